@@ -18,8 +18,6 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #pragma once
 
-#if USE_CLIENT
-
 typedef struct asyncwork_s {
     void (*work_cb)(void *);
     void (*done_cb)(void *);
@@ -27,14 +25,12 @@ typedef struct asyncwork_s {
     struct asyncwork_s *next;
 } asyncwork_t;
 
+typedef void (*parallelwork_t)(void *arg, int index);
+
 void Com_QueueAsyncWork(asyncwork_t *work);
 void Com_CompleteAsyncWork(void);
+void Com_WaitAsyncWork(void);
 void Com_ShutdownAsyncWork(void);
 
-#else
-
-#define Com_QueueAsyncWork(work)    (void)0
-#define Com_CompleteAsyncWork()     (void)0
-#define Com_ShutdownAsyncWork()     (void)0
-
-#endif
+int Com_ParallelWorkers(void);
+void Com_ParallelWork(parallelwork_t func, void *arg, int count);
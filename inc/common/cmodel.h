@@ -29,6 +29,8 @@ typedef struct {
     int         *floodnums;     // if two areas have equal floodnums,
                                 // they are connected
     bool        *portalopen;
+    byte        (*areabits)[MAX_MAP_AREA_BYTES];    // areas connected to
+                                                    // each area
     int         override_bits;
     int         checksum;
     char        *entitystring;
@@ -68,6 +70,10 @@ void        CM_BoxTrace(trace_t *trace,
                         const vec3_t start, const vec3_t end,
                         const vec3_t mins, const vec3_t maxs,
                         const mnode_t *headnode, int brushmask);
+void        CM_ParallelBoxTrace(trace_t *trace,
+                                const vec3_t start, const vec3_t end,
+                                const vec3_t mins, const vec3_t maxs,
+                                const mnode_t *headnode, int brushmask);
 void        CM_TransformedBoxTrace(trace_t *trace,
                                    const vec3_t start, const vec3_t end,
                                    const vec3_t mins, const vec3_t maxs,
@@ -52,9 +52,7 @@ void    FS_Shutdown(void);
 void    FS_Restart(bool total);
 void    FS_AddConfigFiles(bool init);
 
-#if USE_CLIENT
 int FS_RenameFile(const char *from, const char *to);
-#endif
 
 int FS_CreatePath(char *path);
 
@@ -91,6 +89,10 @@ int64_t FS_Tell(qhandle_t f);
 int FS_Seek(qhandle_t f, int64_t offset, int whence);
 
 int64_t FS_Length(qhandle_t f);
+int FS_GetFileInfo(qhandle_t f, file_info_t *info);
+
+void FS_UpdateIndex(void);
+// call after creating files bypassing the filesystem
 
 bool FS_WildCmp(const char *filter, const char *string);
 bool FS_ExtCmp(const char *extension, const char *string);
@@ -0,0 +1,39 @@
+/*
+Copyright (C) 2026 agent <agent@local>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#pragma once
+
+//
+// Log files written by background thread. Writing never blocks: data that
+// doesn't fit into the buffer while disk is stalled is dropped, and number
+// of dropped lines is noted in the log once there is space again.
+//
+// All functions must be called from the main thread.
+//
+
+typedef struct logwriter_s logwriter_t;
+
+logwriter_t *Com_OpenLogWriter(qhandle_t f, bool flush);
+void Com_WriteLog(logwriter_t *w, const void *data, size_t len);
+void Com_FlushLogWriter(logwriter_t *w);
+int Com_CloseLogWriter(logwriter_t *w);
+
+int Com_LogWriterError(const logwriter_t *w);
+unsigned Com_LogWriterDropped(const logwriter_t *w);
+
+void Com_LogPrintf(logwriter_t *w, const char *fmt, ...) q_printf(2, 3);
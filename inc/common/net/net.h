@@ -101,6 +101,15 @@ typedef struct {
     fifo_t send;
 } netstream_t;
 
+typedef struct {
+    uint64_t    bytes_rcvd;
+    uint64_t    bytes_sent;
+    uint64_t    packets_rcvd;
+    uint64_t    packets_sent;
+    uint64_t    recv_errors;
+    uint64_t    send_errors;
+} netstats_t;
+
 #if USE_CLIENT
 #define     NET_IsLocalAddress(adr)     ((adr)->type == NA_LOOPBACK)
 #else
@@ -188,6 +197,7 @@ void        NET_Init(void);
 void        NET_Shutdown(void);
 void        NET_Config(netflag_t flag);
 void        NET_UpdateStats(void);
+void        NET_GetStats(netstats_t *stats);
 
 bool        NET_GetAddress(netsrc_t sock, netadr_t *adr);
 void        NET_GetPackets(netsrc_t sock, void (*packet_cb)(void));
@@ -211,6 +221,15 @@ neterr_t    NET_RunConnect(netstream_t *s);
 neterr_t    NET_RunStream(netstream_t *s);
 void        NET_UpdateStream(netstream_t *s);
 
+#if USE_TESTS
+struct pollfd   *NET_OpenUdp(const char *iface, int port);
+void            NET_CloseUdp(struct pollfd *s);
+bool            NET_SendUdp(struct pollfd *s, const void *data,
+                            size_t len, const netadr_t *to);
+void            NET_GetUdp(struct pollfd *s, void (*packet_cb)(void));
+bool            NET_GetUdpAddress(struct pollfd *s, netadr_t *adr);
+#endif
+
 struct pollfd   *NET_AllocPollFd(void);
 void            NET_FreePollFd(struct pollfd *e);
 
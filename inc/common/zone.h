@@ -60,6 +60,7 @@ char    *Z_TagCopyString(const char *in, memtag_t tag);
 void    Z_FreeTags(memtag_t tag);
 void    Z_LeakTest(memtag_t tag);
 void    Z_Stats_f(void);
+const char *Z_TagStats(memtag_t tag, size_t *bytes, size_t *count);
 
 // may return pointer to static memory
 char    *Z_CvarCopyString(const char *in);
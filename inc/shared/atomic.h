@@ -20,6 +20,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #ifdef _MSC_VER
 typedef volatile int atomic_int;
+typedef volatile unsigned atomic_uint;
 #define atomic_load(p)      (*(p))
 #define atomic_store(p, v)  (*(p) = (v))
 #else
@@ -323,12 +323,14 @@ typedef struct {
  * 2 - Added CustomizeEntity().
  * 3 - Added EntityVisibleToClient(), renamed CustomizeEntity() to
  * CustomizeEntityToClient() and changed the meaning of return value.
+ * 4 - Added TraceWorld() and TraceEntities().
  */
 
 #define GAME3_API_VERSION_EX_MINIMUM             1
 #define GAME3_API_VERSION_EX_CUSTOMIZE_ENTITY    2
 #define GAME3_API_VERSION_EX_ENTITY_VISIBLE      3
-#define GAME3_API_VERSION_EX                     3
+#define GAME3_API_VERSION_EX_WORLD_TRACE         4
+#define GAME3_API_VERSION_EX                     4
 
 typedef enum {
     VIS_PVS     = 0,
@@ -341,6 +343,12 @@ typedef struct {
     game3_entity_state_extension_t x;
 } game3_customize_entity_t;
 
+typedef struct {
+    vec3_t          start, mins, maxs, end;
+    int             contentmask;
+    game3_trace_t   trace;
+} game3_worldtrace_t;
+
 typedef struct {
     uint32_t    apiversion;
     uint32_t    structsize;
@@ -352,6 +360,12 @@ typedef struct {
 
     void        *(*GetExtension)(const char *name);
     void        *(*TagRealloc)(void *ptr, size_t size);
+
+    // clips all boxes to world only, splitting work across threads
+    void        (*TraceWorld)(game3_worldtrace_t *traces, int count);
+    // clips trace returned by TraceWorld() to solid entities, result is the
+    // same as trace() with the same arguments would return
+    void        (*TraceEntities)(game3_worldtrace_t *trace, game3_edict_t *passent);
 } game3_import_ex_t;
 
 typedef struct {
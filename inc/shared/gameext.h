@@ -65,3 +65,19 @@ typedef struct {
     void (*AddDebugText)(const vec3_t origin, const vec3_t angles, const char *text,
                          float size, uint32_t color, uint32_t time, qboolean depth_test);
 } debug_draw_api_v1_t;
+
+#define WORLD_TRACE_API_V1 "WORLD_TRACE_API_V1"
+
+typedef struct {
+    vec3_t      start, mins, maxs, end;
+    contents_t  contentmask;
+    trace_t     trace;
+} worldtrace_t;
+
+typedef struct {
+    // clips all boxes to world only, splitting work across threads
+    void (*TraceWorld)(worldtrace_t *traces, int count);
+    // clips trace returned by TraceWorld() to solid entities, result is the
+    // same as trace() with the same arguments would return
+    void (*TraceEntities)(worldtrace_t *trace, edict_t *passent);
+} world_trace_api_v1_t;
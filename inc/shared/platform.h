@@ -94,6 +94,12 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #define q_has_builtin(x)    0
 #endif
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define HAVE_SSE2   1
+#else
+#define HAVE_SSE2   0
+#endif
+
 #ifdef __GNUC__
 
 #if (__GNUC__ > 4) || (__GNUC__ == 4 && __GNUC_MINOR__ >= 4)
@@ -143,6 +149,8 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #define q_forceinline       inline __attribute__((always_inline))
 
+#define q_thread_local      __thread
+
 #else /* __GNUC__ */
 
 #ifdef _MSC_VER
@@ -152,6 +160,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #define q_alignof(t)        __alignof(t)
 #define q_unreachable()     __assume(0)
 #define q_forceinline       __forceinline
+#define q_thread_local      __declspec(thread)
 #else
 #define q_noreturn
 #define q_noinline
@@ -159,6 +168,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #define q_alignof(t)        1
 #define q_unreachable()     abort()
 #define q_forceinline       inline
+#define q_thread_local      _Thread_local
 #endif
 
 #define q_printf(f, a)
@@ -20,14 +20,17 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "common/async.h"
 #include "common/zone.h"
 #include "system/pthread.h"
+#include "system/system.h"
 
 static bool work_initialized;
 static bool work_terminate;
 static pthread_mutex_t work_lock;
 static pthread_cond_t work_cond;
+static pthread_cond_t work_done_cond;
 static pthread_t work_thread;
 static asyncwork_t *pend_head;
 static asyncwork_t *done_head;
+static bool work_busy;
 
 static void append_work(asyncwork_t **head, asyncwork_t *work)
 {
@@ -49,12 +52,15 @@ static void *work_func(void *arg)
         if (!work)
             break;
         pend_head = work->next;
+        work_busy = true;
 
         pthread_mutex_unlock(&work_lock);
         work->work_cb(work->cb_arg);
         pthread_mutex_lock(&work_lock);
 
         append_work(&done_head, work);
+        work_busy = false;
+        pthread_cond_broadcast(&work_done_cond);
     }
     pthread_mutex_unlock(&work_lock);
 
@@ -66,6 +72,7 @@ void Com_QueueAsyncWork(asyncwork_t *work)
     if (!work_initialized) {
         pthread_mutex_init(&work_lock, NULL);
         pthread_cond_init(&work_cond, NULL);
+        pthread_cond_init(&work_done_cond, NULL);
         if (pthread_create(&work_thread, NULL, work_func, NULL))
             Com_Error(ERR_FATAL, "Couldn't create async work thread");
         work_initialized = true;
@@ -78,14 +85,11 @@ void Com_QueueAsyncWork(asyncwork_t *work)
     pthread_cond_signal(&work_cond);
 }
 
-void Com_CompleteAsyncWork(void)
+// called with work_lock held
+static void complete_work(void)
 {
     asyncwork_t *work, *next;
 
-    if (!work_initialized)
-        return;
-    if (pthread_mutex_trylock(&work_lock))
-        return;
     if (q_unlikely(done_head)) {
         for (work = done_head; work; work = next) {
             next = work->next;
@@ -95,11 +99,183 @@ void Com_CompleteAsyncWork(void)
         }
         done_head = NULL;
     }
+}
+
+void Com_CompleteAsyncWork(void)
+{
+    if (!work_initialized)
+        return;
+    if (pthread_mutex_trylock(&work_lock))
+        return;
+    complete_work();
+    pthread_mutex_unlock(&work_lock);
+}
+
+// blocks until all queued work is done and runs completion callbacks
+void Com_WaitAsyncWork(void)
+{
+    if (!work_initialized)
+        return;
+
+    pthread_mutex_lock(&work_lock);
+    while (pend_head || work_busy)
+        pthread_cond_wait(&work_done_cond, &work_lock);
+    complete_work();
     pthread_mutex_unlock(&work_lock);
 }
 
+/*
+==============================================================================
+
+PARALLEL WORK
+
+Worker pool for splitting CPU-bound loops across all cores. Items are picked
+in order by pool threads and by the calling thread, and Com_ParallelWork()
+returns only when all of them are done. Work callbacks may use zone memory,
+but must not touch anything else that is owned by the main thread.
+
+==============================================================================
+*/
+
+#define MAX_POOL_THREADS    15
+
+static int              pool_numthreads = -1;
+static bool             pool_terminate;
+static pthread_mutex_t  pool_lock;
+static pthread_cond_t   pool_work_cond;
+static pthread_cond_t   pool_done_cond;
+static pthread_t        pool_threads[MAX_POOL_THREADS];
+
+static parallelwork_t   pool_func;
+static void             *pool_arg;
+static int              pool_next;
+static int              pool_count;
+static int              pool_busy;
+
+// called with pool_lock held
+static void run_pool_items(void)
+{
+    while (pool_next < pool_count) {
+        int index = pool_next++;
+        pool_busy++;
+
+        pthread_mutex_unlock(&pool_lock);
+        pool_func(pool_arg, index);
+        pthread_mutex_lock(&pool_lock);
+
+        pool_busy--;
+    }
+}
+
+static void *pool_func_thread(void *arg)
+{
+    pthread_mutex_lock(&pool_lock);
+    while (1) {
+        while (pool_next >= pool_count && !pool_terminate)
+            pthread_cond_wait(&pool_work_cond, &pool_lock);
+
+        if (pool_terminate)
+            break;
+
+        run_pool_items();
+
+        if (!pool_busy)
+            pthread_cond_signal(&pool_done_cond);
+    }
+    pthread_mutex_unlock(&pool_lock);
+
+    return NULL;
+}
+
+static void init_pool(void)
+{
+    int i, count = min(Sys_GetNumCPUs() - 1, MAX_POOL_THREADS);
+
+    pthread_mutex_init(&pool_lock, NULL);
+    pthread_cond_init(&pool_work_cond, NULL);
+    pthread_cond_init(&pool_done_cond, NULL);
+
+    for (i = 0; i < count; i++)
+        if (pthread_create(&pool_threads[i], NULL, pool_func_thread, NULL))
+            break;
+
+    pool_numthreads = i;
+}
+
+static void shutdown_pool(void)
+{
+    if (pool_numthreads < 0)
+        return;
+
+    pthread_mutex_lock(&pool_lock);
+    pool_terminate = true;
+    pthread_mutex_unlock(&pool_lock);
+
+    pthread_cond_broadcast(&pool_work_cond);
+
+    for (int i = 0; i < pool_numthreads; i++)
+        Q_assert(!pthread_join(pool_threads[i], NULL));
+
+    pthread_mutex_destroy(&pool_lock);
+    pthread_cond_destroy(&pool_work_cond);
+    pthread_cond_destroy(&pool_done_cond);
+    pool_numthreads = -1;
+    pool_terminate = false;
+}
+
+/*
+=================
+Com_ParallelWorkers
+
+Returns number of threads that will run parallel work, excluding the
+calling thread.
+=================
+*/
+int Com_ParallelWorkers(void)
+{
+    if (pool_numthreads < 0)
+        init_pool();
+
+    return pool_numthreads;
+}
+
+/*
+=================
+Com_ParallelWork
+
+Calls func(arg, index) for every index in [0, count). Must be called from
+the main thread and is not reentrant.
+=================
+*/
+void Com_ParallelWork(parallelwork_t func, void *arg, int count)
+{
+    if (count > 1 && Com_ParallelWorkers() > 0) {
+        pthread_mutex_lock(&pool_lock);
+        Q_assert(pool_next >= pool_count);
+        pool_func = func;
+        pool_arg = arg;
+        pool_next = 0;
+        pool_count = count;
+        pthread_cond_broadcast(&pool_work_cond);
+
+        run_pool_items();
+
+        while (pool_busy)
+            pthread_cond_wait(&pool_done_cond, &pool_lock);
+        pool_func = NULL;
+        pool_arg = NULL;
+        pthread_mutex_unlock(&pool_lock);
+        return;
+    }
+
+    for (int i = 0; i < count; i++)
+        func(arg, i);
+}
+
 void Com_ShutdownAsyncWork(void)
 {
+    shutdown_pool();
+
     if (!work_initialized)
         return;
 
@@ -114,5 +290,6 @@ void Com_ShutdownAsyncWork(void)
 
     pthread_mutex_destroy(&work_lock);
     pthread_cond_destroy(&work_cond);
+    pthread_cond_destroy(&work_done_cond);
     work_initialized = false;
 }
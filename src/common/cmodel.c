@@ -173,6 +173,7 @@ void CM_FreeMap(cm_t *cm)
 {
     Z_Free(cm->portalopen);
     Z_Free(cm->floodnums);
+    Z_Free(cm->areabits);
 
     if (cm->override_bits & OVERRIDE_ENTS)
         Z_Free(cm->entitystring);
@@ -229,6 +230,7 @@ int CM_LoadMap(cm_t *cm, const char *name)
 
     cm->floodnums = Z_TagMallocz(sizeof(cm->floodnums[0]) * cm->cache->numareas, TAG_CMODEL);
     cm->portalopen = Z_TagMallocz(sizeof(cm->portalopen[0]) * cm->cache->numportals, TAG_CMODEL);
+    cm->areabits = Z_TagMallocz(sizeof(cm->areabits[0]) * cm->cache->numareas, TAG_CMODEL);
     FloodAreaConnections(cm);
 
     fix_incorrect_leaf_contents(cm);
@@ -364,31 +366,33 @@ CM_BoxLeafnums
 Fills in a list of all the leafs touched
 =============
 */
-static int              leaf_count, leaf_maxcount;
-static const mleaf_t    **leaf_list;
-static const vec_t      *leaf_mins, *leaf_maxs;
-static const mnode_t    *leaf_topnode;
-
-static void CM_BoxLeafs_r(const mnode_t *node)
+typedef struct {
+    int             count, maxcount;
+    const mleaf_t   **list;
+    const vec_t     *mins, *maxs;
+    const mnode_t   *topnode;
+} boxleafs_t;
+
+static void CM_BoxLeafs_r(boxleafs_t *bl, const mnode_t *node)
 {
     while (node->plane) {
-        box_plane_t s = BoxOnPlaneSideFast(leaf_mins, leaf_maxs, node->plane);
+        box_plane_t s = BoxOnPlaneSideFast(bl->mins, bl->maxs, node->plane);
         if (s == BOX_INFRONT) {
             node = node->children[0];
         } else if (s == BOX_BEHIND) {
             node = node->children[1];
         } else {
             // go down both
-            if (!leaf_topnode) {
-                leaf_topnode = node;
+            if (!bl->topnode) {
+                bl->topnode = node;
             }
-            CM_BoxLeafs_r(node->children[0]);
+            CM_BoxLeafs_r(bl, node->children[0]);
             node = node->children[1];
         }
     }
 
-    if (leaf_count < leaf_maxcount) {
-        leaf_list[leaf_count++] = (const mleaf_t *)node;
+    if (bl->count < bl->maxcount) {
+        bl->list[bl->count++] = (const mleaf_t *)node;
     }
 }
 
@@ -396,20 +400,19 @@ int CM_BoxLeafs_headnode(const vec3_t mins, const vec3_t maxs,
                          const mleaf_t **list, int listsize,
                          const mnode_t *headnode, const mnode_t **topnode)
 {
-    leaf_list = list;
-    leaf_count = 0;
-    leaf_maxcount = listsize;
-    leaf_mins = mins;
-    leaf_maxs = maxs;
-
-    leaf_topnode = NULL;
+    boxleafs_t bl = {
+        .maxcount = listsize,
+        .list = list,
+        .mins = mins,
+        .maxs = maxs,
+    };
 
-    CM_BoxLeafs_r(headnode);
+    CM_BoxLeafs_r(&bl, headnode);
 
     if (topnode)
-        *topnode = leaf_topnode;
+        *topnode = bl.topnode;
 
-    return leaf_count;
+    return bl.count;
 }
 
 /*
@@ -452,20 +455,29 @@ BOX TRACING
 // 1/32 epsilon to keep floating point happy
 #define DIST_EPSILON    (1 / 32.f)
 
-static vec3_t   trace_start, trace_end;
-static vec3_t   trace_offsets[8];
-static vec3_t   trace_extents;
+// parallel traces can't mark brushes, they keep a short list instead
+#define MAX_CHECKED_BRUSHES 64
+
+typedef struct {
+    vec3_t      start, end;
+    vec3_t      offsets[8];
+    vec3_t      extents;
 
-static trace_t  *trace_trace;
-static int      trace_contents;
-static bool     trace_ispoint;      // optimized case
+    trace_t     *trace;
+    int         contents;
+    bool        ispoint;        // optimized case
+
+    bool        parallel;
+    int         numchecked;
+    const mbrush_t  *checked[MAX_CHECKED_BRUSHES];
+} tracework_t;
 
 /*
 ================
 CM_ClipBoxToBrush
 ================
 */
-static void CM_ClipBoxToBrush(const vec3_t p1, const vec3_t p2, trace_t *trace, const mbrush_t *brush)
+static void CM_ClipBoxToBrush(const tracework_t *tw, const vec3_t p1, const vec3_t p2, trace_t *trace, const mbrush_t *brush)
 {
     int         i;
     const cplane_t  *plane, *clipplane[2];
@@ -492,10 +504,10 @@ static void CM_ClipBoxToBrush(const vec3_t p1, const vec3_t p2, trace_t *trace,
         plane = side->plane;
 
         // FIXME: special case for axial
-        if (!trace_ispoint) {
+        if (!tw->ispoint) {
             // general box case
             // push the plane out apropriately for mins/maxs
-            dist = DotProduct(trace_offsets[plane->signbits], plane->normal);
+            dist = DotProduct(tw->offsets[plane->signbits], plane->normal);
             dist = plane->dist - dist;
         } else {
             // special point case
@@ -582,7 +594,7 @@ static void CM_ClipBoxToBrush(const vec3_t p1, const vec3_t p2, trace_t *trace,
 CM_TestBoxInBrush
 ================
 */
-static void CM_TestBoxInBrush(const vec3_t p1, trace_t *trace, const mbrush_t *brush)
+static void CM_TestBoxInBrush(const tracework_t *tw, const vec3_t p1, trace_t *trace, const mbrush_t *brush)
 {
     int         i;
     const cplane_t  *plane;
@@ -600,7 +612,7 @@ static void CM_TestBoxInBrush(const vec3_t p1, trace_t *trace, const mbrush_t *b
         // FIXME: special case for axial
         // general box case
         // push the plane out apropriately for mins/maxs
-        dist = DotProduct(trace_offsets[plane->signbits], plane->normal);
+        dist = DotProduct(tw->offsets[plane->signbits], plane->normal);
         dist = plane->dist - dist;
 
         d1 = DotProduct(p1, plane->normal) - dist;
@@ -616,30 +628,58 @@ static void CM_TestBoxInBrush(const vec3_t p1, trace_t *trace, const mbrush_t *b
     trace->contents = brush->contents;
 }
 
+/*
+================
+CM_CheckBrush
+
+Returns false if brush was already checked in another leaf.
+================
+*/
+static bool CM_CheckBrush(tracework_t *tw, mbrush_t *b)
+{
+    int i;
+
+    if (!tw->parallel) {
+        if (b->checkcount == checkcount)
+            return false;
+        b->checkcount = checkcount;
+        return true;
+    }
+
+    for (i = 0; i < tw->numchecked; i++)
+        if (tw->checked[i] == b)
+            return false;
+
+    // if list is full, brush will be checked again, which doesn't change
+    // the result
+    if (tw->numchecked < MAX_CHECKED_BRUSHES)
+        tw->checked[tw->numchecked++] = b;
+    return true;
+}
+
 /*
 ================
 CM_TraceToLeaf
 ================
 */
-static void CM_TraceToLeaf(const mleaf_t *leaf)
+static void CM_TraceToLeaf(tracework_t *tw, const mleaf_t *leaf)
 {
     int         k;
     mbrush_t    *b, **leafbrush;
 
-    if (!(leaf->contents & trace_contents))
+    if (!(leaf->contents & tw->contents))
         return;
     // trace line against all brushes in the leaf
     leafbrush = leaf->firstleafbrush;
     for (k = 0; k < leaf->numleafbrushes; k++, leafbrush++) {
         b = *leafbrush;
-        if (b->checkcount == checkcount)
-            continue;   // already checked this brush in another leaf
-        b->checkcount = checkcount;
+        if (!CM_CheckBrush(tw, b))
+            continue;
 
-        if (!(b->contents & trace_contents))
+        if (!(b->contents & tw->contents))
             continue;
-        CM_ClipBoxToBrush(trace_start, trace_end, trace_trace, b);
-        if (!trace_trace->fraction)
+        CM_ClipBoxToBrush(tw, tw->start, tw->end, tw->trace, b);
+        if (!tw->trace->fraction)
             return;
     }
 }
@@ -649,25 +689,24 @@ static void CM_TraceToLeaf(const mleaf_t *leaf)
 CM_TestInLeaf
 ================
 */
-static void CM_TestInLeaf(const mleaf_t *leaf)
+static void CM_TestInLeaf(tracework_t *tw, const mleaf_t *leaf)
 {
     int         k;
     mbrush_t    *b, **leafbrush;
 
-    if (!(leaf->contents & trace_contents))
+    if (!(leaf->contents & tw->contents))
         return;
     // trace line against all brushes in the leaf
     leafbrush = leaf->firstleafbrush;
     for (k = 0; k < leaf->numleafbrushes; k++, leafbrush++) {
         b = *leafbrush;
-        if (b->checkcount == checkcount)
-            continue;   // already checked this brush in another leaf
-        b->checkcount = checkcount;
+        if (!CM_CheckBrush(tw, b))
+            continue;
 
-        if (!(b->contents & trace_contents))
+        if (!(b->contents & tw->contents))
             continue;
-        CM_TestBoxInBrush(trace_start, trace_trace, b);
-        if (!trace_trace->fraction)
+        CM_TestBoxInBrush(tw, tw->start, tw->trace, b);
+        if (!tw->trace->fraction)
             return;
     }
 }
@@ -678,7 +717,7 @@ CM_RecursiveHullCheck
 
 ==================
 */
-static void CM_RecursiveHullCheck(const mnode_t *node, float p1f, float p2f, const vec3_t p1, const vec3_t p2)
+static void CM_RecursiveHullCheck(tracework_t *tw, const mnode_t *node, float p1f, float p2f, const vec3_t p1, const vec3_t p2)
 {
     const cplane_t  *plane;
     float       t1, t2, offset;
@@ -688,14 +727,14 @@ static void CM_RecursiveHullCheck(const mnode_t *node, float p1f, float p2f, con
     int         side;
     float       midf;
 
-    if (trace_trace->fraction <= p1f)
+    if (tw->trace->fraction <= p1f)
         return;     // already hit something nearer
 
 recheck:
     // if plane is NULL, we are in a leaf node
     plane = node->plane;
     if (!plane) {
-        CM_TraceToLeaf((const mleaf_t *)node);
+        CM_TraceToLeaf(tw, (const mleaf_t *)node);
         return;
     }
 
@@ -706,16 +745,16 @@ recheck:
     if (plane->type < 3) {
         t1 = p1[plane->type] - plane->dist;
         t2 = p2[plane->type] - plane->dist;
-        offset = trace_extents[plane->type];
+        offset = tw->extents[plane->type];
     } else {
         t1 = PlaneDiff(p1, plane);
         t2 = PlaneDiff(p2, plane);
-        if (trace_ispoint)
+        if (tw->ispoint)
             offset = 0;
         else
-            offset = fabsf(trace_extents[0] * plane->normal[0]) +
-                     fabsf(trace_extents[1] * plane->normal[1]) +
-                     fabsf(trace_extents[2] * plane->normal[2]);
+            offset = fabsf(tw->extents[0] * plane->normal[0]) +
+                     fabsf(tw->extents[1] * plane->normal[1]) +
+                     fabsf(tw->extents[2] * plane->normal[2]);
     }
 
     // see which sides we need to consider
@@ -752,47 +791,40 @@ recheck:
     midf = p1f + (p2f - p1f) * frac;
     LerpVector(p1, p2, frac, mid);
 
-    CM_RecursiveHullCheck(node->children[side], p1f, midf, p1, mid);
+    CM_RecursiveHullCheck(tw, node->children[side], p1f, midf, p1, mid);
 
     // go past the node
     midf = p1f + (p2f - p1f) * frac2;
     LerpVector(p1, p2, frac2, mid);
 
-    CM_RecursiveHullCheck(node->children[side ^ 1], midf, p2f, mid, p2);
+    CM_RecursiveHullCheck(tw, node->children[side ^ 1], midf, p2f, mid, p2);
 }
 
 //======================================================================
 
-/*
-==================
-CM_BoxTrace
-==================
-*/
-void CM_BoxTrace(trace_t *trace,
-                 const vec3_t start, const vec3_t end,
-                 const vec3_t mins, const vec3_t maxs,
-                 const mnode_t *headnode, int brushmask)
+static void CM_TraceWork(tracework_t *tw, trace_t *trace,
+                         const vec3_t start, const vec3_t end,
+                         const vec3_t mins, const vec3_t maxs,
+                         const mnode_t *headnode, int brushmask)
 {
     const vec_t *bounds[2] = { mins, maxs };
     int i, j;
 
-    checkcount++;       // for multi-check avoidance
-
     // fill in a default trace
-    trace_trace = trace;
-    memset(trace_trace, 0, sizeof(*trace_trace));
-    trace_trace->fraction = 1;
-    trace_trace->surface = &(nulltexinfo.c);
+    tw->trace = trace;
+    memset(trace, 0, sizeof(*trace));
+    trace->fraction = 1;
+    trace->surface = &(nulltexinfo.c);
 
     if (!headnode)
         return;
 
-    trace_contents = brushmask;
-    VectorCopy(start, trace_start);
-    VectorCopy(end, trace_end);
+    tw->contents = brushmask;
+    VectorCopy(start, tw->start);
+    VectorCopy(end, tw->end);
     for (i = 0; i < 8; i++)
         for (j = 0; j < 3; j++)
-            trace_offsets[i][j] = bounds[(i >> j) & 1][j];
+            tw->offsets[i][j] = bounds[(i >> j) & 1][j];
 
     //
     // check for position test special case
@@ -809,11 +841,11 @@ void CM_BoxTrace(trace_t *trace,
 
         numleafs = CM_BoxLeafs_headnode(c1, c2, leafs, q_countof(leafs), headnode, NULL);
         for (i = 0; i < numleafs; i++) {
-            CM_TestInLeaf(leafs[i]);
-            if (trace_trace->allsolid)
+            CM_TestInLeaf(tw, leafs[i]);
+            if (trace->allsolid)
                 break;
         }
-        VectorCopy(start, trace_trace->endpos);
+        VectorCopy(start, trace->endpos);
         return;
     }
 
@@ -821,24 +853,62 @@ void CM_BoxTrace(trace_t *trace,
     // check for point special case
     //
     if (VectorEmpty(mins) && VectorEmpty(maxs)) {
-        trace_ispoint = true;
-        VectorClear(trace_extents);
+        tw->ispoint = true;
+        VectorClear(tw->extents);
     } else {
-        trace_ispoint = false;
-        trace_extents[0] = max(-mins[0], maxs[0]);
-        trace_extents[1] = max(-mins[1], maxs[1]);
-        trace_extents[2] = max(-mins[2], maxs[2]);
+        tw->ispoint = false;
+        tw->extents[0] = max(-mins[0], maxs[0]);
+        tw->extents[1] = max(-mins[1], maxs[1]);
+        tw->extents[2] = max(-mins[2], maxs[2]);
     }
 
     //
     // general sweeping through world
     //
-    CM_RecursiveHullCheck(headnode, 0, 1, start, end);
+    CM_RecursiveHullCheck(tw, headnode, 0, 1, start, end);
 
-    if (trace_trace->fraction == 1)
-        VectorCopy(end, trace_trace->endpos);
+    if (trace->fraction == 1)
+        VectorCopy(end, trace->endpos);
     else
-        LerpVector(start, end, trace_trace->fraction, trace_trace->endpos);
+        LerpVector(start, end, trace->fraction, trace->endpos);
+}
+
+/*
+==================
+CM_BoxTrace
+==================
+*/
+void CM_BoxTrace(trace_t *trace,
+                 const vec3_t start, const vec3_t end,
+                 const vec3_t mins, const vec3_t maxs,
+                 const mnode_t *headnode, int brushmask)
+{
+    tracework_t tw;
+
+    checkcount++;       // for multi-check avoidance
+
+    tw.parallel = false;
+    CM_TraceWork(&tw, trace, start, end, mins, maxs, headnode, brushmask);
+}
+
+/*
+==================
+CM_ParallelBoxTrace
+
+Thread safe version of CM_BoxTrace() for parallel work callbacks. Gives
+exactly the same result.
+==================
+*/
+void CM_ParallelBoxTrace(trace_t *trace,
+                         const vec3_t start, const vec3_t end,
+                         const vec3_t mins, const vec3_t maxs,
+                         const mnode_t *headnode, int brushmask)
+{
+    tracework_t tw;
+
+    tw.parallel = true;
+    tw.numchecked = 0;
+    CM_TraceWork(&tw, trace, start, end, mins, maxs, headnode, brushmask);
 }
 
 /*
@@ -934,6 +1004,7 @@ static void FloodAreaConnections(const cm_t *cm)
     int     i;
     marea_t *area;
     int     floodnum;
+    byte    floodbits[MAX_MAP_AREAS][MAX_MAP_AREA_BYTES];
 
     // all current floods are now invalid
     floodvalid++;
@@ -947,6 +1018,16 @@ static void FloodAreaConnections(const cm_t *cm)
         floodnum++;
         FloodArea_r(cm, i, floodnum);
     }
+
+    // portal state changes rarely, but connectivity is queried for every
+    // entity and client each frame, so expand floods into bit vectors
+    memset(floodbits, 0, sizeof(floodbits[0]) * (floodnum + 1));
+    for (i = 1; i < cm->cache->numareas; i++)
+        Q_SetBit(floodbits[cm->floodnums[i]], i);
+
+    memset(cm->areabits[0], 0, sizeof(cm->areabits[0]));
+    for (i = 1; i < cm->cache->numareas; i++)
+        memcpy(cm->areabits[i], floodbits[cm->floodnums[i]], sizeof(cm->areabits[0]));
 }
 
 void CM_SetAreaPortalState(const cm_t *cm, int portalnum, bool open)
@@ -979,11 +1060,8 @@ bool CM_AreasConnected(const cm_t *cm, int area1, int area2)
         Com_EPrintf("%s: area > numareas\n", __func__);
         return false;
     }
-    if (cm->floodnums[area1] == cm->floodnums[area2]) {
-        return true;
-    }
 
-    return false;
+    return Q_IsBitSet(cm->areabits[area1], area2);
 }
 
 /*
@@ -998,8 +1076,6 @@ This is used by the client refreshes to cull visibility
 */
 int CM_WriteAreaBits(const cm_t *cm, byte *buffer, int area)
 {
-    int     i;
-    int     floodnum;
     int     bytes;
 
     if (!cm->cache) {
@@ -1013,14 +1089,7 @@ int CM_WriteAreaBits(const cm_t *cm, byte *buffer, int area)
         // for debugging, send everything
         memset(buffer, 255, bytes);
     } else {
-        memset(buffer, 0, bytes);
-
-        floodnum = cm->floodnums[area];
-        for (i = 0; i < cm->cache->numareas; i++) {
-            if (cm->floodnums[i] == floodnum) {
-                Q_SetBit(buffer, i);
-            }
-        }
+        memcpy(buffer, cm->areabits[area], bytes);
     }
 
     return bytes;
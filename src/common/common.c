@@ -32,6 +32,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "common/field.h"
 #include "common/fifo.h"
 #include "common/files.h"
+#include "common/logwriter.h"
 #include "common/math.h"
 #include "common/mdfour.h"
 #include "common/msg.h"
@@ -61,11 +62,11 @@ static void     (*com_abort_func)(void *);
 static void     *com_abort_arg;
 
 static bool     com_errorEntered;
-static char     com_errorMsg[MAXERRORMSG]; // from Com_Printf/Com_Error
+static q_thread_local char com_errorMsg[MAXERRORMSG]; // from Com_Printf/Com_Error
 
 static int      com_printEntered;
 
-static qhandle_t    com_logFile;
+static logwriter_t  *com_logFile;
 static bool         com_logNewline;
 static bool         com_conNewline;
 
@@ -88,6 +89,7 @@ cvar_t  *logfile_enable;    // 1 = create new, 2 = append to existing
 cvar_t  *logfile_flush;     // 1 = flush after each print
 cvar_t  *logfile_name;
 cvar_t  *logfile_prefix;
+cvar_t  *logfile_gzip;
 cvar_t  *console_prefix;
 
 #if USE_CLIENT
@@ -218,14 +220,22 @@ static void Com_Redirect(const char *msg, size_t total)
 
 static void logfile_close(void)
 {
-    if (!com_logFile) {
+    logwriter_t *w = com_logFile;
+    unsigned dropped;
+
+    if (!w) {
         return;
     }
 
     Com_Printf("Closing console log.\n");
 
-    FS_CloseFile(com_logFile);
-    com_logFile = 0;
+    com_logFile = NULL;
+    dropped = Com_LogWriterDropped(w);
+    Com_CloseLogWriter(w);
+
+    if (dropped) {
+        Com_WPrintf("%u lines dropped from console log.\n", dropped);
+    }
 }
 
 static void logfile_open(void)
@@ -243,6 +253,10 @@ static void logfile_open(void)
         }
     }
 
+    if (logfile_gzip->integer) {
+        mode |= FS_FLAG_GZIP;
+    }
+
     f = FS_EasyOpenFile(buffer, sizeof(buffer), mode | FS_FLAG_TEXT,
                         "logs/", logfile_name->string, ".log");
     if (!f) {
@@ -250,7 +264,14 @@ static void logfile_open(void)
         return;
     }
 
-    com_logFile = f;
+    // disk writes happen in background
+    com_logFile = Com_OpenLogWriter(f, logfile_flush->integer > 0);
+    if (!com_logFile) {
+        Com_EPrintf("Couldn't create log writer thread\n");
+        Cvar_Set("logfile", "0");
+        return;
+    }
+
     com_logNewline = false;
     Com_Printf("Logging console to %s\n", buffer);
 }
@@ -332,15 +353,18 @@ static void logfile_write(print_type_t type, const char *text)
     format_prefix(type, prefix, sizeof(prefix));
 
     size_t len = prefix_lines(buf, sizeof(buf), text, prefix, &com_logNewline);
-    int ret = FS_Write(buf, len, com_logFile);
-    if (ret == len) {
+    Com_WriteLog(com_logFile, buf, len);
+
+    // errors are reported by writer thread asynchronously
+    int ret = Com_LogWriterError(com_logFile);
+    if (!ret) {
         return;
     }
 
     // zero handle BEFORE doing anything else to avoid recursion
-    qhandle_t tmp = com_logFile;
-    com_logFile = 0;
-    FS_CloseFile(tmp);
+    logwriter_t *tmp = com_logFile;
+    com_logFile = NULL;
+    Com_CloseLogWriter(tmp);
     Com_EPrintf("Couldn't write console log: %s\n", Q_ErrorString(ret));
     Cvar_Set("logfile", "0");
 }
@@ -576,7 +600,7 @@ void Com_Error(error_type_t code, const char *fmt, ...)
     }
 
     if (com_logFile) {
-        FS_FPrintf(com_logFile, "FATAL: %s\n", com_errorMsg);
+        Com_LogPrintf(com_logFile, "FATAL: %s\n", com_errorMsg);
     }
 
     SV_Shutdown(va("Server fatal crashed: %s\n", com_errorMsg), ERR_FATAL);
@@ -591,7 +615,7 @@ void Com_Error(error_type_t code, const char *fmt, ...)
 
 abort:
     if (com_logFile) {
-        FS_Flush(com_logFile);
+        Com_FlushLogWriter(com_logFile);
     }
     com_errorEntered = false;
     longjmp(com_abortframe, -1);
@@ -910,6 +934,7 @@ void Qcommon_Init(int argc, char **argv)
     logfile_flush = Cvar_Get("logfile_flush", "0", 0);
     logfile_name = Cvar_Get("logfile_name", "console", 0);
     logfile_prefix = Cvar_Get("logfile_prefix", "[%Y-%m-%d %H:%M] ", 0);
+    logfile_gzip = Cvar_Get("logfile_gzip", "0", 0);
     console_prefix = Cvar_Get("console_prefix", "", 0);
 #if USE_CLIENT
     dedicated = Cvar_Get("dedicated", "0", CVAR_NOSET);
@@ -990,6 +1015,7 @@ void Qcommon_Init(int argc, char **argv)
     logfile_enable->changed = logfile_enable_changed;
     logfile_flush->changed = logfile_param_changed;
     logfile_name->changed = logfile_param_changed;
+    logfile_gzip->changed = logfile_param_changed;
     logfile_enable_changed(logfile_enable);
 
     FS_AddConfigFiles(true);
@@ -1069,6 +1095,8 @@ void Qcommon_Frame(void)
 
     Com_CompleteAsyncWork();
 
+    FS_UpdateIndex();
+
 #if USE_CLIENT
     time_before = time_event = time_between = time_after = 0;
 
@@ -23,6 +23,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "common/error.h"
 #include "common/files.h"
 #include "common/prompt.h"
+#include "common/async.h"
 #include "common/intreadwrite.h"
 #include "system/system.h"
 #include "client/client.h"
@@ -35,6 +36,14 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include <zlib.h>
 #endif
 
+#ifdef __linux__
+#define USE_DIR_INDEX   1
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <unistd.h>
+#endif
+
 #include "common/loc.h"
 
 /*
@@ -55,6 +64,8 @@ QUAKE FILESYSTEM
 
 #if USE_ZLIB
 #define ZIP_BUFSIZE     (1 << 16)   // inflate in blocks of 64k
+#define ZIP_SPAN        (1 << 20)   // distance between seek checkpoints
+#define ZIP_WINDOW      (1 << MAX_WBITS)
 #define ZIP_MAXFILES    (1 << 20)   // 1 million files
 
 #define ZIP_SIZELOCALHEADER         30
@@ -109,10 +120,28 @@ typedef enum {
 typedef struct {
     z_stream    stream;
     int64_t     rest_in;
+    bool        synced;     // started from offset 0 or index point, may extend index
     byte        buffer[ZIP_BUFSIZE];
 } zipstream_t;
 #endif
 
+#if USE_ZLIB
+// inflate state at deflate block boundary, allows resuming decompression
+// from the middle of compressed entry
+typedef struct {
+    int64_t     in;         // offset of first full compressed byte
+    int64_t     out;        // offset in uncompressed data
+    int         bits;       // number of bits of previous byte still unused
+    byte        *window;    // last 32k of uncompressed data
+} zippoint_t;
+
+typedef struct {
+    zippoint_t  *points;
+    int         num_points;
+    bool        complete;   // entry has been inflated to the end
+} zipindex_t;
+#endif
+
 typedef struct packfile_s {
     int64_t     filepos;
     int64_t     filelen;
@@ -120,6 +149,7 @@ typedef struct packfile_s {
     int64_t     complen;
     uint16_t    compmtd;    // compression method, 0 (stored) or Z_DEFLATED
     bool        coherent;   // true if local file header has been checked
+    zipindex_t  *index;     // seek checkpoints, built after first backward seek
 #endif
     uint8_t     namelen;
     uint32_t    nameofs;
@@ -130,6 +160,7 @@ typedef struct {
     filetype_t  type;       // FS_PAK or FS_ZIP
     unsigned    refcount;   // for tracking pack users
     FILE        *fp;
+    int64_t     mtime;
     unsigned    num_files;
     unsigned    hash_size;
     packfile_t  *files;
@@ -138,9 +169,26 @@ typedef struct {
     char        filename[1];
 } pack_t;
 
+#if USE_DIR_INDEX
+typedef struct indexentry_s {
+    struct indexentry_s *hash_next;
+    char        name[1];
+} indexentry_t;
+
+// names of everything below a directory in the search path
+typedef struct {
+    unsigned        num_entries;
+    unsigned        hash_size;
+    indexentry_t    **hash;
+} dirindex_t;
+#endif
+
 typedef struct searchpath_s {
     struct searchpath_s *next;
     pack_t      *pack;        // only one of filename / pack will be used
+#if USE_DIR_INDEX
+    dirindex_t  *index;       // NULL if directory is not indexed
+#endif
     unsigned    mode;
     char        filename[1];
 } searchpath_t;
@@ -157,6 +205,7 @@ typedef struct {
     int         error;      // stream error indicator from read/write operation
     int64_t     position;   // reading position for FS_PAK/FS_ZIP
     int64_t     length;     // total cached file length
+    int64_t     mtime;      // modification time of file or pack it is from
 } file_t;
 
 typedef struct {
@@ -187,15 +236,26 @@ static unsigned     fs_count_read;
 static unsigned     fs_count_open;
 static unsigned     fs_count_strcmp;
 static unsigned     fs_count_strlwr;
+static unsigned     fs_count_skipped;
+static struct {
+    unsigned    num_dirs;
+    unsigned    num_packs;
+    uint64_t    wall_usec;      // time spent adding game directories
+    uint64_t    work_usec;      // sum of individual pack load times
+    uint64_t    max_usec;
+    char        max_path[MAX_OSPATH];
+} fs_pack_stats;
 #define FS_COUNT_READ       fs_count_read++
 #define FS_COUNT_OPEN       fs_count_open++
 #define FS_COUNT_STRCMP     fs_count_strcmp++
 #define FS_COUNT_STRLWR     fs_count_strlwr++
+#define FS_COUNT_SKIPPED    fs_count_skipped++
 #else
 #define FS_COUNT_READ       (void)0
 #define FS_COUNT_OPEN       (void)0
 #define FS_COUNT_STRCMP     (void)0
 #define FS_COUNT_STRLWR     (void)0
+#define FS_COUNT_SKIPPED    (void)0
 #endif
 
 static cvar_t       *fs_autoexec;
@@ -214,6 +274,7 @@ static void open_zip_file(file_t *file);
 static void close_zip_file(file_t *file);
 static int read_zip_file(file_t *file, void *buf, size_t len);
 static int seek_zip_file(file_t *file, int64_t offset, int whence);
+static void free_zip_index(packfile_t *entry);
 #endif
 
 // for tracking users of pack_t instance
@@ -221,6 +282,12 @@ static int seek_zip_file(file_t *file, int64_t offset, int whence);
 static pack_t *pack_get(pack_t *pack);
 static void pack_put(pack_t *pack);
 
+#if USE_DIR_INDEX
+static bool index_missing(searchpath_t *search, const char *name, unsigned hash);
+static void index_free(searchpath_t *search);
+static void poll_index(void);
+#endif
+
 /*
 
 All of Quake's data access is through a hierchal file system,
@@ -470,6 +537,29 @@ int64_t FS_Length(qhandle_t f)
     return file->length;
 }
 
+/*
+================
+FS_GetFileInfo
+
+Returns size and modification time of file opened for reading. For files
+from packs, modification time of the pack is returned.
+================
+*/
+int FS_GetFileInfo(qhandle_t f, file_info_t *info)
+{
+    file_t *file = file_for_handle(f);
+
+    if (!file)
+        return Q_ERR(EBADF);
+
+    if ((file->mode & FS_MODE_MASK) != FS_MODE_READ)
+        return Q_ERR(EBADF);
+
+    info->size = file->length;
+    info->mtime = file->mtime;
+    return Q_ERR_SUCCESS;
+}
+
 /*
 ============
 FS_Tell
@@ -916,6 +1006,10 @@ static int64_t open_file_write(file_t *file, const char *name)
         goto fail;
     }
 
+#if USE_DIR_INDEX
+    poll_index();
+#endif
+
     FS_DPrintf("%s: %s: %"PRId64" bytes\n", __func__, fullpath, pos);
     return pos;
 
@@ -1014,6 +1108,7 @@ static void open_zip_file(file_t *file)
     z->next_in = z->next_out = NULL;
 
     s->rest_in = file->entry->complen;
+    s->synced = file->entry->index;
     file->zfp = s;
 }
 
@@ -1028,13 +1123,108 @@ static void close_zip_file(file_t *file)
     fclose(file->fp);
 }
 
+static void free_zip_index(packfile_t *entry)
+{
+    zipindex_t *index = entry->index;
+
+    if (!index)
+        return;
+
+    for (int i = 0; i < index->num_points; i++)
+        Z_Free(index->points[i].window);
+    Z_Free(index->points);
+    Z_Free(index);
+    entry->index = NULL;
+}
+
+// called at deflate block boundary. points are only added past the last one,
+// and only by handles that started decompression from offset 0 or from
+// existing point while index existed, so there are no gaps. handles that were
+// already past the last point when index was created don't add points.
+static void add_zip_point(zipindex_t *index, z_streamp z, int64_t in, int64_t out)
+{
+    zippoint_t *point;
+    uInt len;
+
+    if (out < (index->num_points ? index->points[index->num_points - 1].out : 0) + ZIP_SPAN)
+        return;
+
+    if (!(index->num_points & 15))
+        index->points = Z_Realloc(index->points, (index->num_points + 16) * sizeof(index->points[0]));
+
+    point = &index->points[index->num_points];
+    point->window = FS_Malloc(ZIP_WINDOW);
+    if (inflateGetDictionary(z, point->window, &len) != Z_OK || len != ZIP_WINDOW) {
+        Z_Free(point->window);
+        return;
+    }
+
+    point->in = in;
+    point->out = out;
+    point->bits = z->data_type & 7;
+    index->num_points++;
+}
+
+// returns last point at or before offset
+static const zippoint_t *find_zip_point(const zipindex_t *index, int64_t offset)
+{
+    int lo = 0, hi = index->num_points;
+
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (index->points[mid].out <= offset)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return lo ? &index->points[lo - 1] : NULL;
+}
+
+// restarts decompression from the given point, or from the start of entry
+static int reset_zip_file(file_t *file, const zippoint_t *point)
+{
+    packfile_t *entry = file->entry;
+    zipstream_t *s = file->zfp;
+    z_streamp z = &s->stream;
+    int64_t in = point ? point->in : 0;
+    int bits = point ? point->bits : 0;
+    int c = 0;
+
+    if (os_fseek(file->fp, entry->filepos + in - (bits > 0), SEEK_SET))
+        return Q_ERRNO;
+
+    if (bits && (c = getc(file->fp)) == EOF)
+        return FS_ERR_READ(file->fp);
+
+    inflateReset(z);
+
+    z->avail_in = z->avail_out = 0;
+    z->next_in = z->next_out = NULL;
+
+    if (point) {
+        if (bits)
+            inflatePrime(z, bits, c >> (8 - bits));
+        inflateSetDictionary(z, point->window, ZIP_WINDOW);
+    }
+
+    s->rest_in = entry->complen - in;
+    s->synced = entry->index;
+    file->position = point ? point->out : 0;
+    return Q_ERR_SUCCESS;
+}
+
 static int read_zip_file(file_t *file, void *buf, size_t len)
 {
     zipstream_t *s = file->zfp;
     z_streamp z = &s->stream;
+    zipindex_t *index = file->entry->index;
     size_t block, result;
     int ret;
 
+    if (index && (index->complete || !s->synced))
+        index = NULL;
+
     Q_assert(file->position <= file->length);
 
     len = min(len, file->length - file->position);
@@ -1066,14 +1256,22 @@ static int read_zip_file(file_t *file, void *buf, size_t len)
             z->avail_in = result;
         }
 
-        ret = inflate(z, Z_SYNC_FLUSH);
+        // stop at block boundaries while building index
+        ret = inflate(z, index ? Z_BLOCK : Z_SYNC_FLUSH);
         if (ret == Z_STREAM_END) {
+            if (index) {
+                index->complete = true;
+            }
             break;
         }
         if (ret != Z_OK) {
             file->error = Q_ERR_INFLATE_FAILED;
             break;
         }
+        if (index && (z->data_type & 128) && !(z->data_type & 64)) {
+            add_zip_point(index, z, file->entry->complen - s->rest_in - z->avail_in,
+                          file->position + len - z->avail_out);
+        }
         if (file->error) {
             break;
         }
@@ -1092,31 +1290,37 @@ static int read_zip_file(file_t *file, void *buf, size_t len)
 static int seek_zip_file(file_t *file, int64_t offset, int whence)
 {
     packfile_t *entry = file->entry;
-    zipstream_t *s = file->zfp;
-    z_streamp z = &s->stream;
+    const zippoint_t *point = NULL;
+    int ret;
 
     offset = get_seek_offset(file, offset, whence);
     if (offset < 0)
         return offset;
 
-    if (offset < file->position) {
-        if (os_fseek(file->fp, entry->filepos, SEEK_SET))
-            return Q_ERRNO;
-
-        inflateReset(z);
+    // start building index on first backward seek
+    if (offset < file->position && !entry->index && entry->filelen > ZIP_SPAN * 2)
+        entry->index = FS_Mallocz(sizeof(*entry->index));
 
-        z->avail_in = z->avail_out = 0;
-        z->next_in = z->next_out = NULL;
+    if (entry->index)
+        point = find_zip_point(entry->index, offset);
 
-        s->rest_in = entry->complen;
-        file->position = 0;
+    // resume from checkpoint if there is one between current and new
+    // position, rewind to the start if seeking backwards otherwise
+    if (point && (offset < file->position || point->out > file->position)) {
+        ret = reset_zip_file(file, point);
+        if (ret)
+            return ret;
+    } else if (offset < file->position) {
+        ret = reset_zip_file(file, NULL);
+        if (ret)
+            return ret;
     }
 
     while (file->position < offset) {
         byte buf[ZIP_BUFSIZE];
 
         int len = min(offset - file->position, sizeof(buf));
-        int ret = read_zip_file(file, buf, len);
+        ret = read_zip_file(file, buf, len);
         if (ret < 0)
             return ret;
         if (ret == 0)
@@ -1178,6 +1382,7 @@ static int64_t open_from_pack(file_t *file, pack_t *pack, packfile_t *entry)
     file->error = Q_ERR_SUCCESS;
     file->position = 0;
     file->length = entry->filelen;
+    file->mtime = pack->mtime;
 
 #if USE_ZLIB
     if (pack->type == FS_ZIP) {
@@ -1293,6 +1498,7 @@ static int64_t open_from_disk(file_t *file, const char *fullpath)
     file->fp = fp;
     file->error = Q_ERR_SUCCESS;
     file->length = info.size;
+    file->mtime = info.mtime;
 
 #if USE_ZLIB
     if (file->mode & FS_FLAG_GZIP) {
@@ -1380,6 +1586,12 @@ static int64_t open_file_read(file_t *file, const char *normalized, size_t namel
             if (valid == PATH_INVALID) {
                 continue;
             }
+#if USE_DIR_INDEX
+            if (index_missing(search, normalized, hash)) {
+                FS_COUNT_SKIPPED;
+                continue;
+            }
+#endif
             // check a file in the directory tree
             if (Q_concat(fullpath, sizeof(fullpath), search->filename,
                          "/", normalized) >= sizeof(fullpath)) {
@@ -1966,8 +2178,6 @@ bool FS_EasyWriteFile(char *buf, size_t size, unsigned mode,
     return true;
 }
 
-#if USE_CLIENT
-
 static int build_absolute_path(char *buffer, const char *path)
 {
     char normalized[MAX_OSPATH];
@@ -2002,11 +2212,13 @@ int FS_RenameFile(const char *from, const char *to)
     if (rename(frompath, topath))
         return Q_ERRNO;
 
+#if USE_DIR_INDEX
+    poll_index();
+#endif
+
     return Q_ERR_SUCCESS;
 }
 
-#endif // USE_CLIENT
-
 /*
 ================
 FS_FPrintf
@@ -2031,6 +2243,10 @@ int FS_FPrintf(qhandle_t f, const char *format, ...)
 
 static void pack_free(pack_t *pack)
 {
+#if USE_ZLIB
+    for (unsigned i = 0; i < pack->num_files; i++)
+        free_zip_index(&pack->files[i]);
+#endif
     fclose(pack->fp);
     Z_Free(pack->names);
     Z_Free(pack->file_hash);
@@ -2058,20 +2274,77 @@ static void pack_put(pack_t *pack)
     }
 }
 
+// pack file directory loaded by worker thread
+typedef struct {
+    char        path[MAX_OSPATH];
+    pack_t      *pack;
+    uint64_t    usec;
+    char        error[MAXERRORMSG];
+    char        warning[MAXERRORMSG];
+#if USE_DEBUG
+    char        debug[MAXERRORMSG];
+#endif
+} packjob_t;
+
+// set while loading on a worker thread
+static q_thread_local packjob_t *pack_job;
+
+// messages from worker threads are saved and printed later by main thread
+q_printf(1, 2)
+static void pack_warning(const char *fmt, ...)
+{
+    char        buffer[MAXERRORMSG];
+    va_list     argptr;
+
+    va_start(argptr, fmt);
+    Q_vsnprintf(buffer, sizeof(buffer), fmt, argptr);
+    va_end(argptr);
+
+    if (pack_job)
+        Q_strlcpy(pack_job->warning, buffer, sizeof(pack_job->warning));
+    else
+        Com_WPrintf("%s", buffer);
+}
+
+#if USE_DEBUG
+q_printf(1, 2)
+static void pack_dprintf(const char *fmt, ...)
+{
+    char        buffer[MAXERRORMSG];
+    va_list     argptr;
+
+    if (!fs_debug || !fs_debug->integer)
+        return;
+
+    va_start(argptr, fmt);
+    Q_vsnprintf(buffer, sizeof(buffer), fmt, argptr);
+    va_end(argptr);
+
+    if (pack_job)
+        Q_strlcpy(pack_job->debug, buffer, sizeof(pack_job->debug));
+    else
+        Com_LPrintf(PRINT_DEVELOPER, "%s", buffer);
+}
+#else
+#define pack_dprintf(...)
+#endif
+
 // allocates pack_t instance along with filenames
 static pack_t *pack_alloc(FILE *fp, filetype_t type, const char *name,
                           unsigned num_files, size_t names_len)
 {
     pack_t *pack;
     size_t len;
+    file_info_t info;
 
     len = strlen(name);
     pack = FS_Malloc(sizeof(*pack) + len);
     pack->type = type;
     pack->refcount = 0;
     pack->fp = fp;
+    pack->mtime = get_fp_info(fp, &info) ? 0 : info.mtime;
     pack->num_files = num_files;
-    pack->files = FS_Malloc(num_files * sizeof(pack->files[0]));
+    pack->files = FS_Mallocz(num_files * sizeof(pack->files[0]));
     pack->hash_size = 0;
     pack->file_hash = NULL;
     pack->names = FS_Malloc(names_len);
@@ -2201,8 +2474,8 @@ static pack_t *load_pak_file(const char *packfile)
 
     pack_calc_hashes(pack);
 
-    FS_DPrintf("%s: %u files, %u hash\n",
-               packfile, pack->num_files, pack->hash_size);
+    pack_dprintf("%s: %u files, %u hash\n",
+                 packfile, pack->num_files, pack->hash_size);
 
     FS_FreeTempMem(info);
     return pack;
@@ -2470,7 +2743,7 @@ static pack_t *load_zip_file(const char *packfile)
 // non-zero for sfx?
     extra_bytes = header_pos - central_end;
     if (extra_bytes) {
-        Com_WPrintf("%s has %"PRId64" extra bytes at the beginning\n", packfile, extra_bytes);
+        pack_warning("%s has %"PRId64" extra bytes at the beginning\n", packfile, extra_bytes);
     }
 
     if (os_fseek(fp, central_ofs + extra_bytes, SEEK_SET)) {
@@ -2518,9 +2791,9 @@ static pack_t *load_zip_file(const char *packfile)
 
     pack_calc_hashes(pack);
 
-    FS_DPrintf("%s: %u files, %u skipped, %u hash%s\n",
-               packfile, pack->num_files, (int)(num_files_cd - num_files),
-               pack->hash_size, zip64 ? ", zip64" : "");
+    pack_dprintf("%s: %u files, %u skipped, %u hash%s\n",
+                 packfile, pack->num_files, (int)(num_files_cd - num_files),
+                 pack->hash_size, zip64 ? ", zip64" : "");
 
     return pack;
 
@@ -2534,6 +2807,366 @@ fail2:
 }
 #endif
 
+#if USE_DIR_INDEX
+
+/*
+=============================================================================
+
+DIRECTORY INDEX
+
+Names of everything below each directory in the search path are indexed when
+the directory is added, and kept up to date with inotify. Names not found in
+the index can't be opened from that directory, so looking them up skips the
+disk entirely. Stale names of removed files are harmless, they just fall
+through to the disk. If anything goes wrong, directory is left unindexed.
+
+Lookups never read inotify events themselves. Events are read once per frame,
+after files are written or renamed by the filesystem, and by FS_UpdateIndex()
+callers that create files directly. Files created by other processes are not
+visible until the next frame.
+
+=============================================================================
+*/
+
+#define MAX_INDEX_DEPTH     32
+
+typedef struct {
+    int             wd;
+    searchpath_t    *search;
+    char            *prefix;    // empty or ends with '/'
+} dirwatch_t;
+
+static int          fs_inotify_fd = -1;
+static dirwatch_t   *fs_watches;
+static int          fs_num_watches;
+
+static indexentry_t *index_find(const dirindex_t *index, const char *name, unsigned hash)
+{
+    indexentry_t *entry;
+
+    for (entry = index->hash[hash & (index->hash_size - 1)]; entry; entry = entry->hash_next) {
+        FS_COUNT_STRCMP;
+        if (!FS_pathcmp(entry->name, name))
+            return entry;
+    }
+
+    return NULL;
+}
+
+static void index_rehash(dirindex_t *index, unsigned hash_size)
+{
+    indexentry_t **hash, *entry, *next;
+    unsigned i, n;
+
+    hash = FS_Mallocz(hash_size * sizeof(hash[0]));
+    for (i = 0; i < index->hash_size; i++) {
+        for (entry = index->hash[i]; entry; entry = next) {
+            next = entry->hash_next;
+            n = FS_HashPath(entry->name, hash_size);
+            entry->hash_next = hash[n];
+            hash[n] = entry;
+        }
+    }
+
+    Z_Free(index->hash);
+    index->hash = hash;
+    index->hash_size = hash_size;
+}
+
+static void index_add(dirindex_t *index, const char *name, size_t len)
+{
+    unsigned hash = FS_HashPath(name, 0);
+    indexentry_t *entry;
+
+    if (index_find(index, name, hash))
+        return;
+
+    entry = FS_Malloc(sizeof(*entry) + len);
+    memcpy(entry->name, name, len + 1);
+    hash &= index->hash_size - 1;
+    entry->hash_next = index->hash[hash];
+    index->hash[hash] = entry;
+
+    if (++index->num_entries > index->hash_size * 2)
+        index_rehash(index, index->hash_size * 4);
+}
+
+static dirwatch_t *find_watch(int wd, const searchpath_t *search)
+{
+    for (int i = 0; i < fs_num_watches; i++)
+        if (fs_watches[i].wd == wd && (!search || fs_watches[i].search == search))
+            return &fs_watches[i];
+
+    return NULL;
+}
+
+static void remove_watch(int i)
+{
+    Z_Free(fs_watches[i].prefix);
+    fs_watches[i] = fs_watches[--fs_num_watches];
+}
+
+static void index_free(searchpath_t *search)
+{
+    dirindex_t *index = search->index;
+    indexentry_t *entry, *next;
+    unsigned i;
+
+    if (!index)
+        return;
+
+    // watch descriptors are shared by search paths with the same directory
+    for (i = 0; i < fs_num_watches;) {
+        int wd = fs_watches[i].wd;
+        if (fs_watches[i].search != search) {
+            i++;
+            continue;
+        }
+        remove_watch(i);
+        if (!find_watch(wd, NULL))
+            inotify_rm_watch(fs_inotify_fd, wd);
+    }
+
+    for (i = 0; i < index->hash_size; i++) {
+        for (entry = index->hash[i]; entry; entry = next) {
+            next = entry->hash_next;
+            Z_Free(entry);
+        }
+    }
+
+    Z_Free(index->hash);
+    Z_Free(index);
+    search->index = NULL;
+}
+
+static bool add_watch(searchpath_t *search, const char *path, const char *prefix, size_t len)
+{
+    dirwatch_t *w;
+    int wd;
+
+    wd = inotify_add_watch(fs_inotify_fd, path, IN_CREATE | IN_MOVED_TO | IN_ONLYDIR);
+    if (wd == -1) {
+        FS_DPrintf("%s: %s: %s\n", __func__, path, strerror(errno));
+        return false;
+    }
+
+    // same directory may be reachable by different paths through symlinks.
+    // events carry only one wd, so such directories can't be indexed.
+    if ((w = find_watch(wd, search)))
+        return !strcmp(w->prefix, prefix);
+
+    if (!(fs_num_watches & 63))
+        fs_watches = Z_Realloc(fs_watches, (fs_num_watches + 64) * sizeof(fs_watches[0]));
+
+    w = &fs_watches[fs_num_watches++];
+    w->wd = wd;
+    w->search = search;
+    w->prefix = FS_Malloc(len + 1);
+    memcpy(w->prefix, prefix, len + 1);
+    return true;
+}
+
+// adds directory below search path and everything in it to the index.
+// watch is added before reading the directory, so nothing can be missed.
+static bool index_scan(searchpath_t *search, char *prefix, size_t len, int depth)
+{
+    char path[MAX_OSPATH];
+    struct dirent *ent;
+    struct stat st;
+    size_t namelen;
+    DIR *dir;
+    bool ret = true;
+
+    if (depth > MAX_INDEX_DEPTH)
+        return false;
+
+    if (Q_concat(path, sizeof(path), search->filename, "/", prefix) >= sizeof(path))
+        return false;
+
+    if (!add_watch(search, path, prefix, len))
+        return false;
+
+    dir = opendir(path);
+    if (!dir)
+        return false;
+
+    while (ret && (ent = readdir(dir))) {
+        if (!strcmp(ent->d_name, ".") || !strcmp(ent->d_name, ".."))
+            continue;
+
+        namelen = strlen(ent->d_name);
+        if (len + namelen + 1 >= MAX_OSPATH) {
+            ret = false;
+            break;
+        }
+
+        memcpy(prefix + len, ent->d_name, namelen + 1);
+        index_add(search->index, prefix, len + namelen);
+
+        if (ent->d_type == DT_DIR) {
+            st.st_mode = S_IFDIR;
+        } else if (ent->d_type == DT_UNKNOWN || ent->d_type == DT_LNK) {
+            if (Q_concat(path, sizeof(path), search->filename, "/", prefix) >= sizeof(path) ||
+                stat(path, &st) == -1)
+                st.st_mode = 0;
+        } else {
+            st.st_mode = 0;
+        }
+
+        if (S_ISDIR(st.st_mode)) {
+            prefix[len + namelen] = '/';
+            prefix[len + namelen + 1] = 0;
+            ret = index_scan(search, prefix, len + namelen + 1, depth + 1);
+        }
+    }
+
+    prefix[len] = 0;
+    closedir(dir);
+    return ret;
+}
+
+static bool index_dir(searchpath_t *search, char *prefix, size_t len)
+{
+    if (index_scan(search, prefix, len, 0))
+        return true;
+
+    FS_DPrintf("Couldn't index %s/%s\n", search->filename, prefix);
+    index_free(search);
+    return false;
+}
+
+static void build_index(searchpath_t *search)
+{
+    char prefix[MAX_OSPATH] = "";
+
+    if (fs_inotify_fd == -1) {
+        fs_inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (fs_inotify_fd == -1) {
+            Com_DPrintf("Couldn't initialize inotify: %s\n", strerror(errno));
+            fs_inotify_fd = -2;
+        }
+    }
+    if (fs_inotify_fd < 0)
+        return;
+
+    search->index = FS_Mallocz(sizeof(*search->index));
+    search->index->hash_size = 256;
+    search->index->hash = FS_Mallocz(256 * sizeof(search->index->hash[0]));
+
+    index_dir(search, prefix, 0);
+}
+
+static void drop_all_indexes(void)
+{
+    searchpath_t *search;
+
+    for (search = fs_searchpaths; search; search = search->next)
+        index_free(search);
+}
+
+static void handle_event(const struct inotify_event *ev)
+{
+    char prefix[MAX_OSPATH];
+    searchpath_t *search;
+    dirwatch_t *w;
+    size_t len;
+    int i;
+
+    if (ev->mask & IN_Q_OVERFLOW) {
+        FS_DPrintf("inotify queue overflow\n");
+        drop_all_indexes();
+        return;
+    }
+
+    // directory went away
+    if (ev->mask & IN_IGNORED) {
+        for (i = 0; i < fs_num_watches;) {
+            if (fs_watches[i].wd == ev->wd)
+                remove_watch(i);
+            else
+                i++;
+        }
+        return;
+    }
+
+    if (!ev->len || !(ev->mask & (IN_CREATE | IN_MOVED_TO)))
+        return;
+
+    for (search = fs_searchpaths; search; search = search->next) {
+        if (!search->index || !(w = find_watch(ev->wd, search)))
+            continue;
+
+        len = Q_concat(prefix, sizeof(prefix), w->prefix, ev->name);
+        if (len >= sizeof(prefix) - 1) {
+            index_free(search);
+            continue;
+        }
+
+        index_add(search->index, prefix, len);
+
+        // new directories need to be watched and may already have something
+        if (ev->mask & IN_ISDIR) {
+            prefix[len++] = '/';
+            prefix[len] = 0;
+            index_dir(search, prefix, len);
+        }
+    }
+}
+
+static void poll_index(void)
+{
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    const struct inotify_event *ev;
+    ssize_t ret;
+    char *p;
+
+    while (fs_num_watches) {
+        ret = read(fs_inotify_fd, buf, sizeof(buf));
+        if (ret <= 0) {
+            if (ret < 0 && errno != EAGAIN) {
+                FS_DPrintf("%s: %s\n", __func__, strerror(errno));
+                drop_all_indexes();
+            }
+            break;
+        }
+        for (p = buf; p < buf + ret; p += sizeof(*ev) + ev->len) {
+            ev = (const struct inotify_event *)p;
+            handle_event(ev);
+        }
+    }
+}
+
+// returns true if name can't exist in indexed directory
+static bool index_missing(searchpath_t *search, const char *name, unsigned hash)
+{
+    return search->index && !index_find(search->index, name, hash);
+}
+
+static void shutdown_index(void)
+{
+    if (fs_inotify_fd >= 0)
+        close(fs_inotify_fd);
+    fs_inotify_fd = -1;
+    Z_Freep(&fs_watches);
+    fs_num_watches = 0;
+}
+
+#endif // USE_DIR_INDEX
+
+/*
+================
+FS_UpdateIndex
+
+Picks up files created without going through filesystem code.
+================
+*/
+void FS_UpdateIndex(void)
+{
+#if USE_DIR_INDEX
+    poll_index();
+#endif
+}
+
 // this is complicated as we need pakXX.pak loaded first,
 // sorted in numerical order, then the rest of the paks in
 // alphabetical order, e.g. pak0.pak, pak2.pak, pak17.pak, abc.pak...
@@ -2564,16 +3197,42 @@ alphacmp:
     return Q_stricmp(s1, s2);
 }
 
+static void load_pack_job(void *arg, int index)
+{
+    packjob_t *job = (packjob_t *)arg + index;
+    uint64_t start = Sys_Microseconds();
+    size_t len = strlen(job->path);
+
+    if (!len)
+        return;
+
+    pack_job = job;
+#if USE_ZLIB
+    // FIXME: guess packfile type by contents instead?
+    if (len > 4 && !Q_stricmp(job->path + len - 4, ".pkz"))
+        job->pack = load_zip_file(job->path);
+    else
+#endif
+        job->pack = load_pak_file(job->path);
+    if (!job->pack)
+        Q_strlcpy(job->error, Com_GetLastError(), sizeof(job->error));
+    pack_job = NULL;
+
+    job->usec = Sys_Microseconds() - start;
+}
+
 // sets fs_gamedir, adds the directory to the head of the path,
 // then loads and adds pak*.pak, then anything else in alphabethical order.
 static void q_printf(2, 3) add_game_dir(unsigned mode, const char *fmt, ...)
 {
     va_list         argptr;
     searchpath_t    *search;
-    pack_t          *pack;
+    packjob_t       *jobs;
     listfiles_t     list;
+#if USE_DEBUG
+    uint64_t        start = Sys_Microseconds();
+#endif
     int             i;
-    char            path[MAX_OSPATH];
     size_t          len;
 
     va_start(argptr, fmt);
@@ -2590,13 +3249,16 @@ static void q_printf(2, 3) add_game_dir(unsigned mode, const char *fmt, ...)
 #endif
 
     // add the directory to the search path
-    search = FS_Malloc(sizeof(*search) + len);
+    search = FS_Mallocz(sizeof(*search) + len);
     search->mode = mode;
-    search->pack = NULL;
     memcpy(search->filename, fs_gamedir, len + 1);
     search->next = fs_searchpaths;
     fs_searchpaths = search;
 
+#if USE_DIR_INDEX
+    build_index(search);
+#endif
+
     // add any pack files
     memset(&list, 0, sizeof(list));
 #if USE_ZLIB
@@ -2612,31 +3274,62 @@ static void q_printf(2, 3) add_game_dir(unsigned mode, const char *fmt, ...)
 
     qsort(list.files, list.count, sizeof(list.files[0]), pakcmp);
 
+    jobs = FS_Mallocz(sizeof(jobs[0]) * list.count);
     for (i = 0; i < list.count; i++) {
-        len = Q_concat(path, sizeof(path), fs_gamedir, "/", list.files[i]);
-        if (len >= sizeof(path)) {
+        if (Q_concat(jobs[i].path, sizeof(jobs[i].path), fs_gamedir,
+                     "/", list.files[i]) >= sizeof(jobs[i].path)) {
             Com_EPrintf("%s: refusing oversize path\n", __func__);
+            jobs[i].path[0] = 0;
+        }
+    }
+
+    // directories are parsed in parallel, but added in sorted order
+    Com_ParallelWork(load_pack_job, jobs, list.count);
+
+    for (i = 0; i < list.count; i++) {
+        packjob_t *job = &jobs[i];
+
+        if (!job->path[0]) {
             continue;
         }
-#if USE_ZLIB
-        // FIXME: guess packfile type by contents instead?
-        if (len > 4 && !Q_stricmp(path + len - 4, ".pkz"))
-            pack = load_zip_file(path);
-        else
+        if (job->warning[0]) {
+            Com_WPrintf("%s", job->warning);
+        }
+#if USE_DEBUG
+        if (job->debug[0]) {
+            Com_LPrintf(PRINT_DEVELOPER, "%s", job->debug);
+        }
 #endif
-            pack = load_pak_file(path);
-        if (!pack) {
-            Com_EPrintf("Couldn't load %s: %s\n", path, Com_GetLastError());
+        if (!job->pack) {
+            Com_EPrintf("Couldn't load %s: %s\n", job->path, job->error);
             continue;
         }
-        search = FS_Malloc(sizeof(*search));
+        search = FS_Mallocz(sizeof(*search));
         search->mode = mode;
         search->filename[0] = 0;
-        search->pack = pack_get(pack);
+        search->pack = pack_get(job->pack);
         search->next = fs_searchpaths;
         fs_searchpaths = search;
     }
 
+#if USE_DEBUG
+    fs_pack_stats.num_dirs++;
+    fs_pack_stats.wall_usec += Sys_Microseconds() - start;
+    for (i = 0; i < list.count; i++) {
+        if (!jobs[i].path[0]) {
+            continue;
+        }
+        fs_pack_stats.num_packs++;
+        fs_pack_stats.work_usec += jobs[i].usec;
+        if (fs_pack_stats.max_usec < jobs[i].usec) {
+            fs_pack_stats.max_usec = jobs[i].usec;
+            Q_strlcpy(fs_pack_stats.max_path, jobs[i].path, sizeof(fs_pack_stats.max_path));
+        }
+    }
+#endif
+
+    Z_Free(jobs);
+
     for (i = 0; i < list.count; i++) {
         Z_Free(list.files[i]);
     }
@@ -3323,6 +4016,24 @@ static void FS_Stats_f(void)
     Com_Printf("Total calls to open_from_disk: %u\n", fs_count_open);
     Com_Printf("Total mixed-case reopens: %u\n", fs_count_strlwr);
 
+    Com_Printf("Pack files loaded: %u in %u directories\n",
+               fs_pack_stats.num_packs, fs_pack_stats.num_dirs);
+    if (fs_pack_stats.num_packs) {
+        Com_Printf("Game directory loading time: %.1f ms (%.1f ms pack loading work, %d worker threads)\n",
+                   fs_pack_stats.wall_usec * 1e-3, fs_pack_stats.work_usec * 1e-3,
+                   Com_ParallelWorkers());
+        Com_Printf("Slowest pack file: %s (%.1f ms)\n",
+                   fs_pack_stats.max_path, fs_pack_stats.max_usec * 1e-3);
+    }
+
+#if USE_DIR_INDEX
+    Com_Printf("Disk lookups skipped by index: %u\n", fs_count_skipped);
+    for (path = fs_searchpaths; path; path = path->next)
+        if (path->index)
+            Com_Printf("%s: %u names indexed\n", path->filename, path->index->num_entries);
+    Com_Printf("Directories watched: %d\n", fs_num_watches);
+#endif
+
     if (!totalHashSize) {
         Com_Printf("No stats to display\n");
         return;
@@ -3491,6 +4202,9 @@ update:
 
 static void free_search_path(searchpath_t *path)
 {
+#if USE_DIR_INDEX
+    index_free(path);
+#endif
     pack_put(path->pack);
     Z_Free(path);
 }
@@ -3534,7 +4248,7 @@ static void add_game_kpf(const char *dir)
     if (!pack)
         return;
 
-    search = FS_Malloc(sizeof(*search));
+    search = FS_Mallocz(sizeof(*search));
     search->mode = FS_PATH_BASE | FS_DIR_BASE;
     search->filename[0] = 0;
     search->pack = pack_get(pack);
@@ -3676,6 +4390,10 @@ void FS_Shutdown(void)
     // free search paths
     free_all_paths();
 
+#if USE_DIR_INDEX
+    shutdown_index();
+#endif
+
 #if USE_ZLIB
     inflateEnd(&fs_zipstream.stream);
 #endif
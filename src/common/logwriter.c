@@ -0,0 +1,264 @@
+/*
+Copyright (C) 2026 agent <agent@local>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "shared/shared.h"
+#include "shared/atomic.h"
+#include "common/common.h"
+#include "common/files.h"
+#include "common/logwriter.h"
+#include "common/zone.h"
+#include "system/pthread.h"
+
+// must be power of two
+#define LOG_RING_SIZE   (1 << 20)
+#define LOG_RING_MASK   (LOG_RING_SIZE - 1)
+
+// single producer (main thread), single consumer (writer thread) ring.
+// Positions grow forever and wrap around naturally.
+struct logwriter_s {
+    qhandle_t       file;
+    bool            flush;      // flush file after each batch
+    char            *ring;
+    atomic_uint     head;       // advanced by main thread
+    atomic_uint     tail;       // advanced by writer thread
+    atomic_int      sleeping;   // writer is waiting for data
+    atomic_int      error;      // first write error
+    bool            terminate;  // protected by lock
+    unsigned        dropped;    // lines dropped since last note
+    unsigned        total_dropped;
+    pthread_mutex_t lock;
+    pthread_cond_t  wake_cond;  // new data or terminate
+    pthread_cond_t  done_cond;  // ring drained
+    pthread_t       thread;
+};
+
+static void write_batch(logwriter_t *w, unsigned tail, unsigned head)
+{
+    unsigned pos = tail & LOG_RING_MASK;
+    unsigned len = head - tail;
+    unsigned part = min(len, LOG_RING_SIZE - pos);
+    int ret;
+
+    // keep draining after error, main thread closes the log
+    if (atomic_load(&w->error))
+        return;
+
+    ret = FS_Write(w->ring + pos, part, w->file);
+    if (ret >= 0 && len > part)
+        ret = FS_Write(w->ring, len - part, w->file);
+    if (ret >= 0 && w->flush)
+        ret = FS_Flush(w->file);
+
+    if (ret < 0)
+        atomic_store(&w->error, ret);
+}
+
+static void *writer_func(void *arg)
+{
+    logwriter_t *w = arg;
+    unsigned head, tail;
+
+    while (1) {
+        tail = atomic_load(&w->tail);
+        head = atomic_load(&w->head);
+
+        // everything that accumulated while writing goes in one batch
+        if (head != tail) {
+            write_batch(w, tail, head);
+            atomic_store(&w->tail, head);
+            continue;
+        }
+
+        pthread_mutex_lock(&w->lock);
+        pthread_cond_broadcast(&w->done_cond);
+        atomic_store(&w->sleeping, 1);
+        while (atomic_load(&w->head) == tail && !w->terminate)
+            pthread_cond_wait(&w->wake_cond, &w->lock);
+        atomic_store(&w->sleeping, 0);
+        pthread_mutex_unlock(&w->lock);
+
+        if (atomic_load(&w->head) == tail)
+            break;  // terminated with empty ring
+    }
+
+    return NULL;
+}
+
+static void wake_writer(logwriter_t *w)
+{
+    pthread_mutex_lock(&w->lock);
+    pthread_cond_signal(&w->wake_cond);
+    pthread_mutex_unlock(&w->lock);
+}
+
+/*
+=================
+Com_OpenLogWriter
+
+Takes ownership of file handle. Returns NULL if writer thread couldn't be
+created, file is closed in that case.
+=================
+*/
+logwriter_t *Com_OpenLogWriter(qhandle_t f, bool flush)
+{
+    logwriter_t *w = Z_Mallocz(sizeof(*w));
+
+    w->file = f;
+    w->flush = flush;
+    w->ring = Z_Malloc(LOG_RING_SIZE);
+
+    pthread_mutex_init(&w->lock, NULL);
+    pthread_cond_init(&w->wake_cond, NULL);
+    pthread_cond_init(&w->done_cond, NULL);
+
+    if (pthread_create(&w->thread, NULL, writer_func, w)) {
+        pthread_mutex_destroy(&w->lock);
+        pthread_cond_destroy(&w->wake_cond);
+        pthread_cond_destroy(&w->done_cond);
+        FS_CloseFile(f);
+        Z_Free(w->ring);
+        Z_Free(w);
+        return NULL;
+    }
+
+    return w;
+}
+
+static unsigned count_lines(const char *data, size_t len)
+{
+    unsigned count = 0;
+
+    while (len--)
+        count += *data++ == '\n';
+
+    return max(count, 1);
+}
+
+static bool put_data(logwriter_t *w, const void *data, size_t len)
+{
+    unsigned head = atomic_load(&w->head);
+    unsigned tail = atomic_load(&w->tail);
+    unsigned pos = head & LOG_RING_MASK;
+    unsigned part;
+
+    if (len > LOG_RING_SIZE - (head - tail))
+        return false;
+
+    part = min(len, LOG_RING_SIZE - pos);
+    memcpy(w->ring + pos, data, part);
+    memcpy(w->ring, (const char *)data + part, len - part);
+    atomic_store(&w->head, head + len);
+    return true;
+}
+
+void Com_WriteLog(logwriter_t *w, const void *data, size_t len)
+{
+    if (!len)
+        return;
+
+    if (w->dropped) {
+        char note[64];
+        size_t n = Q_scnprintf(note, sizeof(note), "*** %u lines dropped ***\n", w->dropped);
+
+        if (!put_data(w, note, n))
+            goto drop;
+        w->dropped = 0;
+    }
+
+    if (!put_data(w, data, len))
+        goto drop;
+
+    // if writer is busy, it will pick this up with the next batch
+    if (atomic_load(&w->sleeping))
+        wake_writer(w);
+    return;
+
+drop:
+    len = count_lines(data, len);
+    w->dropped += len;
+    w->total_dropped += len;
+}
+
+void Com_LogPrintf(logwriter_t *w, const char *fmt, ...)
+{
+    char buf[MAXPRINTMSG];
+    va_list argptr;
+    size_t len;
+
+    va_start(argptr, fmt);
+    len = Q_vscnprintf(buf, sizeof(buf), fmt, argptr);
+    va_end(argptr);
+
+    Com_WriteLog(w, buf, len);
+}
+
+// waits until everything queued so far has been written
+void Com_FlushLogWriter(logwriter_t *w)
+{
+    pthread_mutex_lock(&w->lock);
+    while (atomic_load(&w->tail) != atomic_load(&w->head)) {
+        pthread_cond_signal(&w->wake_cond);
+        pthread_cond_wait(&w->done_cond, &w->lock);
+    }
+    pthread_mutex_unlock(&w->lock);
+
+    if (!atomic_load(&w->error))
+        FS_Flush(w->file);
+}
+
+/*
+=================
+Com_CloseLogWriter
+
+Writes out everything queued, closes the file and frees writer. Returns
+the first error encountered, if any.
+=================
+*/
+int Com_CloseLogWriter(logwriter_t *w)
+{
+    int ret;
+
+    pthread_mutex_lock(&w->lock);
+    w->terminate = true;
+    pthread_cond_signal(&w->wake_cond);
+    pthread_mutex_unlock(&w->lock);
+
+    Q_assert(!pthread_join(w->thread, NULL));
+
+    ret = FS_CloseFile(w->file);
+    if (atomic_load(&w->error))
+        ret = atomic_load(&w->error);
+
+    pthread_mutex_destroy(&w->lock);
+    pthread_cond_destroy(&w->wake_cond);
+    pthread_cond_destroy(&w->done_cond);
+    Z_Free(w->ring);
+    Z_Free(w);
+
+    return ret;
+}
+
+int Com_LogWriterError(const logwriter_t *w)
+{
+    return atomic_load(&w->error);
+}
+
+unsigned Com_LogWriterDropped(const logwriter_t *w)
+{
+    return w->total_dropped;
+}
@@ -219,7 +219,7 @@ static inline void MSG_WriteAngle16(float f)
     MSG_WriteShort(ANGLE2SHORT(f));
 }
 
-#if USE_CLIENT
+#if USE_CLIENT || USE_TESTS
 
 static void compute_buttons_upmove(int *buttons, short *upmove)
 {
@@ -494,7 +494,7 @@ int MSG_WriteDeltaUsercmd_Enhanced(const usercmd_t *from,
     return bits;
 }
 
-#endif // USE_CLIENT
+#endif // USE_CLIENT || USE_TESTS
 
 void MSG_WriteDir(const vec3_t dir)
 {
@@ -571,10 +571,22 @@ void MSG_PackEntity(entity_packed_t *out, const entity_state_t *in, bool ext)
     }
 }
 
+// bits, number, modelindex[4], frame, skinnum, effects, renderfx, origin,
+// angles, old_origin, sound, event, solid, morefx, alpha, scale
+#define MAX_DELTA_ENTITY_BYTES  (5 + 2 + 8 + 2 + 4 + 4 + 4 + 12 + 6 + 12 + 4 + 1 + 4 + 4 + 1 + 1)
+
+// unchecked writes into space reserved by MSG_WriteDeltaEntity
+#define W8(c)   (*p++ = (c))
+#define W16(c)  do { WL16(p, c); p += 2; } while (0)
+#define W32(c)  do { WL32(p, c); p += 4; } while (0)
+#define WF(v)   W32(((union { float f; uint32_t u; }){ v }).u)
+
 void MSG_WriteDeltaEntity(const entity_packed_t *from,
                           const entity_packed_t *to,
                           msgEsFlags_t          flags)
 {
+    byte        temp[MAX_DELTA_ENTITY_BYTES];
+    byte        *start, *p;
     uint64_t    bits;
     uint32_t    mask;
 
@@ -745,75 +757,84 @@ void MSG_WriteDeltaEntity(const entity_packed_t *from,
     else if (bits & 0x0000ff00)
         bits |= U_MOREBITS1;
 
-    MSG_WriteByte(bits & 255);
-    if (bits & U_MOREBITS1) MSG_WriteByte((bits >>  8) & 255);
-    if (bits & U_MOREBITS2) MSG_WriteByte((bits >> 16) & 255);
-    if (bits & U_MOREBITS3) MSG_WriteByte((bits >> 24) & 255);
-    if (bits & U_MOREBITS4) MSG_WriteByte((bits >> 32) & 255);
+    // reserve worst case space once and write without further checks, go
+    // through temporary buffer only if message is about to overflow
+    if (msg_write.cursize <= msg_write.maxsize &&
+        msg_write.maxsize - msg_write.cursize >= MAX_DELTA_ENTITY_BYTES)
+        start = msg_write.data + msg_write.cursize;
+    else
+        start = temp;
+    p = start;
+
+    W8(bits & 255);
+    if (bits & U_MOREBITS1) W8((bits >>  8) & 255);
+    if (bits & U_MOREBITS2) W8((bits >> 16) & 255);
+    if (bits & U_MOREBITS3) W8((bits >> 24) & 255);
+    if (bits & U_MOREBITS4) W8((bits >> 32) & 255);
 
     //----------
 
     if (bits & U_NUMBER16)
-        MSG_WriteShort(to->number);
+        W16(to->number);
     else
-        MSG_WriteByte(to->number);
+        W8(to->number);
 
     if (bits & U_MODEL16) {
-        if (bits & U_MODEL ) MSG_WriteShort(to->modelindex );
-        if (bits & U_MODEL2) MSG_WriteShort(to->modelindex2);
-        if (bits & U_MODEL3) MSG_WriteShort(to->modelindex3);
-        if (bits & U_MODEL4) MSG_WriteShort(to->modelindex4);
+        if (bits & U_MODEL ) W16(to->modelindex );
+        if (bits & U_MODEL2) W16(to->modelindex2);
+        if (bits & U_MODEL3) W16(to->modelindex3);
+        if (bits & U_MODEL4) W16(to->modelindex4);
     } else {
-        if (bits & U_MODEL ) MSG_WriteByte(to->modelindex );
-        if (bits & U_MODEL2) MSG_WriteByte(to->modelindex2);
-        if (bits & U_MODEL3) MSG_WriteByte(to->modelindex3);
-        if (bits & U_MODEL4) MSG_WriteByte(to->modelindex4);
+        if (bits & U_MODEL ) W8(to->modelindex );
+        if (bits & U_MODEL2) W8(to->modelindex2);
+        if (bits & U_MODEL3) W8(to->modelindex3);
+        if (bits & U_MODEL4) W8(to->modelindex4);
     }
 
     if (bits & U_FRAME8)
-        MSG_WriteByte(to->frame);
+        W8(to->frame);
     else if (bits & U_FRAME16)
-        MSG_WriteShort(to->frame);
+        W16(to->frame);
 
     if ((bits & U_SKIN32) == U_SKIN32)
-        MSG_WriteLong(to->skinnum);
+        W32(to->skinnum);
     else if (bits & U_SKIN8)
-        MSG_WriteByte(to->skinnum);
+        W8(to->skinnum);
     else if (bits & U_SKIN16)
-        MSG_WriteShort(to->skinnum);
+        W16(to->skinnum);
 
     if ((bits & U_EFFECTS32) == U_EFFECTS32)
-        MSG_WriteLong(to->effects);
+        W32(to->effects);
     else if (bits & U_EFFECTS8)
-        MSG_WriteByte(to->effects);
+        W8(to->effects);
     else if (bits & U_EFFECTS16)
-        MSG_WriteShort(to->effects);
+        W16(to->effects);
 
     if ((bits & U_RENDERFX32) == U_RENDERFX32)
-        MSG_WriteLong(to->renderfx);
+        W32(to->renderfx);
     else if (bits & U_RENDERFX8)
-        MSG_WriteByte(to->renderfx);
+        W8(to->renderfx);
     else if (bits & U_RENDERFX16)
-        MSG_WriteShort(to->renderfx);
+        W16(to->renderfx);
 
-    if (bits & U_ORIGIN1) MSG_WriteCoord(to->origin[0]);
-    if (bits & U_ORIGIN2) MSG_WriteCoord(to->origin[1]);
-    if (bits & U_ORIGIN3) MSG_WriteCoord(to->origin[2]);
+    if (bits & U_ORIGIN1) WF(to->origin[0]);
+    if (bits & U_ORIGIN2) WF(to->origin[1]);
+    if (bits & U_ORIGIN3) WF(to->origin[2]);
 
     if (bits & U_ANGLE16) {
-        if (bits & U_ANGLE1) MSG_WriteShort(to->angles[0]);
-        if (bits & U_ANGLE2) MSG_WriteShort(to->angles[1]);
-        if (bits & U_ANGLE3) MSG_WriteShort(to->angles[2]);
+        if (bits & U_ANGLE1) W16(to->angles[0]);
+        if (bits & U_ANGLE2) W16(to->angles[1]);
+        if (bits & U_ANGLE3) W16(to->angles[2]);
     } else {
-        if (bits & U_ANGLE1) MSG_WriteChar(to->angles[0] >> 8);
-        if (bits & U_ANGLE2) MSG_WriteChar(to->angles[1] >> 8);
-        if (bits & U_ANGLE3) MSG_WriteChar(to->angles[2] >> 8);
+        if (bits & U_ANGLE1) W8(to->angles[0] >> 8);
+        if (bits & U_ANGLE2) W8(to->angles[1] >> 8);
+        if (bits & U_ANGLE3) W8(to->angles[2] >> 8);
     }
 
     if (bits & U_OLDORIGIN) {
-        MSG_WriteCoord(to->old_origin[0]);
-        MSG_WriteCoord(to->old_origin[1]);
-        MSG_WriteCoord(to->old_origin[2]);
+        WF(to->old_origin[0]);
+        WF(to->old_origin[1]);
+        WF(to->old_origin[2]);
     }
 
     if (bits & U_SOUND) {
@@ -825,44 +846,57 @@ void MSG_WriteDeltaEntity(const entity_packed_t *from,
             if (to->loop_attenuation != from->loop_attenuation)
                 w |= 0x8000;
 
-            MSG_WriteShort(w);
+            W16(w);
             if (w & 0x4000)
-                MSG_WriteByte(to->loop_volume);
+                W8(to->loop_volume);
             if (w & 0x8000)
-                MSG_WriteByte(to->loop_attenuation);
+                W8(to->loop_attenuation);
         } else {
-            MSG_WriteByte(to->sound);
+            W8(to->sound);
         }
     }
 
     if (bits & U_EVENT)
-        MSG_WriteByte(to->event);
+        W8(to->event);
 
     if (bits & U_SOLID) {
         if (flags & MSG_ES_LONGSOLID)
-            MSG_WriteLong(to->solid);
+            W32(to->solid);
         else
-            MSG_WriteShort(to->solid);
+            W16(to->solid);
     }
 
     if (flags & MSG_ES_EXTENSIONS) {
         uint32_t to_morefx = to->effects >> 32;
         if ((bits & U_MOREFX32) == U_MOREFX32)
-            MSG_WriteLong(to_morefx);
+            W32(to_morefx);
         else if (bits & U_MOREFX8)
-            MSG_WriteByte(to_morefx);
+            W8(to_morefx);
         else if (bits & U_MOREFX16)
-            MSG_WriteShort(to_morefx);
+            W16(to_morefx);
 
         if (bits & U_ALPHA)
-            MSG_WriteByte(to->alpha);
+            W8(to->alpha);
 
         if (bits & U_SCALE)
-            MSG_WriteByte(to->scale);
+            W8(to->scale);
     }
 
+#ifdef PARANOID
+    Q_assert(p - start <= MAX_DELTA_ENTITY_BYTES);
+#endif
+
+    if (start == temp)
+        SZ_Write(&msg_write, temp, p - temp);
+    else
+        msg_write.cursize += p - start;
 }
 
+#undef W8
+#undef W16
+#undef W32
+#undef WF
+
 #define OFFSET2CHAR(x)  Q_clip_int8((x) * 4)
 #define BLEND2BYTE(x)   Q_clip_uint8((x) * 255)
 
@@ -1883,7 +1917,7 @@ size_t MSG_ReadStringLine(char *dest, size_t size)
     return len;
 }
 
-#if USE_CLIENT || USE_MVD_CLIENT
+#if USE_CLIENT || USE_MVD_CLIENT || USE_TESTS
 
 static inline float MSG_ReadAngle(void)
 {
@@ -1949,7 +1983,7 @@ void MSG_ReadPos(vec3_t pos, msgEsFlags_t flags)
     }
 }
 
-#if USE_CLIENT
+#if USE_CLIENT || USE_TESTS
 static inline void MSG_ReadPosP(vec3_t pos, msgPsFlags_t flags)
 {
     if (flags & MSG_PS_RERELEASE) {
@@ -1967,7 +2001,9 @@ static inline void MSG_ReadPosP(vec3_t pos, msgPsFlags_t flags)
         pos[2] = SHORT2COORD(MSG_ReadShort());
     }
 }
+#endif
 
+#if USE_CLIENT
 void MSG_ReadDir(vec3_t dir)
 {
     int     b;
@@ -2111,7 +2147,7 @@ void MSG_ReadDeltaUsercmd_Enhanced(const usercmd_t *from, usercmd_t *to)
     }
 }
 
-#if USE_CLIENT || USE_MVD_CLIENT
+#if USE_CLIENT || USE_MVD_CLIENT || USE_TESTS
 
 /*
 =================
@@ -2199,12 +2235,17 @@ void MSG_ParseDeltaEntity(entity_state_t            *to,
     else if (bits & U_SKIN16)
         to->skinnum = MSG_ReadWord();
 
-    if ((bits & U_EFFECTS32) == U_EFFECTS32)
-        to->effects = MSG_ReadULong();
-    else if (bits & U_EFFECTS8)
-        to->effects = MSG_ReadByte();
-    else if (bits & U_EFFECTS16)
-        to->effects = MSG_ReadWord();
+    // upper 32 bits of effects are updated separately
+    if (bits & U_EFFECTS32) {
+        uint32_t effects;
+        if ((bits & U_EFFECTS32) == U_EFFECTS32)
+            effects = MSG_ReadULong();
+        else if (bits & U_EFFECTS8)
+            effects = MSG_ReadByte();
+        else
+            effects = MSG_ReadWord();
+        to->effects = (to->effects & ~(effects_t)UINT32_MAX) | effects;
+    }
 
     if ((bits & U_RENDERFX32) == U_RENDERFX32)
         to->renderfx = MSG_ReadULong();
@@ -2259,14 +2300,16 @@ void MSG_ParseDeltaEntity(entity_state_t            *to,
     }
 
     if (flags & MSG_ES_EXTENSIONS) {
-        uint32_t to_morefx = 0;
-        if ((bits & U_MOREFX32) == U_MOREFX32)
-            to_morefx = MSG_ReadULong();
-        else if (bits & U_MOREFX8)
-            to_morefx = MSG_ReadByte();
-        else if (bits & U_MOREFX16)
-            to_morefx = MSG_ReadWord();
-        to->effects |= ((effects_t)to_morefx) << 32;
+        if (bits & U_MOREFX32) {
+            uint32_t to_morefx;
+            if ((bits & U_MOREFX32) == U_MOREFX32)
+                to_morefx = MSG_ReadULong();
+            else if (bits & U_MOREFX8)
+                to_morefx = MSG_ReadByte();
+            else
+                to_morefx = MSG_ReadWord();
+            to->effects = (uint32_t)to->effects | (effects_t)to_morefx << 32;
+        }
 
         if (bits & U_ALPHA)
             to->alpha = MSG_ReadByte() / 255.0f;
@@ -2276,7 +2319,7 @@ void MSG_ParseDeltaEntity(entity_state_t            *to,
     }
 }
 
-#endif // USE_CLIENT || USE_MVD_CLIENT
+#endif // USE_CLIENT || USE_MVD_CLIENT || USE_TESTS
 
 static uint64_t MSG_ReadVarInt64(void)
 {
@@ -2338,7 +2381,7 @@ static void MSG_ReadBlend(player_state_t *to, msgPsFlags_t psflags)
     }
 }
 
-#if USE_CLIENT
+#if USE_CLIENT || USE_TESTS
 
 /*
 ===================
@@ -2655,7 +2698,7 @@ void MSG_ParseDeltaPlayerstate_Enhanced(const player_state_t    *from,
 // KEX
 }
 
-#endif // USE_CLIENT
+#endif // USE_CLIENT || USE_TESTS
 
 #if USE_MVD_CLIENT
 
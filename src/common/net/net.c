@@ -26,6 +26,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "common/fifo.h"
 #if USE_DEBUG
 #include "common/files.h"
+#include "common/logwriter.h"
 #endif
 #include "common/msg.h"
 #include "common/net/net.h"
@@ -120,7 +121,7 @@ static struct pollfd    *udp6_sockets[NS_COUNT];
 static struct pollfd    *tcp6_socket;
 
 #if USE_DEBUG
-static qhandle_t    net_logFile;
+static logwriter_t  *net_logFile;
 #endif
 
 #define MAX_POLL_FDS    1024
@@ -367,14 +368,21 @@ bool NET_StringToAdr(const char *s, netadr_t *a, int default_port)
 
 static void logfile_close(void)
 {
+    unsigned dropped;
+
     if (!net_logFile) {
         return;
     }
 
     Com_Printf("Closing network log.\n");
 
-    FS_CloseFile(net_logFile);
-    net_logFile = 0;
+    dropped = Com_LogWriterDropped(net_logFile);
+    Com_CloseLogWriter(net_logFile);
+    net_logFile = NULL;
+
+    if (dropped) {
+        Com_WPrintf("%u lines dropped from network log.\n", dropped);
+    }
 }
 
 static void logfile_open(void)
@@ -399,7 +407,13 @@ static void logfile_open(void)
         return;
     }
 
-    net_logFile = f;
+    net_logFile = Com_OpenLogWriter(f, net_log_flush->integer > 0);
+    if (!net_logFile) {
+        Com_EPrintf("Couldn't create log writer thread\n");
+        Cvar_Set("net_log_enable", "0");
+        return;
+    }
+
     Com_Printf("Logging network packets to %s\n", buffer);
 }
 
@@ -427,39 +441,43 @@ NET_LogPacket
 static void NET_LogPacket(const netadr_t *address, const char *prefix,
                           const byte *data, size_t length)
 {
-    int numRows;
-    int i, j, c;
+    static char buf[MAX_PACKETLEN * 5 + MAX_QPATH * 2];
+    size_t len, i, j;
+    int c;
 
     if (!net_logFile) {
         return;
     }
 
-    FS_FPrintf(net_logFile, "%u : %s : %s : %zu bytes\n",
-               com_localTime, prefix, NET_AdrToString(address), length);
+    // format the whole packet, so that it is either logged or dropped
+    // as a whole
+    len = Q_scnprintf(buf, sizeof(buf), "%u : %s : %s : %zu bytes\n",
+                      com_localTime, prefix, NET_AdrToString(address), length);
+    length = min(length, MAX_PACKETLEN);
 
-    numRows = (length + 15) / 16;
-    for (i = 0; i < numRows; i++) {
-        FS_FPrintf(net_logFile, "%04x : ", i * 16);
-        for (j = 0; j < 16; j++) {
-            if (i * 16 + j < length) {
-                FS_FPrintf(net_logFile, "%02x ", data[i * 16 + j]);
+    for (i = 0; i < length; i += 16) {
+        len += Q_scnprintf(buf + len, sizeof(buf) - len, "%04zx : ", i);
+        for (j = i; j < i + 16; j++) {
+            if (j < length) {
+                len += Q_scnprintf(buf + len, sizeof(buf) - len, "%02x ", data[j]);
             } else {
-                FS_FPrintf(net_logFile, "   ");
+                len += Q_scnprintf(buf + len, sizeof(buf) - len, "   ");
             }
         }
-        FS_FPrintf(net_logFile, ": ");
-        for (j = 0; j < 16; j++) {
-            if (i * 16 + j < length) {
-                c = data[i * 16 + j];
-                FS_FPrintf(net_logFile, "%c", Q_isprint(c) ? c : '.');
+        len += Q_scnprintf(buf + len, sizeof(buf) - len, ": ");
+        for (j = i; j < i + 16; j++) {
+            if (j < length) {
+                c = data[j];
+                buf[len++] = Q_isprint(c) ? c : '.';
             } else {
-                FS_FPrintf(net_logFile, " ");
+                buf[len++] = ' ';
             }
         }
-        FS_FPrintf(net_logFile, "\n");
+        buf[len++] = '\n';
     }
 
-    FS_FPrintf(net_logFile, "\n");
+    buf[len++] = '\n';
+    Com_WriteLog(net_logFile, buf, len);
 }
 
 #else
@@ -528,6 +546,16 @@ static void NET_Stats_f(void)
     Com_Printf("Current download rate: %zu bytes/sec\n", net_rate_dn);
 }
 
+void NET_GetStats(netstats_t *stats)
+{
+    stats->bytes_rcvd = net_bytes_rcvd;
+    stats->bytes_sent = net_bytes_sent;
+    stats->packets_rcvd = net_packets_rcvd;
+    stats->packets_sent = net_packets_sent;
+    stats->recv_errors = net_recv_errors;
+    stats->send_errors = net_send_errors;
+}
+
 static size_t NET_UpRate_m(char *buffer, size_t size)
 {
     return Q_snprintf(buffer, size, "%zu", net_rate_up);
@@ -814,6 +842,35 @@ void NET_GetPackets(netsrc_t sock, void (*packet_cb)(void))
     NET_GetUdpPackets(udp6_sockets[sock], packet_cb);
 }
 
+static bool NET_SendUdpPacket(struct pollfd *s, const void *data,
+                              size_t len, const netadr_t *to)
+{
+    int ret;
+
+    ret = os_udp_send(s->fd, data, len, to);
+    if (ret == NET_AGAIN)
+        return false;
+
+    if (ret == NET_ERROR) {
+        Com_DPrintf("%s: %s to %s\n", __func__,
+                    NET_ErrorString(), NET_AdrToString(to));
+        net_send_errors++;
+        return false;
+    }
+
+    if (ret < len)
+        Com_WPrintf("%s: short send to %s\n", __func__,
+                    NET_AdrToString(to));
+
+    NET_LogPacket(to, "UDP send", data, ret);
+
+    net_rate_sent += ret;
+    net_bytes_sent += ret;
+    net_packets_sent++;
+
+    return true;
+}
+
 /*
 =============
 NET_SendPacket
@@ -823,7 +880,6 @@ NET_SendPacket
 bool NET_SendPacket(netsrc_t sock, const void *data,
                     size_t len, const netadr_t *to)
 {
-    int ret;
     struct pollfd *s;
 
     if (len == 0)
@@ -856,28 +912,7 @@ bool NET_SendPacket(netsrc_t sock, const void *data,
     if (!s)
         return false;
 
-    ret = os_udp_send(s->fd, data, len, to);
-    if (ret == NET_AGAIN)
-        return false;
-
-    if (ret == NET_ERROR) {
-        Com_DPrintf("%s: %s to %s\n", __func__,
-                    NET_ErrorString(), NET_AdrToString(to));
-        net_send_errors++;
-        return false;
-    }
-
-    if (ret < len)
-        Com_WPrintf("%s: short send to %s\n", __func__,
-                    NET_AdrToString(to));
-
-    NET_LogPacket(to, "UDP send", data, ret);
-
-    net_rate_sent += ret;
-    net_bytes_sent += ret;
-    net_packets_sent++;
-
-    return true;
+    return NET_SendUdpPacket(s, data, len, to);
 }
 
 //=============================================================================
@@ -1021,6 +1056,49 @@ static struct pollfd *UDP_OpenSocket(const char *iface, int port, int family)
     return sock;
 }
 
+#if USE_TESTS
+
+/*
+=============
+NET_OpenUdp
+
+Opens a private IPv4 UDP socket not bound to any netsrc_t. Used by testing
+code that needs to act as many independent clients at once.
+=============
+*/
+struct pollfd *NET_OpenUdp(const char *iface, int port)
+{
+    return UDP_OpenSocket(iface, port, AF_INET);
+}
+
+void NET_CloseUdp(struct pollfd *s)
+{
+    NET_CloseSocket(s);
+}
+
+bool NET_SendUdp(struct pollfd *s, const void *data,
+                 size_t len, const netadr_t *to)
+{
+    if (len == 0 || len > MAX_PACKETLEN)
+        return false;
+
+    return NET_SendUdpPacket(s, data, len, to);
+}
+
+void NET_GetUdp(struct pollfd *s, void (*packet_cb)(void))
+{
+    // caller doesn't wait for NET_Sleep, read until it would block
+    s->revents |= POLLIN;
+    NET_GetUdpPackets(s, packet_cb);
+}
+
+bool NET_GetUdpAddress(struct pollfd *s, netadr_t *adr)
+{
+    return !os_getsockname(s->fd, adr);
+}
+
+#endif // USE_TESTS
+
 static struct pollfd *TCP_OpenSocket(const char *iface, int port, int family, netsrc_t who)
 {
     qsocket_t s;
@@ -22,6 +22,9 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "common/common.h"
 #include "common/files.h"
 #include "common/mdfour.h"
+#include "common/msg.h"
+#include "common/protocol.h"
+#include "common/sizebuf.h"
 #include "common/tests.h"
 #include "refresh/refresh.h"
 #include "system/system.h"
@@ -856,6 +859,918 @@ static void Com_Extract_f(void)
         Com_Printf("Extracted %s (%d bytes)\n", path, len);
 }
 
+/*
+=============================================================================
+
+MESSAGE ENCODING TESTS
+
+=============================================================================
+*/
+
+// private generator, so that generated states are the same on each run
+static uint32_t msg_seed;
+
+static uint32_t msg_rand(void)
+{
+    msg_seed ^= msg_seed << 13;
+    msg_seed ^= msg_seed >> 17;
+    msg_seed ^= msg_seed << 5;
+    return msg_seed;
+}
+
+#define msg_crand()     ((int32_t)msg_rand() * 0x1p-31f)
+#define msg_coord()     ((int32_t)msg_rand() * 0x1p-19f)
+#define msg_angle()     SHORT2ANGLE(msg_rand() & 0xffff)
+#define msg_byte()      (msg_rand() & 0xff)
+#define msg_short()     ((int16_t)msg_rand())
+
+// randomly mutates about quarter of fields
+#define MAYBE(field)    if (!(msg_rand() & 3)) to->field = tmp.field
+
+static void rand_entity(entity_state_t *s, int number, msgEsFlags_t flags)
+{
+    bool ext = flags & MSG_ES_EXTENSIONS;
+
+    memset(s, 0, sizeof(*s));
+    s->number = number;
+    for (int i = 0; i < 3; i++) {
+        s->origin[i] = msg_coord();
+        s->angles[i] = msg_angle();
+        s->old_origin[i] = msg_coord();
+    }
+    s->modelindex = msg_rand() & (ext ? 0xffff : 0xff);
+    s->modelindex2 = msg_rand() & (ext ? 0xffff : 0xff);
+    s->modelindex3 = msg_rand() & (ext ? 0xffff : 0xff);
+    s->modelindex4 = msg_rand() & (ext ? 0xffff : 0xff);
+    s->frame = msg_rand() & 0xffff;
+    s->skinnum = msg_rand() >> (msg_rand() & 31);
+    s->effects = msg_rand() >> (msg_rand() & 31);
+    if (ext)
+        s->effects |= (effects_t)(msg_rand() >> (msg_rand() & 31)) << 32;
+    s->renderfx = msg_rand() >> (msg_rand() & 31);
+    s->solid = msg_rand() & (flags & MSG_ES_LONGSOLID ? 0xffffffff : 0xffff);
+    s->sound = msg_rand() & (ext ? 0x3fff : 0xff);
+    s->event = msg_byte();
+    if (ext) {
+        s->alpha = msg_byte() / 255.0f;
+        s->scale = msg_byte() / 16.0f;
+        s->loop_volume = msg_byte() / 255.0f;
+        s->loop_attenuation = msg_rand() & 1 ? ATTN_LOOP_NONE : (msg_byte() & 127) / 64.0f;
+    }
+}
+
+static void mutate_entity(entity_state_t *to, msgEsFlags_t flags)
+{
+    entity_state_t tmp;
+
+    rand_entity(&tmp, to->number, flags);
+    for (int i = 0; i < 3; i++) {
+        MAYBE(origin[i]);
+        MAYBE(angles[i]);
+        MAYBE(old_origin[i]);
+    }
+    MAYBE(modelindex);
+    MAYBE(modelindex2);
+    MAYBE(modelindex3);
+    MAYBE(modelindex4);
+    MAYBE(frame);
+    MAYBE(skinnum);
+    MAYBE(effects);
+    MAYBE(renderfx);
+    MAYBE(solid);
+    MAYBE(sound);
+    MAYBE(alpha);
+    MAYBE(scale);
+    MAYBE(loop_volume);
+    MAYBE(loop_attenuation);
+    to->event = msg_rand() & 1 ? tmp.event : 0;
+}
+
+static void rand_player(player_state_t *ps)
+{
+    memset(ps, 0, sizeof(*ps));
+    ps->pmove.pm_type = msg_rand() % (PM_FREEZE + 1);
+    for (int i = 0; i < 3; i++) {
+        ps->pmove.origin[i] = msg_coord();
+        ps->pmove.velocity[i] = msg_coord();
+        ps->pmove.delta_angles[i] = msg_angle();
+        ps->viewangles[i] = msg_angle();
+        ps->viewoffset[i] = msg_short() / 16.0f;
+        ps->kick_angles[i] = msg_short() / 1024.0f;
+        ps->gunoffset[i] = msg_short() / 512.0f;
+        ps->gunangles[i] = msg_short() / 4096.0f;
+    }
+    ps->pmove.pm_flags = msg_rand() & 0xffff;
+    ps->pmove.pm_time = msg_rand();
+    ps->pmove.gravity = msg_rand();
+    ps->pmove.viewheight = msg_rand();
+    ps->gunindex = msg_rand() & (BIT(GUNINDEX_BITS) - 1);
+    ps->gunskin = msg_rand() & 7;
+    ps->gunframe = msg_byte();
+    ps->gunrate = msg_rand() & 127;
+    for (int i = 0; i < 4; i++) {
+        ps->screen_blend[i] = msg_byte() / 255.0f;
+        ps->damage_blend[i] = msg_byte() / 255.0f;
+    }
+    ps->fov = msg_byte();
+    ps->rdflags = msg_byte();
+    for (int i = 0; i < MAX_STATS_NEW; i++)
+        ps->stats[i] = msg_rand() & 1 ? msg_short() : 0;
+}
+
+static void mutate_player(player_state_t *to)
+{
+    player_state_t tmp;
+
+    rand_player(&tmp);
+    MAYBE(pmove.pm_type);
+    for (int i = 0; i < 3; i++) {
+        MAYBE(pmove.origin[i]);
+        MAYBE(pmove.velocity[i]);
+        MAYBE(pmove.delta_angles[i]);
+        MAYBE(viewangles[i]);
+        MAYBE(viewoffset[i]);
+        MAYBE(kick_angles[i]);
+        MAYBE(gunoffset[i]);
+        MAYBE(gunangles[i]);
+    }
+    MAYBE(pmove.pm_flags);
+    MAYBE(pmove.pm_time);
+    MAYBE(pmove.gravity);
+    MAYBE(pmove.viewheight);
+    MAYBE(gunindex);
+    MAYBE(gunskin);
+    MAYBE(gunframe);
+    MAYBE(gunrate);
+    for (int i = 0; i < 4; i++) {
+        MAYBE(screen_blend[i]);
+        MAYBE(damage_blend[i]);
+    }
+    MAYBE(fov);
+    MAYBE(rdflags);
+    for (int i = 0; i < MAX_STATS_NEW; i++)
+        MAYBE(stats[i]);
+}
+
+static void rand_usercmd(usercmd_t *cmd)
+{
+    memset(cmd, 0, sizeof(*cmd));
+    cmd->msec = msg_byte();
+    cmd->buttons = msg_byte();
+    for (int i = 0; i < 3; i++)
+        cmd->angles[i] = msg_angle();
+    cmd->forwardmove = (int)(msg_rand() % 1001) - 500;
+    cmd->sidemove = (int)(msg_rand() % 1001) - 500;
+}
+
+static void mutate_usercmd(usercmd_t *to)
+{
+    usercmd_t tmp;
+
+    rand_usercmd(&tmp);
+    MAYBE(msec);
+    MAYBE(buttons);
+    for (int i = 0; i < 3; i++)
+        MAYBE(angles[i]);
+    MAYBE(forwardmove);
+    MAYBE(sidemove);
+}
+
+#undef MAYBE
+
+// copies written message for reading
+static void begin_reading(void)
+{
+    memcpy(msg_read_buffer, msg_write.data, msg_write.cursize);
+    SZ_InitRead(&msg_read, msg_read_buffer, msg_write.cursize);
+    MSG_BeginWriting();
+}
+
+// decoded state must re-encode to the same bytes, and decoder must consume
+// exactly as many bytes as encoder produced
+static bool check_written(const char *what, int flags)
+{
+    if (msg_read.readcount == msg_read.cursize && msg_write.cursize == msg_read.cursize &&
+        !memcmp(msg_write.data, msg_read.data, msg_read.cursize)) {
+        MSG_BeginWriting();
+        return true;
+    }
+
+    Com_EPrintf("%s %#x: wrote %u bytes, read %u of them, re-encoded %u\n",
+                what, flags, msg_read.cursize, msg_read.readcount, msg_write.cursize);
+    MSG_BeginWriting();
+    return false;
+}
+
+static bool test_entity(const entity_state_t *from, const entity_state_t *to, msgEsFlags_t flags)
+{
+    bool ext = flags & MSG_ES_EXTENSIONS;
+    entity_packed_t pfrom, pto;
+    entity_state_t out;
+    uint64_t bits;
+    int number;
+
+    MSG_PackEntity(&pfrom, from, ext);
+    MSG_PackEntity(&pto, to, ext);
+    MSG_WriteDeltaEntity(&pfrom, &pto, flags);
+    if (!msg_write.cursize)
+        return true;    // nothing changed
+
+    begin_reading();
+    number = MSG_ParseEntityBits(&bits, flags);
+    if (number != to->number) {
+        Com_EPrintf("entity %#x: wrote number %d, read %d\n", flags, to->number, number);
+        return false;
+    }
+
+    out = *from;
+    MSG_ParseDeltaEntity(&out, number, bits, flags);
+
+    MSG_PackEntity(&pto, &out, ext);
+    MSG_WriteDeltaEntity(&pfrom, &pto, flags);
+    return check_written("entity", flags);
+}
+
+// only enhanced player state encoding is tested, default one is written for
+// vanilla clients and doesn't decode back with rerelease flags
+static bool test_player(const player_state_t *from, const player_state_t *to, msgPsFlags_t flags)
+{
+    player_packed_t pfrom, pto;
+    player_state_t out;
+    int pflags, extraflags;
+
+    MSG_PackPlayer(&pfrom, from, flags);
+    MSG_PackPlayer(&pto, to, flags);
+    extraflags = MSG_WriteDeltaPlayerstate_Enhanced(&pfrom, &pto, flags);
+
+    begin_reading();
+    pflags = MSG_ReadWord();
+    MSG_ParseDeltaPlayerstate_Enhanced(from, &out, pflags, extraflags, flags);
+
+    MSG_PackPlayer(&pto, &out, flags);
+    if (MSG_WriteDeltaPlayerstate_Enhanced(&pfrom, &pto, flags) != extraflags) {
+        Com_EPrintf("player %#x: extraflags mismatch\n", flags);
+        MSG_BeginWriting();
+        return false;
+    }
+    return check_written("player", flags);
+}
+
+static bool test_usercmd(const usercmd_t *from, const usercmd_t *to, bool enhanced)
+{
+    usercmd_t out;
+
+    if (enhanced) {
+        MSG_WriteDeltaUsercmd_Enhanced(from, to, PROTOCOL_VERSION_RERELEASE);
+        MSG_FlushBits();
+    } else {
+        MSG_WriteDeltaUsercmd(from, to, PROTOCOL_VERSION_RERELEASE, 0);
+        MSG_WriteByte(0);   // light level
+    }
+
+    begin_reading();
+    if (enhanced)
+        MSG_ReadDeltaUsercmd_Enhanced(from, &out);
+    else
+        MSG_ReadDeltaUsercmd(from, &out);
+
+    // usercmds are lossless given quantized input
+    if (msg_read.readcount == msg_read.cursize &&
+        out.msec == to->msec && out.buttons == to->buttons &&
+        ANGLE2SHORT(out.angles[0]) == ANGLE2SHORT(to->angles[0]) &&
+        ANGLE2SHORT(out.angles[1]) == ANGLE2SHORT(to->angles[1]) &&
+        ANGLE2SHORT(out.angles[2]) == ANGLE2SHORT(to->angles[2]) &&
+        out.forwardmove == to->forwardmove && out.sidemove == to->sidemove)
+        return true;
+
+    Com_EPrintf("%s usercmd mismatch\n", enhanced ? "enhanced" : "default");
+    return false;
+}
+
+// writers only emit rerelease coordinates, so MSG_ES_RERELEASE and
+// MSG_PS_RERELEASE are always set, as is MSG_PS_EXTENSIONS that server
+// always uses with enhanced player state. other flags are tested in all
+// combinations, except for MVD only ones.
+static const int es_bits[] = {
+    MSG_ES_FORCE, MSG_ES_NEWENTITY, MSG_ES_FIRSTPERSON, MSG_ES_LONGSOLID,
+    MSG_ES_UMASK, MSG_ES_BEAMORIGIN, MSG_ES_SHORTANGLES, MSG_ES_EXTENSIONS,
+};
+
+static const int ps_bits[] = {
+    MSG_PS_IGNORE_GUNINDEX, MSG_PS_IGNORE_GUNFRAMES, MSG_PS_IGNORE_BLEND,
+    MSG_PS_IGNORE_VIEWANGLES, MSG_PS_IGNORE_DELTAANGLES, MSG_PS_IGNORE_PREDICTION,
+};
+
+static int combo_flags(const int *bits, int count, int combo)
+{
+    int flags = 0;
+
+    for (int i = 0; i < count; i++)
+        if (combo & BIT(i))
+            flags |= bits[i];
+
+    return flags;
+}
+
+static void Com_MsgTest_f(void)
+{
+    int i, combo, iterations, errors = 0, tests = 0;
+
+    iterations = Cmd_Argc() > 1 ? Q_atoi(Cmd_Argv(1)) : 100;
+    msg_seed = Cmd_Argc() > 2 ? Q_atoi(Cmd_Argv(2)) : 0x9e3779b9;
+    if (!msg_seed)
+        msg_seed = 1;
+
+    MSG_BeginWriting();
+
+    for (combo = 0; combo < BIT(q_countof(es_bits)); combo++) {
+        msgEsFlags_t flags = combo_flags(es_bits, q_countof(es_bits), combo) | MSG_ES_RERELEASE;
+        entity_state_t from, to;
+
+        for (i = 0; i < iterations; i++) {
+            rand_entity(&from, 1 + msg_rand() % (MAX_EDICTS - 1), flags);
+            to = from;
+            mutate_entity(&to, flags);
+            errors += !test_entity(&from, &to, flags);
+            tests++;
+        }
+    }
+
+    for (combo = 0; combo < BIT(q_countof(ps_bits)); combo++) {
+        msgPsFlags_t flags = combo_flags(ps_bits, q_countof(ps_bits), combo) | MSG_PS_RERELEASE | MSG_PS_EXTENSIONS;
+        player_state_t from, to;
+
+        // mutually exclusive
+        if ((flags & MSG_PS_IGNORE_VIEWANGLES) && (flags & MSG_PS_IGNORE_PREDICTION))
+            continue;
+
+        for (i = 0; i < iterations; i++) {
+            rand_player(&from);
+            to = from;
+            mutate_player(&to);
+            errors += !test_player(&from, &to, flags);
+            tests++;
+        }
+    }
+
+    for (i = 0; i < iterations * 16; i++) {
+        usercmd_t from, to;
+
+        rand_usercmd(&from);
+        to = from;
+        mutate_usercmd(&to);
+        errors += !test_usercmd(&from, &to, false);
+        errors += !test_usercmd(&from, &to, true);
+        tests++;
+    }
+
+    MSG_BeginWriting();
+    Com_Printf("%d failures, %d tests\n", errors, tests);
+}
+
+#define BENCH_ENTITIES  256     // worst case fits in MAX_MSGLEN
+#define BENCH_PLAYERS   32
+
+// typical frame-to-frame changes: movement, animation, occasional events
+static void move_entity(entity_state_t *ent)
+{
+    uint32_t r = msg_rand();
+
+    VectorCopy(ent->origin, ent->old_origin);
+    if (r & 1)
+        ent->origin[0] += msg_crand() * 32;
+    if (r & 2)
+        ent->origin[1] += msg_crand() * 32;
+    if (r & 4)
+        ent->origin[2] += msg_crand() * 8;
+    if (r & 8)
+        ent->angles[1] = msg_angle();
+    if (r & 16)
+        ent->frame++;
+    ent->event = (r & 0xe0) ? 0 : r >> 8 & 15;
+    if (!(r & 0x700))
+        ent->effects ^= EF_ROTATE;
+}
+
+// copy of MSG_WriteDeltaEntity before space for each entity was reserved
+// once, every field is written with bounds checking. Kept for comparison.
+static void write_delta_entity_old(const entity_packed_t *from,
+                                   const entity_packed_t *to,
+                                   msgEsFlags_t          flags)
+{
+    uint64_t    bits;
+    uint32_t    mask;
+
+    if (!to) {
+        Q_assert(from);
+        Q_assert(from->number > 0 && from->number < MAX_EDICTS);
+
+        bits = U_REMOVE;
+        if (from->number & 0xff00)
+            bits |= U_NUMBER16 | U_MOREBITS1;
+
+        MSG_WriteByte(bits & 255);
+        if (bits & 0x0000ff00)
+            MSG_WriteByte((bits >> 8) & 255);
+
+        if (bits & U_NUMBER16)
+            MSG_WriteShort(from->number);
+        else
+            MSG_WriteByte(from->number);
+
+        return; // remove entity
+    }
+
+    Q_assert(to->number > 0 && to->number < MAX_EDICTS);
+
+    if (!from)
+        from = &nullEntityState;
+
+// send an update
+    bits = 0;
+
+    if (!(flags & MSG_ES_FIRSTPERSON)) {
+        if (to->origin[0] != from->origin[0])
+            bits |= U_ORIGIN1;
+        if (to->origin[1] != from->origin[1])
+            bits |= U_ORIGIN2;
+        if (to->origin[2] != from->origin[2])
+            bits |= U_ORIGIN3;
+
+        if (flags & MSG_ES_SHORTANGLES && to->solid == PACKED_BSP) {
+            if (to->angles[0] != from->angles[0])
+                bits |= U_ANGLE1 | U_ANGLE16;
+            if (to->angles[1] != from->angles[1])
+                bits |= U_ANGLE2 | U_ANGLE16;
+            if (to->angles[2] != from->angles[2])
+                bits |= U_ANGLE3 | U_ANGLE16;
+        } else {
+            if ((to->angles[0] ^ from->angles[0]) & 0xff00)
+                bits |= U_ANGLE1;
+            if ((to->angles[1] ^ from->angles[1]) & 0xff00)
+                bits |= U_ANGLE2;
+            if ((to->angles[2] ^ from->angles[2]) & 0xff00)
+                bits |= U_ANGLE3;
+        }
+
+        if ((flags & MSG_ES_NEWENTITY) && !VectorCompare(to->old_origin, from->origin))
+            bits |= U_OLDORIGIN;
+    }
+
+    if (flags & MSG_ES_UMASK)
+        mask = 0xffff0000;
+    else
+        mask = 0xffff8000;  // don't confuse old clients
+
+    if (to->skinnum != from->skinnum) {
+        if (to->skinnum & mask)
+            bits |= U_SKIN32;
+        else if (to->skinnum & 0x0000ff00)
+            bits |= U_SKIN16;
+        else
+            bits |= U_SKIN8;
+    }
+
+    if (to->frame != from->frame) {
+        if (to->frame & 0xff00)
+            bits |= U_FRAME16;
+        else
+            bits |= U_FRAME8;
+    }
+
+    if (to->effects != from->effects) {
+        if (to->effects & mask)
+            bits |= U_EFFECTS32;
+        else if (to->effects & 0x0000ff00)
+            bits |= U_EFFECTS16;
+        else
+            bits |= U_EFFECTS8;
+    }
+
+    if (to->renderfx != from->renderfx) {
+        if (to->renderfx & mask)
+            bits |= U_RENDERFX32;
+        else if (to->renderfx & 0x0000ff00)
+            bits |= U_RENDERFX16;
+        else
+            bits |= U_RENDERFX8;
+    }
+
+    if (to->solid != from->solid)
+        bits |= U_SOLID;
+
+    // event is not delta compressed, just 0 compressed
+    if (to->event)
+        bits |= U_EVENT;
+
+    if (to->modelindex != from->modelindex)
+        bits |= U_MODEL;
+    if (to->modelindex2 != from->modelindex2)
+        bits |= U_MODEL2;
+    if (to->modelindex3 != from->modelindex3)
+        bits |= U_MODEL3;
+    if (to->modelindex4 != from->modelindex4)
+        bits |= U_MODEL4;
+
+    if (flags & MSG_ES_EXTENSIONS) {
+        if (bits & (U_MODEL | U_MODEL2 | U_MODEL3 | U_MODEL4) &&
+            (to->modelindex | to->modelindex2 | to->modelindex3 | to->modelindex4) & 0xff00)
+            bits |= U_MODEL16;
+        if (to->loop_volume != from->loop_volume || to->loop_attenuation != from->loop_attenuation)
+            bits |= U_SOUND;
+        uint32_t from_morefx = from->effects >> 32;
+        uint32_t to_morefx = to->effects >> 32;
+        if (to_morefx != from_morefx) {
+            if (to_morefx & mask)
+                bits |= U_MOREFX32;
+            else if (to_morefx & 0x0000ff00)
+                bits |= U_MOREFX16;
+            else
+                bits |= U_MOREFX8;
+        }
+        if (to->alpha != from->alpha)
+            bits |= U_ALPHA;
+        if (to->scale != from->scale)
+            bits |= U_SCALE;
+    }
+
+    if (to->sound != from->sound)
+        bits |= U_SOUND;
+
+    if (to->renderfx & RF_FRAMELERP) {
+        if (!VectorCompare(to->old_origin, from->origin))
+            bits |= U_OLDORIGIN;
+    } else if (to->renderfx & RF_BEAM) {
+        if (!(flags & MSG_ES_BEAMORIGIN) || !VectorCompare(to->old_origin, from->old_origin))
+            bits |= U_OLDORIGIN;
+    }
+
+    //
+    // write the message
+    //
+    if (!bits && !(flags & MSG_ES_FORCE))
+        return;     // nothing to send!
+
+    if (flags & MSG_ES_REMOVE)
+        bits |= U_REMOVE; // used for MVD stream only
+
+    //----------
+
+    if (to->number & 0xff00)
+        bits |= U_NUMBER16;     // number8 is implicit otherwise
+
+    if (bits & 0xff00000000ULL)
+        bits |= U_MOREBITS4 | U_MOREBITS3 | U_MOREBITS2 | U_MOREBITS1;
+    else if (bits & 0xff000000)
+        bits |= U_MOREBITS3 | U_MOREBITS2 | U_MOREBITS1;
+    else if (bits & 0x00ff0000)
+        bits |= U_MOREBITS2 | U_MOREBITS1;
+    else if (bits & 0x0000ff00)
+        bits |= U_MOREBITS1;
+
+    MSG_WriteByte(bits & 255);
+    if (bits & U_MOREBITS1) MSG_WriteByte((bits >>  8) & 255);
+    if (bits & U_MOREBITS2) MSG_WriteByte((bits >> 16) & 255);
+    if (bits & U_MOREBITS3) MSG_WriteByte((bits >> 24) & 255);
+    if (bits & U_MOREBITS4) MSG_WriteByte((bits >> 32) & 255);
+
+    //----------
+
+    if (bits & U_NUMBER16)
+        MSG_WriteShort(to->number);
+    else
+        MSG_WriteByte(to->number);
+
+    if (bits & U_MODEL16) {
+        if (bits & U_MODEL ) MSG_WriteShort(to->modelindex );
+        if (bits & U_MODEL2) MSG_WriteShort(to->modelindex2);
+        if (bits & U_MODEL3) MSG_WriteShort(to->modelindex3);
+        if (bits & U_MODEL4) MSG_WriteShort(to->modelindex4);
+    } else {
+        if (bits & U_MODEL ) MSG_WriteByte(to->modelindex );
+        if (bits & U_MODEL2) MSG_WriteByte(to->modelindex2);
+        if (bits & U_MODEL3) MSG_WriteByte(to->modelindex3);
+        if (bits & U_MODEL4) MSG_WriteByte(to->modelindex4);
+    }
+
+    if (bits & U_FRAME8)
+        MSG_WriteByte(to->frame);
+    else if (bits & U_FRAME16)
+        MSG_WriteShort(to->frame);
+
+    if ((bits & U_SKIN32) == U_SKIN32)
+        MSG_WriteLong(to->skinnum);
+    else if (bits & U_SKIN8)
+        MSG_WriteByte(to->skinnum);
+    else if (bits & U_SKIN16)
+        MSG_WriteShort(to->skinnum);
+
+    if ((bits & U_EFFECTS32) == U_EFFECTS32)
+        MSG_WriteLong(to->effects);
+    else if (bits & U_EFFECTS8)
+        MSG_WriteByte(to->effects);
+    else if (bits & U_EFFECTS16)
+        MSG_WriteShort(to->effects);
+
+    if ((bits & U_RENDERFX32) == U_RENDERFX32)
+        MSG_WriteLong(to->renderfx);
+    else if (bits & U_RENDERFX8)
+        MSG_WriteByte(to->renderfx);
+    else if (bits & U_RENDERFX16)
+        MSG_WriteShort(to->renderfx);
+
+    if (bits & U_ORIGIN1) MSG_WriteFloat(to->origin[0]);
+    if (bits & U_ORIGIN2) MSG_WriteFloat(to->origin[1]);
+    if (bits & U_ORIGIN3) MSG_WriteFloat(to->origin[2]);
+
+    if (bits & U_ANGLE16) {
+        if (bits & U_ANGLE1) MSG_WriteShort(to->angles[0]);
+        if (bits & U_ANGLE2) MSG_WriteShort(to->angles[1]);
+        if (bits & U_ANGLE3) MSG_WriteShort(to->angles[2]);
+    } else {
+        if (bits & U_ANGLE1) MSG_WriteChar(to->angles[0] >> 8);
+        if (bits & U_ANGLE2) MSG_WriteChar(to->angles[1] >> 8);
+        if (bits & U_ANGLE3) MSG_WriteChar(to->angles[2] >> 8);
+    }
+
+    if (bits & U_OLDORIGIN) {
+        MSG_WriteFloat(to->old_origin[0]);
+        MSG_WriteFloat(to->old_origin[1]);
+        MSG_WriteFloat(to->old_origin[2]);
+    }
+
+    if (bits & U_SOUND) {
+        if (flags & MSG_ES_EXTENSIONS) {
+            int w = to->sound & 0x3fff;
+
+            if (to->loop_volume != from->loop_volume)
+                w |= 0x4000;
+            if (to->loop_attenuation != from->loop_attenuation)
+                w |= 0x8000;
+
+            MSG_WriteShort(w);
+            if (w & 0x4000)
+                MSG_WriteByte(to->loop_volume);
+            if (w & 0x8000)
+                MSG_WriteByte(to->loop_attenuation);
+        } else {
+            MSG_WriteByte(to->sound);
+        }
+    }
+
+    if (bits & U_EVENT)
+        MSG_WriteByte(to->event);
+
+    if (bits & U_SOLID) {
+        if (flags & MSG_ES_LONGSOLID)
+            MSG_WriteLong(to->solid);
+        else
+            MSG_WriteShort(to->solid);
+    }
+
+    if (flags & MSG_ES_EXTENSIONS) {
+        uint32_t to_morefx = to->effects >> 32;
+        if ((bits & U_MOREFX32) == U_MOREFX32)
+            MSG_WriteLong(to_morefx);
+        else if (bits & U_MOREFX8)
+            MSG_WriteByte(to_morefx);
+        else if (bits & U_MOREFX16)
+            MSG_WriteShort(to_morefx);
+
+        if (bits & U_ALPHA)
+            MSG_WriteByte(to->alpha);
+
+        if (bits & U_SCALE)
+            MSG_WriteByte(to->scale);
+    }
+
+}
+
+static void print_bench(const char *what, int count, uint64_t bytes, uint64_t enc, uint64_t dec)
+{
+    enc = max(enc, 1);
+    dec = max(dec, 1);
+    Com_Printf("%-22s encode %5.1f MB/s %9.f/sec, decode %5.1f MB/s %9.f/sec, %.1f bytes\n",
+               what, bytes / (double)enc, count * 1e6 / enc,
+               bytes / (double)dec, count * 1e6 / dec, (double)bytes / count);
+}
+
+static void Com_MsgBench_f(void)
+{
+    static const msgEsFlags_t es_flags[] = {
+        MSG_ES_RERELEASE,
+        MSG_ES_RERELEASE | MSG_ES_UMASK | MSG_ES_LONGSOLID | MSG_ES_BEAMORIGIN | MSG_ES_SHORTANGLES,
+        MSG_ES_RERELEASE | MSG_ES_UMASK | MSG_ES_LONGSOLID | MSG_ES_BEAMORIGIN | MSG_ES_SHORTANGLES | MSG_ES_EXTENSIONS,
+    };
+    entity_state_t *states, out;
+    entity_packed_t *packed;
+    player_state_t ps_from, ps_to, ps_out;
+    player_packed_t ps_pfrom, ps_pto;
+    msgPsFlags_t ps_flags = MSG_PS_RERELEASE | MSG_PS_EXTENSIONS;
+    uint64_t start, enc, dec, bytes, bits, old_enc;
+    int i, j, passes, count, mismatches;
+    size_t old_len;
+    byte *old_data;
+    char buffer[32];
+
+    passes = Cmd_Argc() > 1 ? Q_atoi(Cmd_Argv(1)) : 4000;
+    passes = max(passes, 1);
+    msg_seed = 0x9e3779b9;
+
+    states = Z_Malloc(sizeof(*states) * BENCH_ENTITIES * 2);
+    packed = Z_Malloc(sizeof(*packed) * BENCH_ENTITIES * 2);
+    old_data = Z_Malloc(MAX_MSGLEN);
+
+    for (i = 0; i < BENCH_ENTITIES; i++) {
+        entity_state_t *s = &states[i * 2];
+
+        memset(s, 0, sizeof(*s));
+        s->number = i + 1;
+        for (j = 0; j < 3; j++) {
+            s->origin[j] = (int)(msg_crand() * 4096);
+            s->angles[j] = msg_angle();
+        }
+        VectorCopy(s->origin, s->old_origin);
+        s->modelindex = msg_rand() % MAX_MODELS;
+        s->frame = msg_rand() % 200;
+        s->skinnum = msg_rand() & 7;
+        s->solid = msg_rand() & 1 ? PACKED_BSP : msg_rand();
+        s[1] = s[0];
+        move_entity(&s[1]);
+    }
+
+    MSG_BeginWriting();
+
+    for (i = 0; i < q_countof(es_flags); i++) {
+        msgEsFlags_t flags = es_flags[i];
+
+        for (j = 0; j < BENCH_ENTITIES * 2; j++)
+            MSG_PackEntity(&packed[j], &states[j], flags & MSG_ES_EXTENSIONS);
+
+        enc = dec = bytes = old_enc = 0;
+        mismatches = 0;
+        for (j = 0; j < passes; j++) {
+            start = Sys_Microseconds();
+            for (int k = 0; k < BENCH_ENTITIES; k++)
+                write_delta_entity_old(&packed[k * 2], &packed[k * 2 + 1],
+                                       flags | (k & 1 ? MSG_ES_NEWENTITY : 0));
+            old_enc += Sys_Microseconds() - start;
+            old_len = msg_write.cursize;
+            memcpy(old_data, msg_write.data, old_len);
+            MSG_BeginWriting();
+
+            start = Sys_Microseconds();
+            for (int k = 0; k < BENCH_ENTITIES; k++)
+                MSG_WriteDeltaEntity(&packed[k * 2], &packed[k * 2 + 1],
+                                     flags | (k & 1 ? MSG_ES_NEWENTITY : 0));
+            enc += Sys_Microseconds() - start;
+            bytes += msg_write.cursize;
+
+            if (msg_write.cursize != old_len || memcmp(msg_write.data, old_data, old_len))
+                mismatches++;
+
+            begin_reading();
+            start = Sys_Microseconds();
+            while (msg_read.readcount < msg_read.cursize) {
+                int number = MSG_ParseEntityBits(&bits, flags);
+                if (number < 1 || number > BENCH_ENTITIES)
+                    break;
+                out = states[(number - 1) * 2];
+                MSG_ParseDeltaEntity(&out, number, bits, flags);
+            }
+            dec += Sys_Microseconds() - start;
+        }
+
+        Q_snprintf(buffer, sizeof(buffer), "entities %#x", flags);
+        print_bench(buffer, passes * BENCH_ENTITIES, bytes, enc, dec);
+
+        old_enc = max(old_enc, 1);
+        Com_Printf("%-22s encode %5.1f MB/s %9.f/sec, new writer is %.2fx faster\n",
+                   "  per-field writer", bytes / (double)old_enc,
+                   passes * BENCH_ENTITIES * 1e6 / old_enc, (double)old_enc / max(enc, 1));
+        if (mismatches)
+            Com_EPrintf("%d passes encoded differently by old writer\n", mismatches);
+    }
+
+    rand_player(&ps_from);
+    ps_to = ps_from;
+    mutate_player(&ps_to);
+    MSG_PackPlayer(&ps_pfrom, &ps_from, ps_flags);
+    MSG_PackPlayer(&ps_pto, &ps_to, ps_flags);
+
+    enc = dec = bytes = 0;
+    count = passes * BENCH_PLAYERS;
+    for (j = 0; j < passes; j++) {
+        int extraflags = 0;
+
+        start = Sys_Microseconds();
+        for (int k = 0; k < BENCH_PLAYERS; k++)
+            extraflags = MSG_WriteDeltaPlayerstate_Enhanced(&ps_pfrom, &ps_pto, ps_flags);
+        enc += Sys_Microseconds() - start;
+        bytes += msg_write.cursize;
+
+        begin_reading();
+        start = Sys_Microseconds();
+        for (int k = 0; k < BENCH_PLAYERS; k++)
+            MSG_ParseDeltaPlayerstate_Enhanced(&ps_from, &ps_out, MSG_ReadWord(), extraflags, ps_flags);
+        dec += Sys_Microseconds() - start;
+    }
+    print_bench("player", count, bytes, enc, dec);
+
+    MSG_BeginWriting();
+    Z_Free(states);
+    Z_Free(packed);
+    Z_Free(old_data);
+}
+
+/*
+=============================================================================
+
+PACK FILE SEEK TESTS
+
+=============================================================================
+*/
+
+#define SEEK_TEST_READ  4096
+
+// randomly seeks and reads compressed pack entry through two handles and
+// compares against data loaded in whole. second handle is in the middle of
+// entry when seek index is created by the first one.
+static void Com_ZipSeekTest_f(void)
+{
+    qhandle_t f[2] = { 0 };
+    int i, len, count, ret, errors = 0;
+    byte *data, *buf;
+    uint64_t start;
+    char *path;
+
+    if (Cmd_Argc() < 2) {
+        Com_Printf("Usage: %s <file> [count]\n", Cmd_Argv(0));
+        return;
+    }
+
+    path = Cmd_Argv(1);
+    count = Cmd_Argc() > 2 ? Q_atoi(Cmd_Argv(2)) : 200;
+    count = max(count, 1);
+    msg_seed = 0x9e3779b9;
+
+    len = FS_LoadFileEx(path, (void **)&data, FS_TYPE_PAK, TAG_FILESYSTEM);
+    if (!data) {
+        Com_Printf("Couldn't load %s: %s\n", path, Q_ErrorString(len));
+        return;
+    }
+
+    buf = FS_Malloc(SEEK_TEST_READ);
+
+    for (i = 0; i < 2; i++) {
+        ret = FS_OpenFile(path, &f[i], FS_MODE_READ | FS_TYPE_PAK);
+        if (!f[i]) {
+            Com_Printf("Couldn't open %s: %s\n", path, Q_ErrorString(ret));
+            goto fail;
+        }
+    }
+
+    // create index by seeking backwards, then move second handle forward,
+    // it must not add checkpoints past the gap
+    ret = FS_Seek(f[1], len / 2, SEEK_SET);
+    if (!ret)
+        ret = FS_Seek(f[0], 1, SEEK_SET);
+    if (!ret)
+        ret = FS_Seek(f[0], 0, SEEK_SET);
+    if (!ret)
+        ret = FS_Seek(f[1], len / 2 + len / 8, SEEK_SET);
+    if (ret) {
+        Com_Printf("Couldn't seek %s: %s\n", path, Q_ErrorString(ret));
+        goto fail;
+    }
+
+    start = Sys_Microseconds();
+    for (i = 0; i < count; i++) {
+        qhandle_t h = f[msg_rand() & 1];
+        int offset = msg_rand() % len;
+        int size = min(msg_rand() % SEEK_TEST_READ + 1, len - offset);
+
+        ret = FS_Seek(h, offset, SEEK_SET);
+        if (!ret)
+            ret = FS_Read(buf, size, h);
+        if (ret != size || memcmp(buf, data + offset, size)) {
+            Com_EPrintf("Read of %d bytes at %d failed: %s\n", size, offset,
+                        ret < 0 ? Q_ErrorString(ret) : "data mismatch");
+            errors++;
+        }
+    }
+
+    Com_Printf("%d failures, %d seeks tested in %.f ms\n", errors, count,
+               (Sys_Microseconds() - start) * 1e-3);
+
+fail:
+    for (i = 0; i < 2; i++)
+        if (f[i])
+            FS_CloseFile(f[i]);
+    Z_Free(buf);
+    FS_FreeFile(data);
+}
+
 static const cmdreg_t c_test[] = {
     { "error", Com_Error_f },
     { "errordrop", Com_ErrorDrop_f },
@@ -881,6 +1796,9 @@ static const cmdreg_t c_test[] = {
     { "extcmptest", Com_ExtCmpTest_f },
     { "nextpathtest", Com_NextPathTest_f },
     { "extract", Com_Extract_f },
+    { "msgtest", Com_MsgTest_f },
+    { "msgbench", Com_MsgBench_f },
+    { "zipseektest", Com_ZipSeekTest_f },
     { NULL }
 };
 
@@ -26,6 +26,8 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "system/system.h"
 #endif
 
+#include "system/pthread.h"
+
 #define Z_MAGIC     0x1d0d
 
 typedef struct {
@@ -51,6 +53,12 @@ typedef struct {
 static list_t       z_chain;
 static zstats_t     z_stats[TAG_MAX];
 
+// allocations may come from async and parallel work threads, so the chain
+// is only accessed with the lock held.
+static pthread_mutex_t  z_lock = PTHREAD_MUTEX_INITIALIZER;
+#define Z_Lock()    pthread_mutex_lock(&z_lock)
+#define Z_Unlock()  pthread_mutex_unlock(&z_lock)
+
 #define S(d) \
     { .z = { .magic = Z_MAGIC, .tag = TAG_STATIC, .size = sizeof(zstatic_t) }, .data = d }
 
@@ -94,18 +102,29 @@ static inline void Z_CountAlloc(const zhead_t *z)
 #define Z_Validate(z) \
     Q_assert((z)->magic == Z_MAGIC && (z)->tag != TAG_FREE)
 
+// error handler frees memory, so release the lock before failing
+#define Z_ValidateLocked(z) \
+    do { \
+        if ((z)->magic != Z_MAGIC || (z)->tag == TAG_FREE) { \
+            Z_Unlock(); \
+            Z_Validate(z); \
+        } \
+    } while (0)
+
 void Z_LeakTest(memtag_t tag)
 {
     zhead_t *z;
     size_t numLeaks = 0, numBytes = 0;
 
+    Z_Lock();
     LIST_FOR_EACH(zhead_t, z, &z_chain, entry) {
-        Z_Validate(z);
+        Z_ValidateLocked(z);
         if (z->tag == tag || (tag == TAG_FREE && z->tag >= TAG_MAX)) {
             numLeaks++;
             numBytes += z->size;
         }
     }
+    Z_Unlock();
 
     if (numLeaks) {
         Com_WPrintf("************* Z_LeakTest *************\n"
@@ -116,6 +135,20 @@ void Z_LeakTest(memtag_t tag)
     }
 }
 
+// called with lock held, returns true if block should be freed
+static bool Z_Unlink(zhead_t *z)
+{
+    Z_CountFree(z);
+
+    if (z->tag == TAG_STATIC)
+        return false;
+
+    List_Remove(&z->entry);
+    z->magic = 0xdead;
+    z->tag = TAG_FREE;
+    return true;
+}
+
 /*
 ========================
 Z_Free
@@ -124,6 +157,7 @@ Z_Free
 void Z_Free(void *ptr)
 {
     zhead_t *z;
+    bool unlinked;
 
     if (!ptr) {
         return;
@@ -133,12 +167,11 @@ void Z_Free(void *ptr)
 
     Z_Validate(z);
 
-    Z_CountFree(z);
+    Z_Lock();
+    unlinked = Z_Unlink(z);
+    Z_Unlock();
 
-    if (z->tag != TAG_STATIC) {
-        List_Remove(&z->entry);
-        z->magic = 0xdead;
-        z->tag = TAG_FREE;
+    if (unlinked) {
         free(z);
     }
 }
@@ -190,10 +223,12 @@ void *Z_Realloc(void *ptr, size_t size)
 
     Q_assert(z->tag != TAG_STATIC);
 
+    Z_Lock();
     Z_CountFree(z);
 
     z = realloc(z, size);
     if (!z) {
+        Z_Unlock();
         Com_Error(ERR_FATAL, "%s: couldn't realloc %zu bytes", __func__, size);
     }
 
@@ -205,6 +240,7 @@ void *Z_Realloc(void *ptr, size_t size)
     List_Relink(&z->entry);
 
     Z_CountAlloc(z);
+    Z_Unlock();
 
     return z + 1;
 }
@@ -245,6 +281,22 @@ void Z_Stats_f(void)
                bytes, count);
 }
 
+/*
+========================
+Z_TagStats
+
+Returns tag name, or NULL if there are no allocations with this tag.
+========================
+*/
+const char *Z_TagStats(memtag_t tag, size_t *bytes, size_t *count)
+{
+    const zstats_t *s = &z_stats[TAG_INDEX(tag)];
+
+    *bytes = s->bytes;
+    *count = s->count;
+    return s->count ? z_tagnames[TAG_INDEX(tag)] : NULL;
+}
+
 /*
 ========================
 Z_FreeTags
@@ -254,12 +306,14 @@ void Z_FreeTags(memtag_t tag)
 {
     zhead_t *z, *n;
 
+    Z_Lock();
     LIST_FOR_EACH_SAFE(zhead_t, z, n, &z_chain, entry) {
-        Z_Validate(z);
-        if (z->tag == tag) {
-            Z_Free(z + 1);
+        Z_ValidateLocked(z);
+        if (z->tag == tag && Z_Unlink(z)) {
+            free(z);
         }
     }
+    Z_Unlock();
 }
 
 /*
@@ -292,7 +346,10 @@ static void *Z_TagMallocInternal(size_t size, memtag_t tag, bool init)
     Sys_BackTrace(z->trace, q_countof(z->trace), 3);
 #endif
 
+    Z_Lock();
     List_Insert(&z_chain, &z->entry);
+    Z_CountAlloc(z);
+    Z_Unlock();
 
 #if USE_TESTS
     if (!init && z_perturb && z_perturb->integer) {
@@ -300,8 +357,6 @@ static void *Z_TagMallocInternal(size_t size, memtag_t tag, bool init)
     }
 #endif
 
-    Z_CountAlloc(z);
-
     return z + 1;
 }
 
@@ -376,6 +431,8 @@ char *Z_CvarCopyString(const char *in)
 
     // return static storage
     z = &z_static[i];
+    Z_Lock();
     Z_CountAlloc(&z->z);
+    Z_Unlock();
     return (char *)z->data;
 }
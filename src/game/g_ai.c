@@ -249,6 +249,86 @@ int range(edict_t *self, edict_t *other)
     return RANGE_FAR;
 }
 
+/*
+=============
+SIGHT CACHE
+
+Clipping sight lines to world gives the same result for the whole level, and
+monsters that stand still check the same lines every frame. World part of
+each line is remembered, and if it is blocked, there is no need to check
+entities at all. Otherwise only entities need to be clipped.
+=============
+*/
+
+#define SIGHT_CACHE_SIZE    2048    // must be power of two
+
+static game3_worldtrace_t   sight_cache[SIGHT_CACHE_SIZE];
+
+static struct {
+    unsigned    hits;
+    unsigned    misses;
+    unsigned    blocked;
+} sight_stats;
+
+void AI_ClearSightCache(void)
+{
+    memset(sight_cache, 0, sizeof(sight_cache));
+}
+
+void AI_SightStats(void)
+{
+    unsigned total = sight_stats.hits + sight_stats.misses;
+
+    gi.cprintf(NULL, PRINT_HIGH, "Sight checks: %u, cache hits: %u (%u%%), blocked by world: %u (%u%%)\n",
+               total, sight_stats.hits, total ? sight_stats.hits * 100 / total : 0,
+               sight_stats.blocked, total ? sight_stats.blocked * 100 / total : 0);
+}
+
+static game3_worldtrace_t *SightCacheEntry(const vec3_t spot1, const vec3_t spot2)
+{
+    uint32_t    v[6];
+    uint32_t    hash = 2166136261u;
+    int         i;
+
+    memcpy(v, spot1, sizeof(vec3_t));
+    memcpy(v + 3, spot2, sizeof(vec3_t));
+    for (i = 0; i < 6; i++)
+        hash = (hash ^ v[i]) * 16777619u;
+
+    return &sight_cache[hash & (SIGHT_CACHE_SIZE - 1)];
+}
+
+static bool CachedVisible(edict_t *self, const vec3_t spot1, const vec3_t spot2)
+{
+    game3_worldtrace_t *wt = SightCacheEntry(spot1, spot2);
+    game3_worldtrace_t tr;
+
+    // compare bits, as -0 may give slightly different result than 0
+    if (wt->contentmask == MASK_OPAQUE &&
+        !memcmp(wt->start, spot1, sizeof(vec3_t)) &&
+        !memcmp(wt->end, spot2, sizeof(vec3_t))) {
+        sight_stats.hits++;
+    } else {
+        sight_stats.misses++;
+        VectorCopy(spot1, wt->start);
+        VectorClear(wt->mins);
+        VectorClear(wt->maxs);
+        VectorCopy(spot2, wt->end);
+        wt->contentmask = MASK_OPAQUE;
+        gix->TraceWorld(wt, 1);
+    }
+
+    // entities can only make it shorter
+    if (wt->trace.fraction < 1.0f) {
+        sight_stats.blocked++;
+        return false;
+    }
+
+    tr = *wt;
+    gix->TraceEntities(&tr, self);
+    return tr.trace.fraction == 1.0f;
+}
+
 /*
 =============
 visible
@@ -266,6 +346,10 @@ bool visible(edict_t *self, edict_t *other)
     spot1[2] += self->viewheight;
     VectorCopy(other->s.origin, spot2);
     spot2[2] += other->viewheight;
+
+    if (gix)
+        return CachedVisible(self, spot1, spot2);
+
     trace = gi.trace(spot1, vec3_origin, vec3_origin, spot2, self, MASK_OPAQUE);
 
     if (trace.fraction == 1.0f)
@@ -460,6 +460,7 @@ typedef struct {
 extern  game_locals_t   game;
 extern  level_locals_t  level;
 extern  game3_import_t  gi;
+extern  const game3_import_ex_t *gix;
 extern  game3_export_t  globals;
 extern  spawn_temp_t    st;
 
@@ -536,6 +537,7 @@ extern  cvar_t  *filterban;
 
 extern  cvar_t  *sv_gravity;
 extern  cvar_t  *sv_maxvelocity;
+extern  cvar_t  *g_parallel_physics;
 
 extern  cvar_t  *gun_x, *gun_y, *gun_z;
 extern  cvar_t  *sv_rollspeed;
@@ -706,6 +708,8 @@ void func_clock_use(edict_t *self, edict_t *other, edict_t *activator);
 // g_ai.c
 //
 void AI_SetSightClient(void);
+void AI_ClearSightCache(void);
+void AI_SightStats(void);
 
 void ai_stand(edict_t *self, float dist);
 void ai_move(edict_t *self, float dist);
@@ -761,6 +765,14 @@ void ClientBeginServerFrame(edict_t *ent);
 void player_pain(edict_t *self, edict_t *other, float kick, int damage);
 void player_die(edict_t *self, edict_t *inflictor, edict_t *attacker, int damage, vec3_t point);
 
+//
+// g_save.c
+//
+void G_FreeSaveBuffers(void);
+#if USE_TESTS
+void G_SaveBench(void);
+#endif
+
 //
 // g_svcmds.c
 //
@@ -798,6 +810,7 @@ void M_ChangeYaw(edict_t *ent);
 //
 // g_phys.c
 //
+void G_PredictMoves(void);
 void G_RunEntity(edict_t *ent);
 
 //
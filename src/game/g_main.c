@@ -21,6 +21,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 game_locals_t   game;
 level_locals_t  level;
 game3_import_t  gi;
+const game3_import_ex_t *gix;
 game3_export_t  globals;
 spawn_temp_t    st;
 
@@ -49,6 +50,7 @@ cvar_t  *filterban;
 
 cvar_t  *sv_maxvelocity;
 cvar_t  *sv_gravity;
+cvar_t  *g_parallel_physics;
 
 cvar_t  *sv_rollspeed;
 cvar_t  *sv_rollangle;
@@ -95,6 +97,8 @@ void ShutdownGame(void)
 
     memset(&game, 0, sizeof(game));
 
+    G_FreeSaveBuffers();
+
     gi.FreeTags(TAG_LEVEL);
     gi.FreeTags(TAG_GAME);
 }
@@ -152,6 +156,7 @@ void InitGame(void)
 
     g_select_empty = gi.cvar("g_select_empty", "0", CVAR_ARCHIVE);
     g_protocol_extensions = gi.cvar("g_protocol_extensions", "0", CVAR_LATCH);
+    g_parallel_physics = gi.cvar("g_parallel_physics", "0", 0);
 
     run_pitch = gi.cvar("run_pitch", "0.002", 0);
     run_roll = gi.cvar("run_roll", "0.005", 0);
@@ -237,6 +242,26 @@ q_exported game3_export_t *GetGameAPI(game3_import_t *import)
     return &globals;
 }
 
+static const game3_export_ex_t globals_ex = {
+    .apiversion = GAME3_API_VERSION_EX,
+    .structsize = sizeof(game3_export_ex_t),
+};
+
+/*
+=================
+GetGameAPIEx
+
+Called by Q2PRO after GetGameAPI()
+=================
+*/
+q_exported const game3_export_ex_t *GetGameAPIEx(const game3_import_ex_t *import)
+{
+    if (import->apiversion >= GAME3_API_VERSION_EX_WORLD_TRACE)
+        gix = import;
+
+    return &globals_ex;
+}
+
 #ifndef GAME_HARD_LINKED
 // this is only here so the functions in q_shared.c can link
 void Com_LPrintf(print_type_t type, const char *fmt, ...)
@@ -486,6 +511,9 @@ void G_RunFrame(void)
         return;
     }
 
+    // clip projectile moves to world in parallel
+    G_PredictMoves();
+
     //
     // treat each object in turn
     // even the world gets a chance to think
@@ -304,6 +304,114 @@ void SV_AddGravity(edict_t *ent)
 /*
 ===============================================================================
 
+PREDICTED MOVES
+
+Toss and fly moves mostly clip to world, which doesn't depend on other
+entities. Before entities run, their moves are predicted and clipped to world
+by the server in parallel. SV_PushEntity() then only has to clip to entities,
+provided the actual move is exactly the predicted one. If think function or
+another entity changed anything, the move is traced as usual, so results are
+always the same as without prediction.
+
+===============================================================================
+*/
+
+static game3_worldtrace_t   predicted[MAX_EDICTS];
+static int                  predicted_index[MAX_EDICTS];    // 1-based
+
+static bool PredictMove(edict_t *ent, game3_worldtrace_t *wt)
+{
+    vec3_t  velocity;
+    vec3_t  move;
+    float   speed;
+
+    switch (ent->movetype) {
+    case MOVETYPE_TOSS:
+    case MOVETYPE_BOUNCE:
+    case MOVETYPE_FLY:
+    case MOVETYPE_FLYMISSILE:
+        break;
+    default:
+        return false;
+    }
+
+    if (ent->flags & FL_TEAMSLAVE)
+        return false;
+    if (ent->groundentity && ent->velocity[2] <= 0)
+        return false;
+
+    // same as SV_CheckVelocity() and SV_AddGravity()
+    speed = sv_maxvelocity->value;
+    velocity[0] = Q_clipf(ent->velocity[0], -speed, speed);
+    velocity[1] = Q_clipf(ent->velocity[1], -speed, speed);
+    velocity[2] = Q_clipf(ent->velocity[2], -speed, speed);
+
+    if (ent->movetype != MOVETYPE_FLY && ent->movetype != MOVETYPE_FLYMISSILE)
+        velocity[2] -= ent->gravity * sv_gravity->value * FRAMETIME;
+
+    VectorScale(velocity, FRAMETIME, move);
+
+    VectorCopy(ent->s.origin, wt->start);
+    VectorCopy(ent->mins, wt->mins);
+    VectorCopy(ent->maxs, wt->maxs);
+    VectorAdd(wt->start, move, wt->end);
+    wt->contentmask = ent->clipmask ? ent->clipmask : MASK_SOLID;
+    return true;
+}
+
+/*
+============
+G_PredictMoves
+
+Called once per frame before running entities.
+============
+*/
+void G_PredictMoves(void)
+{
+    edict_t *ent;
+    int     i, count = 0;
+
+    memset(predicted_index, 0, sizeof(predicted_index));
+
+    if (!gix || !g_parallel_physics->value)
+        return;
+
+    for (i = game.maxclients + 1; i < globals.num_edicts; i++) {
+        ent = &g_edicts[i];
+        if (ent->inuse && PredictMove(ent, &predicted[count]))
+            predicted_index[i] = ++count;
+    }
+
+    if (count)
+        gix->TraceWorld(predicted, count);
+}
+
+static trace_t SV_PushTrace(edict_t *ent, const vec3_t start, const vec3_t end, int mask)
+{
+    int num = ent - g_edicts;
+    game3_worldtrace_t *wt;
+
+    if (predicted_index[num]) {
+        wt = &predicted[predicted_index[num] - 1];
+        predicted_index[num] = 0;
+
+        // compare bits, as -0 may give slightly different result than 0
+        if (!memcmp(wt->start, start, sizeof(vec3_t)) &&
+            !memcmp(wt->end, end, sizeof(vec3_t)) &&
+            !memcmp(wt->mins, ent->mins, sizeof(vec3_t)) &&
+            !memcmp(wt->maxs, ent->maxs, sizeof(vec3_t)) &&
+            wt->contentmask == mask) {
+            gix->TraceEntities(wt, ent);
+            return wt->trace;
+        }
+    }
+
+    return gi.trace(start, ent->mins, ent->maxs, end, ent, mask);
+}
+
+/*
+===============================================================================
+
 PUSHMOVE
 
 ===============================================================================
@@ -332,7 +440,7 @@ retry:
     else
         mask = MASK_SOLID;
 
-    trace = gi.trace(start, ent->mins, ent->maxs, end, ent, mask);
+    trace = SV_PushTrace(ent, start, end, mask);
 
     VectorCopy(trace.endpos, ent->s.origin);
     gi.linkentity(ent);
@@ -449,151 +449,274 @@ static const save_field_t gamefields[] = {
 
 //=========================================================
 
-static void write_data(void *buf, size_t len, gzFile f)
+/*
+Savegames are serialized into memory buffer first and then compressed in
+a single pass. Reading decompresses the whole file up front. File format
+is unchanged.
+*/
+typedef struct {
+    byte    *data;
+    size_t  cursize;
+    size_t  maxsize;
+    size_t  readcount;
+} savebuf_t;
+
+// kept allocated between saves
+static savebuf_t    savebuf;
+
+static void *write_space(savebuf_t *b, size_t len)
+{
+    void *p;
+
+    if (len > b->maxsize - b->cursize) {
+        size_t size = max(b->maxsize * 2, b->cursize + len);
+        byte *data = gi.TagMalloc(size, TAG_GAME);
+        if (b->data) {
+            memcpy(data, b->data, b->cursize);
+            gi.TagFree(b->data);
+        }
+        b->data = data;
+        b->maxsize = size;
+    }
+
+    p = b->data + b->cursize;
+    b->cursize += len;
+    return p;
+}
+
+static savebuf_t *begin_write(void)
 {
-    if (gzwrite(f, buf, len) != len) {
+    savebuf.cursize = 0;
+    return &savebuf;
+}
+
+static void end_write(savebuf_t *b, const char *filename)
+{
+    gzFile f;
+
+    f = gzopen(filename, "wb");
+    if (!f)
+        gi.error("Couldn't open %s", filename);
+
+    if (gzwrite(f, b->data, b->cursize) != b->cursize) {
         gzclose(f);
-        gi.error("%s: couldn't write %zu bytes", __func__, len);
+        gi.error("Couldn't write %s", filename);
     }
+
+    if (gzclose(f))
+        gi.error("Couldn't write %s", filename);
+}
+
+static savebuf_t *begin_read(const char *filename)
+{
+    savebuf_t *b = &savebuf;
+    gzFile f;
+    int ret;
+
+    f = gzopen(filename, "rb");
+    if (!f)
+        gi.error("Couldn't open %s", filename);
+
+    gzbuffer(f, 65536);
+
+    b->cursize = b->readcount = 0;
+    do {
+        ret = gzread(f, write_space(b, 65536), 65536);
+        if (ret < 0) {
+            gzclose(f);
+            gi.error("Couldn't read %s", filename);
+        }
+        b->cursize -= 65536 - ret;
+    } while (ret == 65536);
+
+    gzclose(f);
+    return b;
+}
+
+static void write_data(void *buf, size_t len, savebuf_t *b)
+{
+    memcpy(write_space(b, len), buf, len);
 }
 
-static void write_short(gzFile f, int16_t v)
+static void write_short(savebuf_t *b, int16_t v)
 {
     v = LittleShort(v);
-    write_data(&v, sizeof(v), f);
+    write_data(&v, sizeof(v), b);
 }
 
-static void write_int(gzFile f, int32_t v)
+static void write_int(savebuf_t *b, int32_t v)
 {
     v = LittleLong(v);
-    write_data(&v, sizeof(v), f);
+    write_data(&v, sizeof(v), b);
 }
 
-static void write_float(gzFile f, float v)
+static void write_float(savebuf_t *b, float v)
 {
     v = LittleFloat(v);
-    write_data(&v, sizeof(v), f);
+    write_data(&v, sizeof(v), b);
 }
 
-static void write_string(gzFile f, char *s)
+static void write_string(savebuf_t *b, char *s)
 {
     size_t len;
 
     if (!s) {
-        write_int(f, -1);
+        write_int(b, -1);
         return;
     }
 
     len = strlen(s);
     if (len >= 65536) {
-        gzclose(f);
         gi.error("%s: bad length", __func__);
     }
-    write_int(f, len);
-    write_data(s, len, f);
+    write_int(b, len);
+    write_data(s, len, b);
 }
 
-static void write_vector(gzFile f, vec_t *v)
+static void write_vector(savebuf_t *b, vec_t *v)
 {
-    write_float(f, v[0]);
-    write_float(f, v[1]);
-    write_float(f, v[2]);
+    write_float(b, v[0]);
+    write_float(b, v[1]);
+    write_float(b, v[2]);
 }
 
-static void write_index(gzFile f, void *p, size_t size, const void *start, int max_index)
+static void write_index(savebuf_t *b, void *p, size_t size, const void *start, int max_index)
 {
     uintptr_t diff;
 
     if (!p) {
-        write_int(f, -1);
+        write_int(b, -1);
         return;
     }
 
     diff = (uintptr_t)p - (uintptr_t)start;
     if (diff > max_index * size) {
-        gzclose(f);
         gi.error("%s: pointer out of range: %p", __func__, p);
     }
     if (diff % size) {
-        gzclose(f);
         gi.error("%s: misaligned pointer: %p", __func__, p);
     }
-    write_int(f, (int)(diff / size));
+    write_int(b, (int)(diff / size));
 }
 
-static void write_pointer(gzFile f, void *p, ptr_type_t type)
+// save_ptrs indices sorted by type and pointer
+static int  *sorted_ptrs;
+
+static int ptrcmp(ptr_type_t type, const void *p, const save_ptr_t *ptr)
+{
+    if (type != ptr->type)
+        return type < ptr->type ? -1 : 1;
+    if (p != ptr->ptr)
+        return (uintptr_t)p < (uintptr_t)ptr->ptr ? -1 : 1;
+    return 0;
+}
+
+static int sortcmp(const void *p1, const void *p2)
+{
+    const save_ptr_t *ptr1 = &save_ptrs[*(const int *)p1];
+    const save_ptr_t *ptr2 = &save_ptrs[*(const int *)p2];
+    int ret = ptrcmp(ptr1->type, ptr1->ptr, ptr2);
+
+    // keep the first index if there are duplicates
+    return ret ? ret : *(const int *)p1 - *(const int *)p2;
+}
+
+static void sort_pointers(void)
 {
-    const save_ptr_t *ptr;
     int i;
 
+    sorted_ptrs = gi.TagMalloc(num_save_ptrs * sizeof(sorted_ptrs[0]), TAG_GAME);
+
+    for (i = 0; i < num_save_ptrs; i++)
+        sorted_ptrs[i] = i;
+
+    qsort(sorted_ptrs, num_save_ptrs, sizeof(sorted_ptrs[0]), sortcmp);
+}
+
+static void write_pointer(savebuf_t *b, void *p, ptr_type_t type)
+{
+    int left, right, mid, ret;
+
     if (!p) {
-        write_int(f, -1);
+        write_int(b, -1);
         return;
     }
 
-    for (i = 0, ptr = save_ptrs; i < num_save_ptrs; i++, ptr++) {
-        if (ptr->type == type && ptr->ptr == p) {
-            write_int(f, i);
-            return;
-        }
+    if (!sorted_ptrs)
+        sort_pointers();
+
+    // find the leftmost match
+    left = 0;
+    right = num_save_ptrs;
+    while (left < right) {
+        mid = (left + right) / 2;
+        ret = ptrcmp(type, p, &save_ptrs[sorted_ptrs[mid]]);
+        if (ret > 0)
+            left = mid + 1;
+        else
+            right = mid;
+    }
+
+    if (left < num_save_ptrs && !ptrcmp(type, p, &save_ptrs[sorted_ptrs[left]])) {
+        write_int(b, sorted_ptrs[left]);
+        return;
     }
 
-    gzclose(f);
     gi.error("%s: unknown pointer: %p", __func__, p);
 }
 
-static void write_field(gzFile f, const save_field_t *field, void *base)
+static void write_field(savebuf_t *b, const save_field_t *field, void *base)
 {
     void *p = (byte *)base + field->ofs;
     int i;
 
     switch (field->type) {
     case F_BYTE:
-        write_data(p, field->size, f);
+        write_data(p, field->size, b);
         break;
     case F_SHORT:
         for (i = 0; i < field->size; i++) {
-            write_short(f, ((short *)p)[i]);
+            write_short(b, ((short *)p)[i]);
         }
         break;
     case F_INT:
         for (i = 0; i < field->size; i++) {
-            write_int(f, ((int *)p)[i]);
+            write_int(b, ((int *)p)[i]);
         }
         break;
     case F_BOOL:
         for (i = 0; i < field->size; i++) {
-            write_int(f, ((bool *)p)[i]);
+            write_int(b, ((bool *)p)[i]);
         }
         break;
     case F_FLOAT:
         for (i = 0; i < field->size; i++) {
-            write_float(f, ((float *)p)[i]);
+            write_float(b, ((float *)p)[i]);
         }
         break;
     case F_VECTOR:
-        write_vector(f, (vec_t *)p);
+        write_vector(b, (vec_t *)p);
         break;
 
     case F_ZSTRING:
-        write_string(f, (char *)p);
+        write_string(b, (char *)p);
         break;
     case F_LSTRING:
-        write_string(f, *(char **)p);
+        write_string(b, *(char **)p);
         break;
 
     case F_EDICT:
-        write_index(f, *(void **)p, sizeof(edict_t), g_edicts, game.maxentities - 1);
+        write_index(b, *(void **)p, sizeof(edict_t), g_edicts, game.maxentities - 1);
         break;
     case F_CLIENT:
-        write_index(f, *(void **)p, sizeof(gclient_t), game.clients, game.maxclients - 1);
+        write_index(b, *(void **)p, sizeof(gclient_t), game.clients, game.maxclients - 1);
         break;
     case F_ITEM:
-        write_index(f, *(void **)p, sizeof(gitem_t), itemlist, game.num_items - 1);
+        write_index(b, *(void **)p, sizeof(gitem_t), itemlist, game.num_items - 1);
         break;
 
     case F_POINTER:
-        write_pointer(f, *(void **)p, field->size);
+        write_pointer(b, *(void **)p, field->size);
         break;
 
     default:
@@ -601,108 +724,106 @@ static void write_field(gzFile f, const save_field_t *field, void *base)
     }
 }
 
-static void write_fields(gzFile f, const save_field_t *fields, void *base)
+static void write_fields(savebuf_t *b, const save_field_t *fields, void *base)
 {
     const save_field_t *field;
 
     for (field = fields; field->type; field++) {
-        write_field(f, field, base);
+        write_field(b, field, base);
     }
 }
 
-static void read_data(void *buf, size_t len, gzFile f)
+static void read_data(void *buf, size_t len, savebuf_t *b)
 {
-    if (gzread(f, buf, len) != len) {
-        gzclose(f);
+    if (len > b->cursize - b->readcount)
         gi.error("%s: couldn't read %zu bytes", __func__, len);
-    }
+
+    memcpy(buf, b->data + b->readcount, len);
+    b->readcount += len;
 }
 
-static int read_short(gzFile f)
+static int read_short(savebuf_t *b)
 {
     int16_t v;
 
-    read_data(&v, sizeof(v), f);
+    read_data(&v, sizeof(v), b);
     v = LittleShort(v);
 
     return v;
 }
 
-static int read_int(gzFile f)
+static int read_int(savebuf_t *b)
 {
     int32_t v;
 
-    read_data(&v, sizeof(v), f);
+    read_data(&v, sizeof(v), b);
     v = LittleLong(v);
 
     return v;
 }
 
-static float read_float(gzFile f)
+static float read_float(savebuf_t *b)
 {
     float v;
 
-    read_data(&v, sizeof(v), f);
+    read_data(&v, sizeof(v), b);
     v = LittleFloat(v);
 
     return v;
 }
 
-static char *read_string(gzFile f)
+static char *read_string(savebuf_t *b)
 {
     int len;
     char *s;
 
-    len = read_int(f);
+    len = read_int(b);
     if (len == -1) {
         return NULL;
     }
 
     if (len < 0 || len >= 65536) {
-        gzclose(f);
         gi.error("%s: bad length", __func__);
     }
 
     s = gi.TagMalloc(len + 1, TAG_LEVEL);
-    read_data(s, len, f);
+    read_data(s, len, b);
     s[len] = 0;
 
     return s;
 }
 
-static void read_zstring(gzFile f, char *s, size_t size)
+static void read_zstring(savebuf_t *b, char *s, size_t size)
 {
     int len;
 
-    len = read_int(f);
+    len = read_int(b);
     if (len < 0 || len >= size) {
-        gzclose(f);
         gi.error("%s: bad length", __func__);
     }
 
-    read_data(s, len, f);
+    read_data(s, len, b);
     s[len] = 0;
 }
 
-static void read_vector(gzFile f, vec_t *v)
+static void read_vector(savebuf_t *b, vec_t *v)
 {
-    v[0] = read_float(f);
-    v[1] = read_float(f);
-    v[2] = read_float(f);
+    v[0] = read_float(b);
+    v[1] = read_float(b);
+    v[2] = read_float(b);
 }
 
-static void *read_index(gzFile f, size_t size, const void *start, int max_index)
+static void *read_index(savebuf_t *b, size_t size, const void *start, int max_index)
 {
     int index;
     byte *p;
 
-    index = read_int(f);
+    index = read_int(b);
     if (index == -1) {
         return NULL;
     }
 
     if (index < 0 || index > max_index) {
-        gzclose(f);
         gi.error("%s: bad index", __func__);
     }
 
@@ -710,82 +831,80 @@ static void *read_index(gzFile f, size_t size, const void *start, int max_index)
     return p;
 }
 
-static void *read_pointer(gzFile f, ptr_type_t type)
+static void *read_pointer(savebuf_t *b, ptr_type_t type)
 {
     int index;
     const save_ptr_t *ptr;
 
-    index = read_int(f);
+    index = read_int(b);
     if (index == -1) {
         return NULL;
     }
 
     if (index < 0 || index >= num_save_ptrs) {
-        gzclose(f);
         gi.error("%s: bad index", __func__);
     }
 
     ptr = &save_ptrs[index];
     if (ptr->type != type) {
-        gzclose(f);
         gi.error("%s: type mismatch", __func__);
     }
 
     return (void *)ptr->ptr;
 }
 
-static void read_field(gzFile f, const save_field_t *field, void *base)
+static void read_field(savebuf_t *b, const save_field_t *field, void *base)
 {
     void *p = (byte *)base + field->ofs;
     int i;
 
     switch (field->type) {
     case F_BYTE:
-        read_data(p, field->size, f);
+        read_data(p, field->size, b);
         break;
     case F_SHORT:
         for (i = 0; i < field->size; i++) {
-            ((short *)p)[i] = read_short(f);
+            ((short *)p)[i] = read_short(b);
         }
         break;
     case F_INT:
         for (i = 0; i < field->size; i++) {
-            ((int *)p)[i] = read_int(f);
+            ((int *)p)[i] = read_int(b);
         }
         break;
     case F_BOOL:
         for (i = 0; i < field->size; i++) {
-            ((bool *)p)[i] = read_int(f);
+            ((bool *)p)[i] = read_int(b);
         }
         break;
     case F_FLOAT:
         for (i = 0; i < field->size; i++) {
-            ((float *)p)[i] = read_float(f);
+            ((float *)p)[i] = read_float(b);
         }
         break;
     case F_VECTOR:
-        read_vector(f, (vec_t *)p);
+        read_vector(b, (vec_t *)p);
         break;
 
     case F_LSTRING:
-        *(char **)p = read_string(f);
+        *(char **)p = read_string(b);
         break;
     case F_ZSTRING:
-        read_zstring(f, (char *)p, field->size);
+        read_zstring(b, (char *)p, field->size);
         break;
 
     case F_EDICT:
-        *(edict_t **)p = read_index(f, sizeof(edict_t), g_edicts, game.maxentities - 1);
+        *(edict_t **)p = read_index(b, sizeof(edict_t), g_edicts, game.maxentities - 1);
         break;
     case F_CLIENT:
-        *(gclient_t **)p = read_index(f, sizeof(gclient_t), game.clients, game.maxclients - 1);
+        *(gclient_t **)p = read_index(b, sizeof(gclient_t), game.clients, game.maxclients - 1);
         break;
     case F_ITEM:
-        *(gitem_t **)p = read_index(f, sizeof(gitem_t), itemlist, game.num_items - 1);
+        *(gitem_t **)p = read_index(b, sizeof(gitem_t), itemlist, game.num_items - 1);
         break;
 
     case F_POINTER:
-        *(void **)p = read_pointer(f, field->size);
+        *(void **)p = read_pointer(b, field->size);
         break;
 
     default:
@@ -793,12 +912,12 @@ static void read_field(gzFile f, const save_field_t *field, void *base)
     }
 }
 
-static void read_fields(gzFile f, const save_field_t *fields, void *base)
+static void read_fields(savebuf_t *b, const save_field_t *fields, void *base)
 {
     const save_field_t *field;
 
     for (field = fields; field->type; field++) {
-        read_field(f, field, base);
+        read_field(b, field, base);
     }
 }
 
@@ -836,15 +955,13 @@ last save position.
 */
 void WriteGame(const char *filename, qboolean autosave)
 {
-    gzFile  f;
-    int     i;
+    savebuf_t   *f;
+    int         i;
 
     if (!autosave)
         SaveClientData();
 
-    f = gzopen(filename, "wb");
-    if (!f)
-        gi.error("Couldn't open %s", filename);
+    f = begin_write();
 
     write_int(f, SAVE_MAGIC1);
     write_int(f, SAVE_VERSION);
@@ -857,33 +974,27 @@ void WriteGame(const char *filename, qboolean autosave)
         write_fields(f, clientfields, &game.clients[i]);
     }
 
-    if (gzclose(f))
-        gi.error("Couldn't write %s", filename);
+    end_write(f, filename);
 }
 
 void ReadGame(const char *filename)
 {
-    gzFile  f;
-    int     i;
+    savebuf_t   *f;
+    int         i;
 
+    G_FreeSaveBuffers();
     gi.FreeTags(TAG_GAME);
 
-    f = gzopen(filename, "rb");
-    if (!f)
-        gi.error("Couldn't open %s", filename);
-
-    gzbuffer(f, 65536);
+    f = begin_read(filename);
 
     i = read_int(f);
     if (i != SAVE_MAGIC1) {
-        gzclose(f);
         check_gzip(i);
         gi.error("Not a Q2PRO save game");
     }
 
     i = read_int(f);
     if (i != SAVE_VERSION) {
-        gzclose(f);
         gi.error("Savegame from different version (got %d, expected %d)", i, SAVE_VERSION);
     }
 
@@ -891,11 +1002,9 @@ void ReadGame(const char *filename)
 
     // should agree with server's version
     if (game.maxclients != (int)maxclients->value) {
-        gzclose(f);
         gi.error("Savegame has bad maxclients");
     }
     if (game.maxentities <= game.maxclients || game.maxentities > game.csr.max_edicts) {
-        gzclose(f);
         gi.error("Savegame has bad maxentities");
     }
 
@@ -907,8 +1016,6 @@ void ReadGame(const char *filename)
     for (i = 0; i < game.maxclients; i++) {
         read_fields(f, clientfields, &game.clients[i]);
     }
-
-    gzclose(f);
 }
 
 //==========================================================
@@ -919,15 +1026,10 @@ WriteLevel
 
 =================
 */
-void WriteLevel(const char *filename)
+static void write_level(savebuf_t *f)
 {
-    int     i;
-    edict_t *ent;
-    gzFile  f;
-
-    f = gzopen(filename, "wb");
-    if (!f)
-        gi.error("Couldn't open %s", filename);
+    int         i;
+    edict_t     *ent;
 
     write_int(f, SAVE_MAGIC2);
     write_int(f, SAVE_VERSION);
@@ -944,9 +1046,14 @@ void WriteLevel(const char *filename)
         write_fields(f, entityfields, ent);
     }
     write_int(f, -1);
+}
 
-    if (gzclose(f))
-        gi.error("Couldn't write %s", filename);
+void WriteLevel(const char *filename)
+{
+    savebuf_t   *f = begin_write();
+
+    write_level(f);
+    end_write(f, filename);
 }
 
 /*
@@ -967,35 +1074,30 @@ No clients are connected yet.
 */
 void ReadLevel(const char *filename)
 {
-    int     entnum;
-    gzFile  f;
-    int     i;
-    edict_t *ent;
+    int         entnum;
+    savebuf_t   *f;
+    int         i;
+    edict_t     *ent;
 
     // free any dynamic memory allocated by loading the level
     // base state
     gi.FreeTags(TAG_LEVEL);
 
-    f = gzopen(filename, "rb");
-    if (!f)
-        gi.error("Couldn't open %s", filename);
-
-    gzbuffer(f, 65536);
+    f = begin_read(filename);
 
     // wipe all the entities
     memset(g_edicts, 0, game.maxentities * sizeof(g_edicts[0]));
+    AI_ClearSightCache();
     globals.num_edicts = game.maxclients + 1;
 
     i = read_int(f);
     if (i != SAVE_MAGIC2) {
-        gzclose(f);
         check_gzip(i);
         gi.error("Not a Q2PRO save game");
     }
 
     i = read_int(f);
     if (i != SAVE_VERSION) {
-        gzclose(f);
         gi.error("Savegame from different version (got %d, expected %d)", i, SAVE_VERSION);
     }
 
@@ -1008,7 +1110,6 @@ void ReadLevel(const char *filename)
         if (entnum == -1)
             break;
         if (entnum < 0 || entnum >= game.maxentities) {
-            gzclose(f);
             gi.error("%s: bad entity number", __func__);
         }
         if (entnum >= globals.num_edicts)
@@ -1024,8 +1125,6 @@ void ReadLevel(const char *filename)
         gi.linkentity(ent);
     }
 
-    gzclose(f);
-
     // mark all clients as unconnected
     for (i = 0; i < game.maxclients; i++) {
         ent = &g_edicts[i + 1];
@@ -1057,4 +1156,59 @@ void ReadLevel(const char *filename)
 
     // refresh global precache indices
     G_RefreshPrecaches();
-}
\ No newline at end of file
+}
+
+// must be called before freeing TAG_GAME
+void G_FreeSaveBuffers(void)
+{
+    if (savebuf.data)
+        gi.TagFree(savebuf.data);
+    memset(&savebuf, 0, sizeof(savebuf));
+    if (sorted_ptrs)
+        gi.TagFree(sorted_ptrs);
+    sorted_ptrs = NULL;
+}
+
+#if USE_TESTS
+// run on a populated level to measure level save cost
+void G_SaveBench(void)
+{
+    int         i, count = 100;
+    savebuf_t   *f = NULL;
+    clock_t     start, end;
+    double      write_ms, comp_ms = 0;
+    size_t      complen = 0;
+
+    if (gi.argc() > 2)
+        count = Q_clip(atoi(gi.argv(2)), 1, 10000);
+
+    start = clock();
+    for (i = 0; i < count; i++) {
+        f = begin_write();
+        write_level(f);
+    }
+    end = clock();
+    write_ms = (end - start) * 1000.0 / CLOCKS_PER_SEC / count;
+
+#if USE_ZLIB
+    byte *buf = gi.TagMalloc(compressBound(f->cursize), TAG_GAME);
+
+    start = clock();
+    for (i = 0; i < count; i++) {
+        uLongf len = compressBound(f->cursize);
+        if (compress2(buf, &len, f->data, f->cursize, Z_DEFAULT_COMPRESSION) != Z_OK) {
+            gi.TagFree(buf);
+            gi.error("%s: compress2 failed", __func__);
+        }
+        complen = len;
+    }
+    end = clock();
+    comp_ms = (end - start) * 1000.0 / CLOCKS_PER_SEC / count;
+    gi.TagFree(buf);
+#endif
+
+    gi.cprintf(NULL, PRINT_HIGH, "%d edicts, %zu bytes (%zu compressed)\n",
+               globals.num_edicts, f->cursize, complen);
+    gi.cprintf(NULL, PRINT_HIGH, "serialize %.3f ms, compress %.3f ms\n", write_ms, comp_ms);
+}
+#endif
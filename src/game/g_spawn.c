@@ -643,6 +643,7 @@ void SpawnEntities(const char *mapname, const char *entities, const char *spawnp
 
     memset(&level, 0, sizeof(level));
     memset(g_edicts, 0, game.maxentities * sizeof(g_edicts[0]));
+    AI_ClearSightCache();
 
     Q_strlcpy(level.mapname, mapname, sizeof(level.mapname));
     Q_strlcpy(game.spawnpoint, spawnpoint, sizeof(game.spawnpoint));
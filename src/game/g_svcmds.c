@@ -293,6 +293,12 @@ void    ServerCommand(void)
         SVCmd_ListIP_f();
     else if (Q_stricmp(cmd, "writeip") == 0)
         SVCmd_WriteIP_f();
+    else if (Q_stricmp(cmd, "sightstats") == 0)
+        AI_SightStats();
+#if USE_TESTS
+    else if (Q_stricmp(cmd, "savebench") == 0)
+        G_SaveBench();
+#endif
     else
         gi.cprintf(NULL, PRINT_HIGH, "Unknown server command \"%s\"\n", cmd);
 }
@@ -232,6 +232,7 @@ extern cvar_t *gl_shaders;
 extern cvar_t *gl_md5_load;
 extern cvar_t *gl_md5_use;
 extern cvar_t *gl_md5_distance;
+extern cvar_t *gl_md5_cache;
 #endif
 extern cvar_t *gl_damageblend_frac;
 extern cvar_t *gl_bloom;
@@ -961,6 +962,10 @@ void R_SetSky(const char *name, float rotate, bool autorotate, const vec3_t axis
  */
 void GL_DrawAliasModel(const model_t *model);
 
+#if USE_TESTS
+void GL_AliasTessTest(const model_t **models, int nummodels, int iterations);
+#endif
+
 /*
  * hq2x.c
  *
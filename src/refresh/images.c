@@ -55,6 +55,46 @@ static bool check_image_size(unsigned w, unsigned h)
     return (w < 1 || h < 1 || w > MAX_TEXTURE_SIZE || h > MAX_TEXTURE_SIZE);
 }
 
+typedef struct {
+    image_t         *image;
+    unsigned        hash;
+    int             req;
+    imageformat_t   orig;   // format requested by name
+    imageformat_t   fmt;    // format of loaded data
+    void            *data;
+    int             len;
+    int             ret;
+    byte            *pic;
+    void            *cache;     // loaded from texture cache
+    bool            cacheable;
+    byte            cachekey[16];
+    char            error[MAXERRORMSG];
+    char            warning[MAXERRORMSG];
+} imagejob_t;
+
+// set while decoding on a worker thread
+static q_thread_local imagejob_t *img_job;
+
+// warnings from worker threads are saved and printed later by main thread
+q_printf(1, 2)
+static void img_warning(const char *fmt, ...)
+{
+    char        buffer[MAXERRORMSG];
+    va_list     argptr;
+
+    va_start(argptr, fmt);
+    Q_vsnprintf(buffer, sizeof(buffer), fmt, argptr);
+    va_end(argptr);
+
+    if (img_job) {
+        if (!img_job->warning[0])
+            Q_strlcpy(img_job->warning, buffer, sizeof(img_job->warning));
+        return;
+    }
+
+    Com_WPrintf("%s", buffer);
+}
+
 /*
 ====================================================================
 
@@ -298,7 +338,7 @@ static int load_pcx(const byte *rawdata, size_t rawlen,
 
         if (is_pal) {
             if (SZ_Remaining(&s) < PCX_PALETTE_SIZE)
-                Com_WPrintf("PCX file %s possibly corrupted\n", image->name);
+                img_warning("PCX file %s possibly corrupted\n", image->name);
 
             if (image->type == IT_SKIN)
                 IMG_FloodFill(pixels, w, h);
@@ -309,7 +349,7 @@ static int load_pcx(const byte *rawdata, size_t rawlen,
 
             IMG_FreePixels(pixels);
         } else {
-            Com_WPrintf("%s is a 24-bit PCX file. This is not portable.\n", image->name);
+            img_warning("%s is a 24-bit PCX file. This is not portable.\n", image->name);
             *pic = pixels;
             image->flags |= IF_OPAQUE;
         }
@@ -750,7 +790,7 @@ static void my_output_message_2(j_common_ptr cinfo, bool err_exit)
     if (err_exit)
         Com_SetLastError(buffer);
     else
-        Com_WPrintf("libjpeg: %s: %s\n", jerr->filename, buffer);
+        img_warning("libjpeg: %s: %s\n", jerr->filename, buffer);
 }
 
 static void my_output_message(j_common_ptr cinfo)
@@ -953,7 +993,7 @@ static void my_png_warning_fn(png_structp png_ptr, png_const_charp warning_msg)
     my_png_error *err = png_get_error_ptr(png_ptr);
 
     if (err->filename)
-        Com_WPrintf("libpng: %s: %s\n", err->filename, warning_msg);
+        img_warning("libpng: %s: %s\n", err->filename, warning_msg);
 }
 
 static int my_png_read_header(png_structp png_ptr, png_infop info_ptr,
@@ -1481,6 +1521,7 @@ static cvar_t   *r_texture_overrides;
 #endif
 
 static cvar_t   *r_glowmaps;
+static cvar_t   *r_parallel_images;
 
 static const cmd_option_t o_imagelist[] = {
     { "8", "pal", "list paletted images" },
@@ -1594,11 +1635,12 @@ static image_t *alloc_image(void)
     int i;
     image_t *image, *placeholder = NULL;
 
-    // find a free image_t slot
+    // find a free image_t slot. images still being loaded by IMG_FindBatch()
+    // are not linked into hash table yet and can't be used as placeholders.
     for (i = R_NUM_AUTO_IMG, image = r_images + i; i < r_numImages; i++, image++) {
         if (!image->name[0])
             return image;
-        if (!image->upload_width && !image->upload_height && !placeholder)
+        if (!image->upload_width && !image->upload_height && image->entry.next && !placeholder)
             placeholder = image;
     }
 
@@ -1610,6 +1652,7 @@ static image_t *alloc_image(void)
 
     // reuse placeholder image if available
     if (placeholder) {
+        Q_assert(placeholder->entry.next && placeholder->entry.prev);
         List_Remove(&placeholder->entry);
         memset(placeholder, 0, sizeof(*placeholder));
         return placeholder;
@@ -1638,6 +1681,9 @@ static image_t *lookup_image(const char *name,
     return NULL;
 }
 
+// if set, files are only loaded, and decoded later by IMG_FindBatch
+static imagejob_t   *img_defer;
+
 static int try_image_format(imageformat_t fmt, image_t *image, byte **pic)
 {
     void    *data;
@@ -1648,6 +1694,13 @@ static int try_image_format(imageformat_t fmt, image_t *image, byte **pic)
     if (!data)
         return ret;
 
+    if (img_defer) {
+        img_defer->fmt = fmt;
+        img_defer->data = data;
+        img_defer->len = ret;
+        return fmt;
+    }
+
     // decompress the image
     ret = img_loaders[fmt].load(data, ret, image, pic);
 
@@ -1818,7 +1871,7 @@ static void print_error(const char *name, imageflags_t flags, int err)
     Com_LPrintf(level, "Couldn't load %s: %s\n", Com_MakePrintable(name), msg);
 }
 
-static int load_image_data(image_t *image, imageformat_t fmt, bool need_dimensions, byte **pic)
+static int load_image_data(image_t *image, imageformat_t fmt, byte **pic)
 {
     int ret;
 
@@ -1841,11 +1894,6 @@ static int load_image_data(image_t *image, imageformat_t fmt, bool need_dimensio
             ret = try_other_formats(fmt, image, pic);
         }
     }
-
-    // if we are replacing 8-bit texture with a higher resolution 32-bit
-    // texture, we need to recover original image dimensions
-    if (need_dimensions && fmt <= IM_WAL && ret > IM_WAL)
-        get_image_dimensions(fmt, image);
 #else
     if (fmt == IM_MAX)
         ret = Q_ERR_INVALID_PATH;
@@ -1885,7 +1933,7 @@ static void check_for_glow_map(image_t *image)
     // load the pic from disk
     glow_pic = NULL;
 
-    ret = load_image_data(&temporary, IM_PCX, false, &glow_pic);
+    ret = load_image_data(&temporary, IM_PCX, &glow_pic);
     if (ret < 0) {
         print_error(temporary.name, -1, ret);
         return;
@@ -1918,42 +1966,52 @@ static void load_special_image(image_t *image, byte **pic) {
     p[0] = p[1] = p[2] = p[3] = 0xFF;
 }
 
-// finds or loads the given image, adding it to the hash table.
-static image_t *find_or_load_image(const char *name, size_t len,
-                                   imagetype_t type, imageflags_t flags)
+static imageformat_t image_format(const image_t *image)
+{
+    imageformat_t fmt;
+
+    // find out original extension
+    for (fmt = 0; fmt < IM_MAX; fmt++)
+        if (!Q_stricmp(image->name + image->baselen + 1, img_loaders[fmt].ext))
+            break;
+
+    return fmt;
+}
+
+// finds the given image, or allocates a new slot for it.
+// returns 1 if found (image may be NULL if it failed to load before),
+// 0 if new slot needs to be loaded, or error code.
+static int prepare_image(const char *name, size_t len, imagetype_t type,
+                         imageflags_t flags, image_t **image_p, unsigned *hash_p)
 {
     image_t         *image;
-    byte            *pic;
     unsigned        hash;
-    imageformat_t   fmt;
-    int             ret;
 
     Q_assert(len < MAX_QPATH);
 
+    *image_p = NULL;
+
     // must have an extension and at least 1 char of base name
-    if (len <= 4 || name[len - 4] != '.') {
-        ret = Q_ERR_INVALID_PATH;
-        goto fail;
-    }
+    if (len <= 4 || name[len - 4] != '.')
+        return Q_ERR_INVALID_PATH;
 
     hash = FS_HashPathLen(name, len - 4, RIMAGES_HASH);
+    *hash_p = hash;
 
     // look for it
     if ((image = lookup_image(name, type, hash, len - 4)) != NULL) {
         image->registration_sequence = r_registration_sequence;
         if (image->upload_width && image->upload_height) {
             image->flags |= flags & IF_PERMANENT;
-            return image;
+            *image_p = image;
         }
-        return NULL;
+        return 1;
     }
 
     // allocate image slot
     image = alloc_image();
-    if (!image) {
-        ret = Q_ERR_OUT_OF_SLOTS;
-        goto fail;
-    }
+    if (!image)
+        return Q_ERR_OUT_OF_SLOTS;
 
     // fill in some basic info
     memcpy(image->name, name, len + 1);
@@ -1962,51 +2020,63 @@ static image_t *find_or_load_image(const char *name, size_t len,
     image->flags = flags;
     image->registration_sequence = r_registration_sequence;
 
-    if (!(flags & IF_SPECIAL)) {
-        // find out original extension
-        for (fmt = 0; fmt < IM_MAX; fmt++)
-            if (!Q_stricmp(image->name + image->baselen + 1, img_loaders[fmt].ext))
-                break;
+    *image_p = image;
+    return 0;
+}
 
-        // load the pic from disk
-        pic = NULL;
+// adds loaded image to the hash table and uploads it
+static image_t *finish_image(imagejob_t *job, imageflags_t flags)
+{
+    image_t *image = job->image;
+    imagetype_t type = image->type;
 
-        if (flags & IF_KEEP_EXTENSION) {
-            // direct load requested (for testing code)
-            if (fmt == IM_MAX)
-                ret = Q_ERR_INVALID_PATH;
-            else
-                ret = try_image_format(fmt, image, &pic);
-        } else {
-            ret = load_image_data(image, fmt, true, &pic);
-        }
+    FS_FreeFile(job->data);
 
-        if (ret < 0) {
-            print_error(image->name, flags, ret);
-            if (flags & IF_PERMANENT) {
-                memset(image, 0, sizeof(*image));
-            } else {
-                // don't reload temp pics every frame
-                image->upload_width = image->upload_height = 0;
-                List_Append(&r_imageHash[hash], &image->entry);
-            }
-            return NULL;
+    if (job->warning[0])
+        Com_WPrintf("%s", job->warning);
+
+    if (job->ret < 0) {
+        if (job->error[0])
+            Com_SetLastError(job->error);
+        print_error(image->name, flags, job->ret);
+        if (flags & IF_PERMANENT) {
+            memset(image, 0, sizeof(*image));
+        } else {
+            // don't reload temp pics every frame
+            image->upload_width = image->upload_height = 0;
+            List_Append(&r_imageHash[job->hash], &image->entry);
         }
+        return NULL;
+    }
 
+    if (job->cache) {
+        // upload the image
+        IMG_LoadCached(image, job->cache);
+        FS_FreeFile(job->cache);
+    } else if (!(flags & IF_SPECIAL)) {
         image->aspect = (float)image->upload_width / image->upload_height;
-    } else {
-        load_special_image(image, &pic);
     }
 
-    List_Append(&r_imageHash[hash], &image->entry);
-    
+#if USE_PNG || USE_JPG || USE_TGA
+    // if we are replacing 8-bit texture with a higher resolution 32-bit
+    // texture, we need to recover original image dimensions
+    if (job->orig <= IM_WAL && job->ret > IM_WAL)
+        get_image_dimensions(job->orig, image);
+#endif
+
+    List_Append(&r_imageHash[job->hash], &image->entry);
+
     if (!(flags & IF_SPECIAL)) {
         // check for glow maps
         if (r_glowmaps->integer && (type == IT_SKIN || type == IT_WALL))
             check_for_glow_map(image);
     }
 
-    if (type == IT_SKY && flags & IF_CLASSIC_SKY) {
+    if (job->cache) {
+        // already uploaded
+    } else if (type == IT_SKY && flags & IF_CLASSIC_SKY) {
+        byte *pic = job->pic;
+
         // upload the top half of the image (solid)
         image->height /= 2;
         image->upload_height /= 2;
@@ -2025,33 +2095,99 @@ static image_t *find_or_load_image(const char *name, size_t len,
 
         IMG_Load(&temporary, pic);
         image->texnum2 = temporary.texnum;
+    } else if (job->cacheable) {
+        // upload the image and save it in cache
+        IMG_LoadAndCache(image, job->pic, job->cachekey);
     } else {
         // upload the image
-        IMG_Load(image, pic);
+        IMG_Load(image, job->pic);
     }
 
     // don't need pics in memory after GL upload
-    Z_Free(pic);
+    Z_Free(job->pic);
 
     return image;
+}
 
-fail:
-    print_error(name, flags, ret);
-    return NULL;
+// loads the file from disk, or from texture cache. decoding is done later by
+// decode_image(), which may run on worker thread.
+static void load_image(imagejob_t *job)
+{
+    image_t *image = job->image;
+
+    img_defer = job;
+    if (image->flags & IF_KEEP_EXTENSION) {
+        // direct load requested (for testing code)
+        if (job->orig == IM_MAX)
+            job->ret = Q_ERR_INVALID_PATH;
+        else
+            job->ret = try_image_format(job->orig, image, NULL);
+    } else {
+        job->ret = load_image_data(image, job->orig, NULL);
+    }
+    img_defer = NULL;
+
+    if (job->ret < 0)
+        return;
+
+    job->cacheable = IMG_CacheKey(image, job->data, job->len, job->cachekey);
+    if (job->cacheable && (job->cache = IMG_ReadCache(job->cachekey))) {
+        FS_FreeFile(job->data);
+        job->data = NULL;
+    }
 }
 
-image_t *IMG_Find(const char *name, imagetype_t type, imageflags_t flags)
+static void decode_image(void *arg, int index)
 {
-    char buffer[MAX_QPATH];
-    image_t *image;
-    size_t len;
+    imagejob_t *job = (imagejob_t *)arg + index;
 
-    Q_assert(name);
+    if (!job->data)
+        return;
 
-    // path MUST never overflow
-    len = FS_NormalizePathBuffer(buffer, name, sizeof(buffer));
-    image = find_or_load_image(buffer, len, type, flags);
+    img_job = job;
+    job->ret = img_loaders[job->fmt].load(job->data, job->len, job->image, &job->pic);
+    if (job->ret < 0)
+        Q_strlcpy(job->error, Com_GetLastError(), sizeof(job->error));
+    else
+        job->ret = job->fmt;
+    img_job = NULL;
+}
+
+// finds or loads the given image, adding it to the hash table.
+static image_t *find_or_load_image(const char *name, size_t len,
+                                   imagetype_t type, imageflags_t flags)
+{
+    imagejob_t      job;
+    image_t         *image;
+    unsigned        hash;
+    int             ret;
+
+    ret = prepare_image(name, len, type, flags, &image, &hash);
+    if (ret < 0) {
+        print_error(name, flags, ret);
+        return NULL;
+    }
+    if (ret > 0)
+        return image;
 
+    memset(&job, 0, sizeof(job));
+    job.image = image;
+    job.hash = hash;
+
+    if (flags & IF_SPECIAL) {
+        job.orig = IM_MAX;
+        load_special_image(image, &job.pic);
+    } else {
+        job.orig = image_format(image);
+        load_image(&job);
+        decode_image(&job, 0);
+    }
+
+    return finish_image(&job, flags);
+}
+
+static image_t *image_or_default(image_t *image, imagetype_t type, imageflags_t flags)
+{
     // missing (or invalid) sky texture will use default sky
     if (type == IT_SKY) {
         if (!image)
@@ -2065,6 +2201,139 @@ image_t *IMG_Find(const char *name, imagetype_t type, imageflags_t flags)
     return image;
 }
 
+image_t *IMG_Find(const char *name, imagetype_t type, imageflags_t flags)
+{
+    char buffer[MAX_QPATH];
+    image_t *image;
+    size_t len;
+
+    Q_assert(name);
+
+    // path MUST never overflow
+    len = FS_NormalizePathBuffer(buffer, name, sizeof(buffer));
+    image = find_or_load_image(buffer, len, type, flags);
+
+    return image_or_default(image, type, flags);
+}
+
+/*
+=================================================================
+
+PARALLEL IMAGE LOADING
+
+Files are loaded by the main thread (filesystem is not thread safe), then
+decoded by the worker pool, then uploaded in original order by the main
+thread. Work is split into small batches to bound memory usage.
+
+=================================================================
+*/
+
+#define MAX_IMAGE_JOBS  32
+
+static bool is_pending_image(const imagejob_t *jobs, int numjobs,
+                             const char *name, size_t len, imagetype_t type)
+{
+    for (int i = 0; i < numjobs; i++) {
+        const image_t *image = jobs[i].image;
+        if (image->type == type && image->baselen + 4 == len &&
+            !FS_pathcmpn(image->name, name, len - 4))
+            return true;
+    }
+    return false;
+}
+
+static void finish_image_jobs(imagejob_t *jobs, int numjobs,
+                              imagereq_t *reqs, const int *pending, int numpending)
+{
+    int i;
+
+    Com_ParallelWork(decode_image, jobs, numjobs);
+
+    for (i = 0; i < numjobs; i++) {
+        imagejob_t *job = &jobs[i];
+        imagereq_t *req = &reqs[job->req];
+        image_t *image = finish_image(job, req->flags);
+
+        req->image = image_or_default(image, req->type, req->flags);
+    }
+
+    // duplicates of pending images are now in the hash table
+    for (i = 0; i < numpending; i++) {
+        imagereq_t *req = &reqs[pending[i]];
+        req->image = IMG_Find(req->name, req->type, req->flags);
+    }
+}
+
+/*
+===============
+IMG_FindBatch
+
+Same as calling IMG_Find() for each request, but decodes images in parallel.
+===============
+*/
+void IMG_FindBatch(imagereq_t *reqs, int count)
+{
+    imagejob_t  *jobs;
+    int         pending[MAX_IMAGE_JOBS];
+    int         i, ret, numjobs, numpending, maxjobs;
+    char        buffer[MAX_QPATH];
+    unsigned    hash;
+    image_t     *image;
+    size_t      len;
+
+    maxjobs = r_parallel_images->integer ? (Com_ParallelWorkers() + 1) * 2 : 0;
+    if (maxjobs <= 2) {
+        for (i = 0; i < count; i++)
+            reqs[i].image = IMG_Find(reqs[i].name, reqs[i].type, reqs[i].flags);
+        return;
+    }
+
+    maxjobs = min(maxjobs, MAX_IMAGE_JOBS);
+    jobs = Z_Malloc(sizeof(jobs[0]) * maxjobs);
+    numjobs = numpending = 0;
+
+    for (i = 0; i < count; i++) {
+        imagereq_t *req = &reqs[i];
+        imagejob_t *job = &jobs[numjobs];
+
+        len = FS_NormalizePathBuffer(buffer, req->name, sizeof(buffer));
+
+        // same image may be requested multiple times
+        if (is_pending_image(jobs, numjobs, buffer, len, req->type)) {
+            pending[numpending++] = i;
+        } else if (req->flags & (IF_SPECIAL | IF_KEEP_EXTENSION)) {
+            req->image = IMG_Find(req->name, req->type, req->flags);
+        } else {
+            ret = prepare_image(buffer, len, req->type, req->flags, &image, &hash);
+            if (ret) {
+                if (ret < 0)
+                    print_error(buffer, req->flags, ret);
+                req->image = image_or_default(image, req->type, req->flags);
+                continue;
+            }
+
+            // load the file, but don't decode yet
+            memset(job, 0, sizeof(*job));
+            job->image = image;
+            job->hash = hash;
+            job->req = i;
+            job->orig = image_format(image);
+            load_image(job);
+
+            numjobs++;
+        }
+
+        if (numjobs == maxjobs || numpending == MAX_IMAGE_JOBS) {
+            finish_image_jobs(jobs, numjobs, reqs, pending, numpending);
+            numjobs = numpending = 0;
+        }
+    }
+
+    finish_image_jobs(jobs, numjobs, reqs, pending, numpending);
+
+    Z_Free(jobs);
+}
+
 /*
 ===============
 IMG_ForHandle
@@ -2278,6 +2547,7 @@ void IMG_Init(void)
 #endif // USE_PNG || USE_JPG || USE_TGA
 
     r_glowmaps = Cvar_Get("r_glowmaps", "1", CVAR_FILES);
+    r_parallel_images = Cvar_Get("r_parallel_images", "1", 0);
 
     Cmd_Register(img_cmd);
 
@@ -83,7 +83,15 @@ extern unsigned r_registration_sequence;
 
 extern uint32_t d_8to24table[256];
 
+typedef struct {
+    char            name[MAX_QPATH];
+    imagetype_t     type;
+    imageflags_t    flags;
+    image_t         *image;
+} imagereq_t;
+
 image_t *IMG_Find(const char *name, imagetype_t type, imageflags_t flags);
+void IMG_FindBatch(imagereq_t *reqs, int count);
 void IMG_FreeUnused(void);
 void IMG_FreeAll(void);
 void IMG_Init(void);
@@ -95,6 +103,11 @@ image_t *IMG_ForHandle(qhandle_t h);
 void IMG_Unload(image_t *image);
 void IMG_Load(image_t *image, byte *pic);
 
+bool IMG_CacheKey(const image_t *image, const void *data, size_t len, byte *key);
+void *IMG_ReadCache(const byte *key);
+void IMG_LoadCached(image_t *image, const void *cache);
+void IMG_LoadAndCache(image_t *image, byte *pic, const byte *key);
+
 typedef struct screenshot_s screenshot_t;
 
 typedef int (*save_cb_t)(const screenshot_t *);
@@ -17,6 +17,11 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 */
 
 #include "gl.h"
+#include "system/system.h"
+
+#if HAVE_SSE2
+#include <emmintrin.h>
+#endif
 
 typedef enum {
     SHADOW_NO,
@@ -270,6 +275,263 @@ static void tess_lerped_plain(const maliasmesh_t *mesh)
     }
 }
 
+#if HAVE_SSE2
+
+// SSE2 versions process groups of 4 vertices. normals are decoded into SoA
+// form, positions are transformed one vertex per register. partial group at
+// the end repeats the last vertex and skips stores of unused lanes.
+
+#define LOAD_VEC3(v)    _mm_setr_ps((v)[0], (v)[1], (v)[2], 0)
+#define SPLAT(v, i)     _mm_shuffle_ps(v, v, _MM_SHUFFLE(i, i, i, i))
+
+static inline __m128 load_pos_sse2(const maliasvert_t *vert)
+{
+    __m128i p = _mm_loadl_epi64((const __m128i *)vert);
+
+    // sign extend to 32 bits, 4th lane holds normal bytes
+    p = _mm_srai_epi32(_mm_unpacklo_epi16(p, p), 16);
+    return _mm_cvtepi32_ps(p);
+}
+
+static inline __m128 lerp_pos_sse2(const maliasvert_t *oldvert, const maliasvert_t *newvert,
+                                   __m128 os, __m128 ns, __m128 tr)
+{
+    __m128 o = _mm_mul_ps(load_pos_sse2(oldvert), os);
+    __m128 n = _mm_mul_ps(load_pos_sse2(newvert), ns);
+
+    return _mm_add_ps(_mm_add_ps(o, n), tr);
+}
+
+static inline void get_static_normals_sse2(__m128 normal[3], const maliasvert_t *vert, int n)
+{
+    const uint8_t *n0 = vert[0].norm;
+    const uint8_t *n1 = vert[min(1, n - 1)].norm;
+    const uint8_t *n2 = vert[min(2, n - 1)].norm;
+    const uint8_t *n3 = vert[min(3, n - 1)].norm;
+
+    __m128 sinlat = _mm_setr_ps(TAB_SIN(n0[0]), TAB_SIN(n1[0]), TAB_SIN(n2[0]), TAB_SIN(n3[0]));
+    __m128 coslat = _mm_setr_ps(TAB_COS(n0[0]), TAB_COS(n1[0]), TAB_COS(n2[0]), TAB_COS(n3[0]));
+    __m128 sinlng = _mm_setr_ps(TAB_SIN(n0[1]), TAB_SIN(n1[1]), TAB_SIN(n2[1]), TAB_SIN(n3[1]));
+    __m128 coslng = _mm_setr_ps(TAB_COS(n0[1]), TAB_COS(n1[1]), TAB_COS(n2[1]), TAB_COS(n3[1]));
+
+    normal[0] = _mm_mul_ps(sinlat, coslng);
+    normal[1] = _mm_mul_ps(sinlat, sinlng);
+    normal[2] = coslat;
+}
+
+static inline void get_lerped_normals_sse2(__m128 normal[3],
+                                           const maliasvert_t *oldvert,
+                                           const maliasvert_t *newvert, int n)
+{
+    __m128 oldnorm[3], newnorm[3], len;
+    __m128 back = _mm_set1_ps(backlerp);
+    __m128 front = _mm_set1_ps(frontlerp);
+
+    get_static_normals_sse2(oldnorm, oldvert, n);
+    get_static_normals_sse2(newnorm, newvert, n);
+
+    for (int i = 0; i < 3; i++)
+        normal[i] = _mm_add_ps(_mm_mul_ps(oldnorm[i], back), _mm_mul_ps(newnorm[i], front));
+
+    // normalize result
+    len = _mm_add_ps(_mm_add_ps(_mm_mul_ps(normal[0], normal[0]),
+                                _mm_mul_ps(normal[1], normal[1])),
+                     _mm_mul_ps(normal[2], normal[2]));
+    len = _mm_div_ps(_mm_set1_ps(1.0f), _mm_sqrt_ps(len));
+
+    for (int i = 0; i < 3; i++)
+        normal[i] = _mm_mul_ps(normal[i], len);
+}
+
+static inline __m128 shadedot_sse2(const __m128 normal[3])
+{
+    __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(normal[0], _mm_set1_ps(shadedir[0])),
+                                     _mm_mul_ps(normal[1], _mm_set1_ps(shadedir[1]))),
+                          _mm_mul_ps(normal[2], _mm_set1_ps(shadedir[2])));
+
+    // matches the anormtab.h precalculations
+    __m128 neg = _mm_cmplt_ps(d, _mm_setzero_ps());
+    d = _mm_or_ps(_mm_andnot_ps(neg, d), _mm_and_ps(neg, _mm_mul_ps(d, _mm_set1_ps(0.3f))));
+
+    return _mm_add_ps(d, _mm_set1_ps(1.0f));
+}
+
+// stores 4 vectors (one per vertex) at given offset
+static inline void store_group_sse2(vec_t *dst_vert, int stride, int n,
+                                    __m128 v0, __m128 v1, __m128 v2, __m128 v3)
+{
+    _mm_storeu_ps(dst_vert, v0);
+    if (n > 1)
+        _mm_storeu_ps(dst_vert + stride, v1);
+    if (n > 2)
+        _mm_storeu_ps(dst_vert + stride * 2, v2);
+    if (n > 3)
+        _mm_storeu_ps(dst_vert + stride * 3, v3);
+}
+
+static inline void store_normals_sse2(vec_t *dst_vert, const __m128 normal[3], int n)
+{
+    __m128 n0 = normal[0], n1 = normal[1], n2 = normal[2], n3 = _mm_setzero_ps();
+
+    _MM_TRANSPOSE4_PS(n0, n1, n2, n3);
+    store_group_sse2(dst_vert + 4, 8, n, n0, n1, n2, n3);
+}
+
+static inline void store_colors_sse2(vec_t *dst_vert, __m128 d, int n)
+{
+    __m128 rgb = LOAD_VEC3(color);
+    __m128 alpha = _mm_setr_ps(0, 0, 0, color[3]);
+
+    store_group_sse2(dst_vert + 4, VERTEX_SIZE, n,
+                     _mm_add_ps(_mm_mul_ps(rgb, SPLAT(d, 0)), alpha),
+                     _mm_add_ps(_mm_mul_ps(rgb, SPLAT(d, 1)), alpha),
+                     _mm_add_ps(_mm_mul_ps(rgb, SPLAT(d, 2)), alpha),
+                     _mm_add_ps(_mm_mul_ps(rgb, SPLAT(d, 3)), alpha));
+}
+
+static inline void static_shade_group(const maliasvert_t *src_vert, vec_t *dst_vert, int n)
+{
+    __m128 ns = LOAD_VEC3(newscale);
+    __m128 tr = LOAD_VEC3(translate);
+    __m128 normal[3];
+
+    get_static_normals_sse2(normal, src_vert, n);
+    store_colors_sse2(dst_vert, shadedot_sse2(normal), n);
+
+    for (int i = 0; i < n; i++, dst_vert += VERTEX_SIZE)
+        _mm_storeu_ps(dst_vert, _mm_add_ps(_mm_mul_ps(load_pos_sse2(&src_vert[i]), ns), tr));
+}
+
+static void tess_static_shade_sse2(const maliasmesh_t *mesh)
+{
+    const maliasvert_t *src_vert = &mesh->verts[newframenum * mesh->numverts];
+    vec_t *dst_vert = tess.vertices;
+    int count = mesh->numverts;
+
+    for (; count >= 4; count -= 4, src_vert += 4, dst_vert += VERTEX_SIZE * 4)
+        static_shade_group(src_vert, dst_vert, 4);
+    if (count)
+        static_shade_group(src_vert, dst_vert, count);
+}
+
+static inline void lerped_shell_group(const maliasvert_t *src_oldvert,
+                                      const maliasvert_t *src_newvert,
+                                      vec_t *dst_vert, int n)
+{
+    __m128 os = LOAD_VEC3(oldscale);
+    __m128 ns = LOAD_VEC3(newscale);
+    __m128 tr = LOAD_VEC3(translate);
+    __m128 scale = _mm_set1_ps(shellscale);
+    __m128 normal[3], n0, n1, n2, n3;
+
+    get_lerped_normals_sse2(normal, src_oldvert, src_newvert, n);
+
+    n0 = normal[0];
+    n1 = normal[1];
+    n2 = normal[2];
+    n3 = _mm_setzero_ps();
+    _MM_TRANSPOSE4_PS(n0, n1, n2, n3);
+    store_group_sse2(dst_vert + 4, 8, n, n0, n1, n2, n3);
+
+    store_group_sse2(dst_vert, 8, n,
+        _mm_add_ps(_mm_mul_ps(n0, scale), lerp_pos_sse2(&src_oldvert[0], &src_newvert[0], os, ns, tr)),
+        _mm_add_ps(_mm_mul_ps(n1, scale), lerp_pos_sse2(&src_oldvert[min(1, n - 1)], &src_newvert[min(1, n - 1)], os, ns, tr)),
+        _mm_add_ps(_mm_mul_ps(n2, scale), lerp_pos_sse2(&src_oldvert[min(2, n - 1)], &src_newvert[min(2, n - 1)], os, ns, tr)),
+        _mm_add_ps(_mm_mul_ps(n3, scale), lerp_pos_sse2(&src_oldvert[min(3, n - 1)], &src_newvert[min(3, n - 1)], os, ns, tr)));
+}
+
+static void tess_lerped_shell_sse2(const maliasmesh_t *mesh)
+{
+    const maliasvert_t *src_oldvert = &mesh->verts[oldframenum * mesh->numverts];
+    const maliasvert_t *src_newvert = &mesh->verts[newframenum * mesh->numverts];
+    vec_t *dst_vert = tess.vertices;
+    int count = mesh->numverts;
+
+    for (; count >= 4; count -= 4, src_oldvert += 4, src_newvert += 4, dst_vert += 8 * 4)
+        lerped_shell_group(src_oldvert, src_newvert, dst_vert, 4);
+    if (count)
+        lerped_shell_group(src_oldvert, src_newvert, dst_vert, count);
+}
+
+static inline void lerped_shade_group(const maliasvert_t *src_oldvert,
+                                      const maliasvert_t *src_newvert,
+                                      vec_t *dst_vert, int n)
+{
+    __m128 os = LOAD_VEC3(oldscale);
+    __m128 ns = LOAD_VEC3(newscale);
+    __m128 tr = LOAD_VEC3(translate);
+    __m128 normal[3], oldd, newd;
+
+    get_static_normals_sse2(normal, src_oldvert, n);
+    oldd = shadedot_sse2(normal);
+    get_static_normals_sse2(normal, src_newvert, n);
+    newd = shadedot_sse2(normal);
+    store_colors_sse2(dst_vert, _mm_add_ps(_mm_mul_ps(oldd, _mm_set1_ps(backlerp)),
+                                           _mm_mul_ps(newd, _mm_set1_ps(frontlerp))), n);
+
+    for (int i = 0; i < n; i++, dst_vert += VERTEX_SIZE)
+        _mm_storeu_ps(dst_vert, lerp_pos_sse2(&src_oldvert[i], &src_newvert[i], os, ns, tr));
+}
+
+static void tess_lerped_shade_sse2(const maliasmesh_t *mesh)
+{
+    const maliasvert_t *src_oldvert = &mesh->verts[oldframenum * mesh->numverts];
+    const maliasvert_t *src_newvert = &mesh->verts[newframenum * mesh->numverts];
+    vec_t *dst_vert = tess.vertices;
+    int count = mesh->numverts;
+
+    for (; count >= 4; count -= 4, src_oldvert += 4, src_newvert += 4, dst_vert += VERTEX_SIZE * 4)
+        lerped_shade_group(src_oldvert, src_newvert, dst_vert, 4);
+    if (count)
+        lerped_shade_group(src_oldvert, src_newvert, dst_vert, count);
+}
+
+static inline void lerped_plain_group(const maliasvert_t *src_oldvert,
+                                      const maliasvert_t *src_newvert,
+                                      vec_t *dst_vert, int n)
+{
+    __m128 os = LOAD_VEC3(oldscale);
+    __m128 ns = LOAD_VEC3(newscale);
+    __m128 tr = LOAD_VEC3(translate);
+    __m128 normal[3];
+
+    get_lerped_normals_sse2(normal, src_oldvert, src_newvert, n);
+    store_normals_sse2(dst_vert, normal, n);
+
+    for (int i = 0; i < n; i++, dst_vert += 8)
+        _mm_storeu_ps(dst_vert, lerp_pos_sse2(&src_oldvert[i], &src_newvert[i], os, ns, tr));
+}
+
+static void tess_lerped_plain_sse2(const maliasmesh_t *mesh)
+{
+    const maliasvert_t *src_oldvert = &mesh->verts[oldframenum * mesh->numverts];
+    const maliasvert_t *src_newvert = &mesh->verts[newframenum * mesh->numverts];
+    vec_t *dst_vert = tess.vertices;
+    int count = mesh->numverts;
+
+    for (; count >= 4; count -= 4, src_oldvert += 4, src_newvert += 4, dst_vert += 8 * 4)
+        lerped_plain_group(src_oldvert, src_newvert, dst_vert, 4);
+    if (count)
+        lerped_plain_group(src_oldvert, src_newvert, dst_vert, count);
+}
+
+#undef LOAD_VEC3
+#undef SPLAT
+
+#define tess_static_shade_best  tess_static_shade_sse2
+#define tess_lerped_shell_best  tess_lerped_shell_sse2
+#define tess_lerped_shade_best  tess_lerped_shade_sse2
+#define tess_lerped_plain_best  tess_lerped_plain_sse2
+
+#else
+
+#define tess_static_shade_best  tess_static_shade
+#define tess_lerped_shell_best  tess_lerped_shell
+#define tess_lerped_shade_best  tess_lerped_shade
+#define tess_lerped_plain_best  tess_lerped_plain
+
+#endif // !HAVE_SSE2
+
 static glCullResult_t cull_static_model(const model_t *model)
 {
     const maliasframe_t *newframe = &model->frames[newframenum];
@@ -358,6 +620,127 @@ static void setup_frame_scale(const model_t *model)
     }
 }
 
+#if USE_TESTS
+
+typedef struct {
+    const char  *name;
+    void        (*generic)(const maliasmesh_t *);
+    void        (*best)(const maliasmesh_t *);
+    int         stride;
+    bool        lerped;
+} tesstest_t;
+
+static const tesstest_t tesstests[] = {
+    { "static_shade", tess_static_shade, tess_static_shade_best, VERTEX_SIZE, false },
+    { "lerped_shell", tess_lerped_shell, tess_lerped_shell_best, 8, true },
+    { "lerped_shade", tess_lerped_shade, tess_lerped_shade_best, VERTEX_SIZE, true },
+    { "lerped_plain", tess_lerped_plain, tess_lerped_plain_best, 8, true },
+};
+
+// sets up random frames, backlerp and lighting direction for given model
+static void setup_random_frame(const model_t *model, bool lerped)
+{
+    float yaw = Q_rand_uniform(360);
+
+    newframenum = Q_rand_uniform(model->numframes);
+    oldframenum = lerped ? Q_rand_uniform(model->numframes) : newframenum;
+    backlerp = lerped ? Q_rand_uniform(1000) / 1000.0f : 0;
+    frontlerp = 1.0f - backlerp;
+
+    setup_frame_scale(model);
+
+    shadedir[0] = cosf(-M_PIf / 4) * cosf(DEG2RAD(yaw));
+    shadedir[1] = cosf(-M_PIf / 4) * sinf(DEG2RAD(yaw));
+    shadedir[2] = -sinf(-M_PIf / 4);
+}
+
+static unsigned run_tess_test(const model_t **models, int nummodels, int iterations,
+                              const tesstest_t *test, bool best)
+{
+    unsigned start = Sys_Milliseconds();
+
+    Q_srand(iterations);
+    for (int i = 0; i < iterations; i++) {
+        for (int j = 0; j < nummodels; j++) {
+            const model_t *model = models[j];
+
+            setup_random_frame(model, test->lerped);
+            for (int k = 0; k < model->nummeshes; k++)
+                (best ? test->best : test->generic)(&model->meshes[k]);
+        }
+    }
+
+    return Sys_Milliseconds() - start;
+}
+
+// compares output of both versions on a single random frame of each mesh
+static float check_tess_test(const model_t **models, int nummodels, const tesstest_t *test)
+{
+    float *buffer = FS_AllocTempMem(sizeof(tess.vertices));
+    float maxerr = 0;
+
+    for (int i = 0; i < nummodels; i++) {
+        const model_t *model = models[i];
+
+        for (int j = 0; j < model->nummeshes; j++) {
+            const maliasmesh_t *mesh = &model->meshes[j];
+            int size = mesh->numverts * test->stride;
+
+            Q_srand(i * 256 + j);
+            setup_random_frame(model, test->lerped);
+            test->generic(mesh);
+            memcpy(buffer, tess.vertices, size * sizeof(float));
+
+            Q_srand(i * 256 + j);
+            setup_random_frame(model, test->lerped);
+            test->best(mesh);
+
+            for (int k = 0; k < size; k++) {
+                // 4th component of position and normal is unused
+                if ((k % test->stride) == 3 || (test->stride == 8 && (k % 8) == 7))
+                    continue;
+                maxerr = max(maxerr, fabsf(buffer[k] - tess.vertices[k]));
+            }
+        }
+    }
+
+    FS_FreeTempMem(buffer);
+    return maxerr;
+}
+
+/*
+=============
+GL_AliasTessTest
+
+Benchmarks CPU tessellation of given alias models.
+=============
+*/
+void GL_AliasTessTest(const model_t **models, int nummodels, int iterations)
+{
+    int numverts = 0;
+
+    for (int i = 0; i < nummodels; i++)
+        for (int j = 0; j < models[i]->nummeshes; j++)
+            numverts += models[i]->meshes[j].numverts;
+
+    Com_Printf("%d models, %d vertices, %d iterations\n", nummodels, numverts, iterations);
+
+    color[0] = color[1] = color[2] = color[3] = 1.0f;
+    shellscale = POWERSUIT_SCALE;
+
+    for (int i = 0; i < q_countof(tesstests); i++) {
+        const tesstest_t *test = &tesstests[i];
+        unsigned generic_ms = run_tess_test(models, nummodels, iterations, test, false);
+        unsigned best_ms = run_tess_test(models, nummodels, iterations, test, true);
+        float maxerr = check_tess_test(models, nummodels, test);
+
+        Com_Printf("%s: %u msec generic, %u msec %s, max error %g\n", test->name,
+                   generic_ms, best_ms, HAVE_SSE2 ? "sse2" : "generic", maxerr);
+    }
+}
+
+#endif // USE_TESTS
+
 static void setup_color(void)
 {
     int flags = glr.ent->flags;
@@ -1024,13 +1407,13 @@ void GL_DrawAliasModel(const model_t *model)
         // select proper tessfunc
         if (ent->flags & RF_SHELL_MASK) {
             tessfunc = newframenum == oldframenum ?
-                tess_static_shell : tess_lerped_shell;
+                tess_static_shell : tess_lerped_shell_best;
         } else if (dotshading) {
             tessfunc = newframenum == oldframenum ?
-                tess_static_shade : tess_lerped_shade;
+                tess_static_shade_best : tess_lerped_shade_best;
         } else {
             tessfunc = newframenum == oldframenum ?
-                tess_static_plain : tess_lerped_plain;
+                tess_static_plain : tess_lerped_plain_best;
         }
     }
 
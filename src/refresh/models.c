@@ -18,6 +18,8 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 */
 
 #include "gl.h"
+#include "common/mdfour.h"
+#include "common/sizebuf.h"
 #include "format/md2.h"
 #if USE_MD3
 #include "format/md3.h"
@@ -1314,6 +1316,217 @@ static bool MD5_ParseAnim(model_t *model, const char *s, const char *path)
     return true;
 }
 
+/*
+ * Parsed MD5 models are saved in binary form, keyed by names, sizes and
+ * modification times of source files. Cache files are only valid for the
+ * same build of the engine, since structures are stored as is.
+ */
+
+#define MD5_CACHE_IDENT     MakeLittleLong('M','D','5','C')
+#define MD5_CACHE_VERSION   2
+
+// hashes file metadata, so that cache hits don't need to read source files
+static void MD5_HashFile(struct mdfour *md, const char *path)
+{
+    file_info_t info = { .size = -1 };
+    qhandle_t f;
+    int64_t stamp[2];
+
+    if (FS_OpenFile(path, &f, FS_MODE_READ) >= 0) {
+        FS_GetFileInfo(f, &info);
+        FS_CloseFile(f);
+    }
+
+    stamp[0] = info.size;
+    stamp[1] = info.size < 0 ? 0 : info.mtime;
+
+    mdfour_update(md, (const uint8_t *)path, strlen(path) + 1);
+    mdfour_update(md, (const uint8_t *)stamp, sizeof(stamp));
+}
+
+static void MD5_CachePath(char *buffer, const char *mesh_path,
+                          const char *anim_path, const char *scale_path)
+{
+    static const char hexchars[] = "0123456789abcdef";
+    const uint32_t sizes[] = {
+        MD5_CACHE_VERSION,
+        sizeof(md5_joint_t),
+        sizeof(md5_vertex_t),
+        sizeof(md5_weight_t),
+        sizeof(maliastc_t),
+    };
+    struct mdfour md;
+    uint8_t key[16];
+    char *p;
+
+    mdfour_begin(&md);
+    mdfour_update(&md, (const uint8_t *)sizes, sizeof(sizes));
+    MD5_HashFile(&md, mesh_path);
+    MD5_HashFile(&md, anim_path);
+    MD5_HashFile(&md, scale_path);
+    mdfour_result(&md, key);
+
+    p = buffer + Q_strlcpy(buffer, "md5cache/", MAX_QPATH);
+    for (int i = 0; i < 16; i++) {
+        *p++ = hexchars[key[i] >> 4];
+        *p++ = hexchars[key[i] & 15];
+    }
+    strcpy(p, ".bin");
+}
+
+static void *MD5_ReadArray(model_t *model, sizebuf_t *s, size_t size, bool cpu)
+{
+    const void *src = SZ_ReadData(s, size);
+    void *dst;
+
+    if (!src) {
+        Com_SetLastError("Truncated data");
+        longjmp(md5_jmpbuf, -1);
+    }
+
+    dst = cpu ? MD5_CpuMalloc(model, size) : MD5_GpuMalloc(model, size);
+    memcpy(dst, src, size);
+    return dst;
+}
+
+static bool MD5_ParseCache(model_t *model, const void *data, size_t len)
+{
+    md5_model_t *mdl;
+    sizebuf_t s;
+    int i, j;
+
+    if (setjmp(md5_jmpbuf))
+        return false;
+
+    SZ_InitRead(&s, data, len);
+
+    if (SZ_ReadLong(&s) != MD5_CACHE_IDENT)
+        return false;
+
+    model->skeleton = mdl = MD5_CpuMalloc(model, sizeof(*mdl));
+    mdl->num_meshes = SZ_ReadLong(&s);
+    mdl->num_joints = SZ_ReadLong(&s);
+    mdl->num_frames = SZ_ReadLong(&s);
+
+    if (mdl->num_meshes < 1 || mdl->num_meshes > MD5_MAX_MESHES)
+        return false;
+    if (mdl->num_joints < 1 || mdl->num_joints > MD5_MAX_JOINTS)
+        return false;
+    if (mdl->num_frames < 1 || mdl->num_frames > MD5_MAX_FRAMES)
+        return false;
+
+    mdl->meshes = MD5_CpuMalloc(model, mdl->num_meshes * sizeof(mdl->meshes[0]));
+    for (i = 0; i < mdl->num_meshes; i++) {
+        md5_mesh_t *mesh = &mdl->meshes[i];
+
+        mesh->num_verts   = SZ_ReadLong(&s);
+        mesh->num_indices = SZ_ReadLong(&s);
+        mesh->num_weights = SZ_ReadLong(&s);
+
+        if (mesh->num_verts < 0 || mesh->num_verts > TESS_MAX_VERTICES)
+            return false;
+        if (mesh->num_indices < 0 || mesh->num_indices > TESS_MAX_INDICES || mesh->num_indices % 3)
+            return false;
+        if (mesh->num_weights < 0 || mesh->num_weights > MD5_MAX_WEIGHTS)
+            return false;
+
+        mesh->vertices  = MD5_ReadArray(model, &s, mesh->num_verts   * sizeof(mesh->vertices [0]), false);
+        mesh->tcoords   = MD5_ReadArray(model, &s, mesh->num_verts   * sizeof(mesh->tcoords  [0]), false);
+        mesh->indices   = MD5_ReadArray(model, &s, mesh->num_indices * sizeof(mesh->indices  [0]), false);
+        mesh->weights   = MD5_ReadArray(model, &s, mesh->num_weights * sizeof(mesh->weights  [0]), false);
+        mesh->jointnums = MD5_ReadArray(model, &s, mesh->num_weights * sizeof(mesh->jointnums[0]), false);
+
+        for (j = 0; j < mesh->num_verts; j++) {
+            const md5_vertex_t *vert = &mesh->vertices[j];
+            if (vert->start + vert->count > mesh->num_weights)
+                return false;
+        }
+
+        for (j = 0; j < mesh->num_indices; j++)
+            if (mesh->indices[j] >= mesh->num_verts)
+                return false;
+
+        for (j = 0; j < mesh->num_weights; j++)
+            if (mesh->jointnums[j] >= mdl->num_joints)
+                return false;
+    }
+
+    mdl->skeleton_frames = MD5_ReadArray(model, &s, sizeof(mdl->skeleton_frames[0]) * mdl->num_frames * mdl->num_joints, true);
+
+    return !SZ_Remaining(&s);
+}
+
+static bool MD5_ReadCache(model_t *model, const char *path)
+{
+    void *data;
+    int ret = FS_LoadFileEx(path, &data, FS_TYPE_REAL, TAG_FILESYSTEM);
+    if (!data) {
+        if (ret != Q_ERR(ENOENT))
+            MOD_PrintError(path, ret);
+        return false;
+    }
+
+    ret = MD5_ParseCache(model, data, ret);
+    FS_FreeFile(data);
+    if (!ret) {
+        Com_DPrintf("Ignoring corrupt %s\n", path);
+        return false;
+    }
+
+    return true;
+}
+
+static void MD5_WriteCache(const md5_model_t *mdl, const char *path)
+{
+    size_t size;
+    sizebuf_t s;
+    int i, ret;
+
+    size = sizeof(uint32_t) * 4;
+    for (i = 0; i < mdl->num_meshes; i++) {
+        const md5_mesh_t *mesh = &mdl->meshes[i];
+
+        size += sizeof(uint32_t) * 3;
+        size += mesh->num_verts   * (sizeof(mesh->vertices[0]) + sizeof(mesh->tcoords[0]));
+        size += mesh->num_indices * sizeof(mesh->indices[0]);
+        size += mesh->num_weights * (sizeof(mesh->weights[0]) + sizeof(mesh->jointnums[0]));
+    }
+    size += sizeof(mdl->skeleton_frames[0]) * mdl->num_frames * mdl->num_joints;
+
+    if (size > MAX_LOADFILE)
+        return;
+
+    SZ_InitWrite(&s, Z_Malloc(size), size);
+
+    SZ_WriteLong(&s, MD5_CACHE_IDENT);
+    SZ_WriteLong(&s, mdl->num_meshes);
+    SZ_WriteLong(&s, mdl->num_joints);
+    SZ_WriteLong(&s, mdl->num_frames);
+
+    for (i = 0; i < mdl->num_meshes; i++) {
+        const md5_mesh_t *mesh = &mdl->meshes[i];
+
+        SZ_WriteLong(&s, mesh->num_verts);
+        SZ_WriteLong(&s, mesh->num_indices);
+        SZ_WriteLong(&s, mesh->num_weights);
+
+        SZ_Write(&s, mesh->vertices,  mesh->num_verts   * sizeof(mesh->vertices [0]));
+        SZ_Write(&s, mesh->tcoords,   mesh->num_verts   * sizeof(mesh->tcoords  [0]));
+        SZ_Write(&s, mesh->indices,   mesh->num_indices * sizeof(mesh->indices  [0]));
+        SZ_Write(&s, mesh->weights,   mesh->num_weights * sizeof(mesh->weights  [0]));
+        SZ_Write(&s, mesh->jointnums, mesh->num_weights * sizeof(mesh->jointnums[0]));
+    }
+
+    SZ_Write(&s, mdl->skeleton_frames, sizeof(mdl->skeleton_frames[0]) * mdl->num_frames * mdl->num_joints);
+    Q_assert(s.cursize == size);
+
+    ret = FS_WriteFile(path, s.data, s.cursize);
+    if (ret < 0)
+        Com_DPrintf("Couldn't write %s: %s\n", path, Q_ErrorString(ret));
+
+    Z_Free(s.data);
+}
+
 static bool MD5_LoadFile(model_t *model, const char *path, bool (*parse)(model_t *, const char *, const char *))
 {
     void *data;
@@ -1382,11 +1595,13 @@ static void MOD_LoadMD5(model_t *model)
 {
     char model_name[MAX_QPATH], base_path[MAX_QPATH];
     char mesh_path[MAX_QPATH], anim_path[MAX_QPATH];
+    char scale_path[MAX_QPATH], cache_path[MAX_QPATH];
 
     COM_SplitPath(model->name, model_name, sizeof(model_name), base_path, sizeof(base_path), true);
 
     if (Q_concat(mesh_path, sizeof(mesh_path), base_path, "md5/", model_name, ".md5mesh") >= sizeof(mesh_path) ||
-        Q_concat(anim_path, sizeof(anim_path), base_path, "md5/", model_name, ".md5anim") >= sizeof(anim_path))
+        Q_concat(anim_path, sizeof(anim_path), base_path, "md5/", model_name, ".md5anim") >= sizeof(anim_path) ||
+        Q_concat(scale_path, sizeof(scale_path), base_path, "md5/", model_name, ".md5scale") >= sizeof(scale_path))
         return;
 
     // don't bother if we don't have both
@@ -1395,10 +1610,25 @@ static void MOD_LoadMD5(model_t *model)
 
     size_t watermark = model->hunk.cursize;
 
+    if (gl_md5_cache->integer) {
+        MD5_CachePath(cache_path, mesh_path, anim_path, scale_path);
+        if (MD5_ReadCache(model, cache_path))
+            goto skins;
+
+        MD5_Free(model->skeleton);
+        model->skeleton = NULL;
+        Hunk_FreeToWatermark(&model->hunk, watermark);
+    }
+
     if (!MD5_LoadFile(model, mesh_path, MD5_ParseMesh))
         goto fail;
     if (!MD5_LoadFile(model, anim_path, MD5_ParseAnim))
         goto fail;
+
+    if (gl_md5_cache->integer)
+        MD5_WriteCache(model->skeleton, cache_path);
+
+skins:
     if (!MD5_LoadSkins(model))
         goto fail;
 
@@ -1619,6 +1849,32 @@ model_t *MOD_ForHandle(qhandle_t h)
     return model;
 }
 
+#if USE_TESTS
+static void MOD_TessTest_f(void)
+{
+    const model_t *models[MAX_RMODELS];
+    int i, nummodels, iterations = 100;
+    model_t *model;
+
+    if (Cmd_Argc() > 1)
+        iterations = max(Q_atoi(Cmd_Argv(1)), 1);
+
+    // only models with vertices in system memory
+    nummodels = 0;
+    for (i = 0, model = r_models; i < r_numModels; i++, model++)
+        if (model->type == MOD_ALIAS && model->nummeshes && !model->buffer)
+            models[nummodels++] = model;
+
+    if (!nummodels) {
+        Com_Printf("No alias models loaded%s.\n",
+                   gl_static.use_gpu_lerp ? " (GPU lerping is enabled)" : "");
+        return;
+    }
+
+    GL_AliasTessTest(models, nummodels, iterations);
+}
+#endif
+
 void MOD_Init(void)
 {
     Q_assert(!r_numModels);
@@ -1666,10 +1922,16 @@ void MOD_Init(void)
                 "enabled" : "disabled");
 
     Cmd_AddCommand("modellist", MOD_List_f);
+#if USE_TESTS
+    Cmd_AddCommand("meshtesstest", MOD_TessTest_f);
+#endif
 }
 
 void MOD_Shutdown(void)
 {
     MOD_FreeAll();
     Cmd_RemoveCommand("modellist");
+#if USE_TESTS
+    Cmd_RemoveCommand("meshtesstest");
+#endif
 }
@@ -1020,7 +1020,8 @@ void GL_LoadWorld(const char *name)
     bsp_t *bsp;
     mtexinfo_t *info;
     mface_t *surf;
-    int i, n64surfs, ret;
+    imagereq_t *reqs;
+    int i, n64surfs, numreqs, ret;
 
     if (!name || !*name)
         return;
@@ -1059,7 +1060,10 @@ void GL_LoadWorld(const char *name)
     // calculate world size for far clip plane and sky box
     set_world_size(bsp->nodes);
 
-    // register all texinfo
+    // register all texinfo, wall textures are loaded in parallel
+    reqs = Z_Malloc(sizeof(reqs[0]) * bsp->numtexinfo);
+    numreqs = 0;
+
     for (i = 0, info = bsp->texinfo; i < bsp->numtexinfo; i++, info++) {
         if (info->c.flags & SURF_SKY) {
             if (!gl_static.use_cubemaps) {
@@ -1076,12 +1080,22 @@ void GL_LoadWorld(const char *name)
         } else if (info->c.flags & SURF_NODRAW) {
             info->image = R_NOTEXTURE;
         } else {
-            imageflags_t flags = (info->c.flags & SURF_WARP) ? IF_TURBULENT : IF_NONE;
-            Q_concat(buffer, sizeof(buffer), "textures/", info->name, ".wal");
-            info->image = IMG_Find(buffer, IT_WALL, flags);
+            imagereq_t *req = &reqs[numreqs++];
+            Q_concat(req->name, sizeof(req->name), "textures/", info->name, ".wal");
+            req->type = IT_WALL;
+            req->flags = (info->c.flags & SURF_WARP) ? IF_TURBULENT : IF_NONE;
+            info->image = NULL;
         }
     }
 
+    IMG_FindBatch(reqs, numreqs);
+
+    for (i = numreqs = 0, info = bsp->texinfo; i < bsp->numtexinfo; i++, info++)
+        if (!info->image)
+            info->image = reqs[numreqs++].image;
+
+    Z_Free(reqs);
+
     // calculate vertex buffer size in bytes
     size = 0;
     for (i = n64surfs = 0, surf = bsp->faces; i < bsp->numfaces; i++, surf++) {
@@ -18,7 +18,13 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 */
 
 #include "gl.h"
+#include "common/mdfour.h"
 #include "common/prompt.h"
+#include "system/system.h"
+
+#if HAVE_SSE2
+#include <emmintrin.h>
+#endif
 
 static int gl_filter_min;
 static int gl_filter_max;
@@ -48,6 +54,7 @@ static cvar_t *gl_invert;
 static cvar_t *gl_partshape;
 static cvar_t *gl_cubemaps;
 static cvar_t *gl_bloom_scale;
+static cvar_t *gl_texturecache;
 
 cvar_t *gl_intensity;
 
@@ -57,6 +64,7 @@ static void GL_Upscale32(byte *data, int width, int height, int maxlevel, imaget
 static void GL_SetFilterAndRepeat(imagetype_t type, imageflags_t flags);
 static void GL_SetCubemapFilterAndRepeat(void);
 static void GL_InitRawTexture(void);
+static void GL_CacheLevel(int comp, int width, int height, const byte *data);
 
 typedef struct {
     const char *name;
@@ -190,14 +198,131 @@ IMAGE PROCESSING
 =========================================================
 */
 
-static void IMG_ResampleTexture(const byte *in, int inwidth, int inheight,
-                                byte *out, int outwidth, int outheight)
+typedef void (*resample_row_t)(byte *out, const byte *inrow1, const byte *inrow2,
+                               const unsigned *p1, const unsigned *p2, int outwidth);
+typedef void (*mipmap_row_t)(byte *out, const byte *in, int width);
+
+static void resample_row_generic(byte *out, const byte *inrow1, const byte *inrow2,
+                                 const unsigned *p1, const unsigned *p2, int outwidth)
 {
-    int         i, j;
+    const byte  *pix1, *pix2, *pix3, *pix4;
+    int         j;
+
+    for (j = 0; j < outwidth; j++) {
+        pix1 = inrow1 + p1[j];
+        pix2 = inrow1 + p2[j];
+        pix3 = inrow2 + p1[j];
+        pix4 = inrow2 + p2[j];
+        out[0] = (pix1[0] + pix2[0] + pix3[0] + pix4[0]) >> 2;
+        out[1] = (pix1[1] + pix2[1] + pix3[1] + pix4[1]) >> 2;
+        out[2] = (pix1[2] + pix2[2] + pix3[2] + pix4[2]) >> 2;
+        out[3] = (pix1[3] + pix2[3] + pix3[3] + pix4[3]) >> 2;
+        out += 4;
+    }
+}
+
+// width is in bytes
+static void mipmap_row_generic(byte *out, const byte *in, int width)
+{
+    int     j;
+
+    for (j = 0; j < width; j += 8, out += 4, in += 8) {
+        out[0] = (in[0] + in[4] + in[width + 0] + in[width + 4]) >> 2;
+        out[1] = (in[1] + in[5] + in[width + 1] + in[width + 5]) >> 2;
+        out[2] = (in[2] + in[6] + in[width + 2] + in[width + 6]) >> 2;
+        out[3] = (in[3] + in[7] + in[width + 3] + in[width + 7]) >> 2;
+    }
+}
+
+#if HAVE_SSE2
+
+#define PIX32(p)    (*(const uint32_t *)(p))
+
+// sums of 4 pixels are at most 1020, so filtering in 16-bit lanes and
+// truncating gives exactly the same result as the generic version
+static void resample_row_sse2(byte *out, const byte *inrow1, const byte *inrow2,
+                              const unsigned *p1, const unsigned *p2, int outwidth)
+{
+    const __m128i zero = _mm_setzero_si128();
+    int j;
+
+    for (j = 0; j + 4 <= outwidth; j += 4, out += 16) {
+        __m128i a = _mm_setr_epi32(PIX32(inrow1 + p1[j + 0]), PIX32(inrow1 + p1[j + 1]),
+                                   PIX32(inrow1 + p1[j + 2]), PIX32(inrow1 + p1[j + 3]));
+        __m128i b = _mm_setr_epi32(PIX32(inrow1 + p2[j + 0]), PIX32(inrow1 + p2[j + 1]),
+                                   PIX32(inrow1 + p2[j + 2]), PIX32(inrow1 + p2[j + 3]));
+        __m128i c = _mm_setr_epi32(PIX32(inrow2 + p1[j + 0]), PIX32(inrow2 + p1[j + 1]),
+                                   PIX32(inrow2 + p1[j + 2]), PIX32(inrow2 + p1[j + 3]));
+        __m128i d = _mm_setr_epi32(PIX32(inrow2 + p2[j + 0]), PIX32(inrow2 + p2[j + 1]),
+                                   PIX32(inrow2 + p2[j + 2]), PIX32(inrow2 + p2[j + 3]));
+
+        __m128i lo = _mm_add_epi16(_mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero)),
+                                   _mm_add_epi16(_mm_unpacklo_epi8(c, zero), _mm_unpacklo_epi8(d, zero)));
+        __m128i hi = _mm_add_epi16(_mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero)),
+                                   _mm_add_epi16(_mm_unpackhi_epi8(c, zero), _mm_unpackhi_epi8(d, zero)));
+
+        lo = _mm_srli_epi16(lo, 2);
+        hi = _mm_srli_epi16(hi, 2);
+        _mm_storeu_si128((__m128i *)out, _mm_packus_epi16(lo, hi));
+    }
+
+    resample_row_generic(out, inrow1, inrow2, p1 + j, p2 + j, outwidth - j);
+}
+
+#undef PIX32
+
+// filters 2 rows of 4 pixels into 2 output pixels
+static inline __m128i mipmap_quad_sse2(__m128i r0, __m128i r1)
+{
+    const __m128i zero = _mm_setzero_si128();
+    __m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(r0, zero), _mm_unpacklo_epi8(r1, zero));
+    __m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(r0, zero), _mm_unpackhi_epi8(r1, zero));
+    __m128i sum = _mm_add_epi16(_mm_unpacklo_epi64(lo, hi), _mm_unpackhi_epi64(lo, hi));
+    return _mm_srli_epi16(sum, 2);
+}
+
+// safe to call in place: all input is loaded before overlapping output is stored
+static void mipmap_row_sse2(byte *out, const byte *in, int width)
+{
+    int j;
+
+    for (j = 0; j + 32 <= width; j += 32, out += 16, in += 32) {
+        __m128i a0 = _mm_loadu_si128((const __m128i *)(in));
+        __m128i a1 = _mm_loadu_si128((const __m128i *)(in + 16));
+        __m128i b0 = _mm_loadu_si128((const __m128i *)(in + width));
+        __m128i b1 = _mm_loadu_si128((const __m128i *)(in + width + 16));
+
+        __m128i lo = mipmap_quad_sse2(a0, b0);
+        __m128i hi = mipmap_quad_sse2(a1, b1);
+        _mm_storeu_si128((__m128i *)out, _mm_packus_epi16(lo, hi));
+    }
+
+    for (; j < width; j += 8, out += 4, in += 8) {
+        out[0] = (in[0] + in[4] + in[width + 0] + in[width + 4]) >> 2;
+        out[1] = (in[1] + in[5] + in[width + 1] + in[width + 5]) >> 2;
+        out[2] = (in[2] + in[6] + in[width + 2] + in[width + 6]) >> 2;
+        out[3] = (in[3] + in[7] + in[width + 3] + in[width + 7]) >> 2;
+    }
+}
+
+#define resample_row_best   resample_row_sse2
+#define mipmap_row_best     mipmap_row_sse2
+
+#else
+
+#define resample_row_best   resample_row_generic
+#define mipmap_row_best     mipmap_row_generic
+
+#endif // !HAVE_SSE2
+
+static void resample_texture(const byte *in, int inwidth, int inheight,
+                             byte *out, int outwidth, int outheight,
+                             resample_row_t resample_row)
+{
+    int         i;
     const byte  *inrow1, *inrow2;
     unsigned    frac, fracstep;
     unsigned    p1[MAX_TEXTURE_SIZE], p2[MAX_TEXTURE_SIZE];
-    const byte  *pix1, *pix2, *pix3, *pix4;
     float       heightScale;
 
     Q_assert(outwidth <= MAX_TEXTURE_SIZE);
@@ -219,35 +344,117 @@ static void IMG_ResampleTexture(const byte *in, int inwidth, int inheight,
     for (i = 0; i < outheight; i++) {
         inrow1 = in + inwidth * (int)((i + 0.25f) * heightScale);
         inrow2 = in + inwidth * (int)((i + 0.75f) * heightScale);
-        for (j = 0; j < outwidth; j++) {
-            pix1 = inrow1 + p1[j];
-            pix2 = inrow1 + p2[j];
-            pix3 = inrow2 + p1[j];
-            pix4 = inrow2 + p2[j];
-            out[0] = (pix1[0] + pix2[0] + pix3[0] + pix4[0]) >> 2;
-            out[1] = (pix1[1] + pix2[1] + pix3[1] + pix4[1]) >> 2;
-            out[2] = (pix1[2] + pix2[2] + pix3[2] + pix4[2]) >> 2;
-            out[3] = (pix1[3] + pix2[3] + pix3[3] + pix4[3]) >> 2;
-            out += 4;
-        }
+        resample_row(out, inrow1, inrow2, p1, p2, outwidth);
+        out += outwidth * 4;
     }
 }
 
-static void IMG_MipMap(byte *out, const byte *in, int width, int height)
+static void mipmap_texture(byte *out, const byte *in, int width, int height,
+                           mipmap_row_t mipmap_row)
 {
-    int     i, j;
+    int     i;
 
     width <<= 2;
     height >>= 1;
-    for (i = 0; i < height; i++, in += width) {
-        for (j = 0; j < width; j += 8, out += 4, in += 8) {
-            out[0] = (in[0] + in[4] + in[width + 0] + in[width + 4]) >> 2;
-            out[1] = (in[1] + in[5] + in[width + 1] + in[width + 5]) >> 2;
-            out[2] = (in[2] + in[6] + in[width + 2] + in[width + 6]) >> 2;
-            out[3] = (in[3] + in[7] + in[width + 3] + in[width + 7]) >> 2;
-        }
+    for (i = 0; i < height; i++, in += width * 2, out += width / 2)
+        mipmap_row(out, in, width);
+}
+
+static void IMG_ResampleTexture(const byte *in, int inwidth, int inheight,
+                                byte *out, int outwidth, int outheight)
+{
+    resample_texture(in, inwidth, inheight, out, outwidth, outheight, resample_row_best);
+}
+
+static void IMG_MipMap(byte *out, const byte *in, int width, int height)
+{
+    mipmap_texture(out, in, width, height, mipmap_row_best);
+}
+
+#if USE_TESTS
+static void fill_random_pixels(byte *data, int size)
+{
+    int i;
+
+    for (i = 0; i < size; i += 4)
+        WL32(data + i, Q_rand());
+}
+
+static void IMG_FilterTest_f(void)
+{
+    int size = 1024, iterations = 20, i, errors = 0;
+    int outwidth, outheight, bytes;
+    byte *src, *out1, *out2;
+    unsigned start, generic_ms, best_ms;
+
+    if (Cmd_Argc() > 1)
+        size = Q_clip(Q_atoi(Cmd_Argv(1)), 2, MAX_TEXTURE_SIZE / 2);
+    if (Cmd_Argc() > 2)
+        iterations = max(Q_atoi(Cmd_Argv(2)), 1);
+
+    size = Q_npot32(size);
+    bytes = size * size * 4;
+
+    src = FS_AllocTempMem(bytes);
+    out1 = FS_AllocTempMem(bytes);
+    out2 = FS_AllocTempMem(bytes);
+    fill_random_pixels(src, bytes);
+
+    // mipmap: full chain down to 1x1, in place like GL_Upload32 does
+    start = Sys_Milliseconds();
+    for (i = 0; i < iterations; i++) {
+        memcpy(out1, src, bytes);
+        for (int w = size, h = size; w > 1; w >>= 1, h >>= 1)
+            mipmap_texture(out1, out1, w, h, mipmap_row_generic);
+    }
+    generic_ms = Sys_Milliseconds() - start;
+
+    start = Sys_Milliseconds();
+    for (i = 0; i < iterations; i++) {
+        memcpy(out2, src, bytes);
+        for (int w = size, h = size; w > 1; w >>= 1, h >>= 1)
+            mipmap_texture(out2, out2, w, h, mipmap_row_best);
     }
+    best_ms = Sys_Milliseconds() - start;
+
+    if (memcmp(out1, out2, bytes)) {
+        Com_EPrintf("Mipmap output mismatch\n");
+        errors++;
+    }
+
+    Com_Printf("mipmap %dx%d: %u msec generic, %u msec %s\n", size, size,
+               generic_ms, best_ms, HAVE_SSE2 ? "sse2" : "generic");
+
+    // resample: NPOT downscale, as used when NPOT textures aren't supported
+    outwidth = size * 3 / 4;
+    outheight = size * 3 / 4;
+
+    start = Sys_Milliseconds();
+    for (i = 0; i < iterations; i++)
+        resample_texture(src, size, size, out1, outwidth, outheight, resample_row_generic);
+    generic_ms = Sys_Milliseconds() - start;
+
+    start = Sys_Milliseconds();
+    for (i = 0; i < iterations; i++)
+        resample_texture(src, size, size, out2, outwidth, outheight, resample_row_best);
+    best_ms = Sys_Milliseconds() - start;
+
+    if (memcmp(out1, out2, outwidth * outheight * 4)) {
+        Com_EPrintf("Resample output mismatch\n");
+        errors++;
+    }
+
+    Com_Printf("resample %dx%d -> %dx%d: %u msec generic, %u msec %s\n",
+               size, size, outwidth, outheight, generic_ms, best_ms,
+               HAVE_SSE2 ? "sse2" : "generic");
+
+    Com_Printf("%d failures, %d iterations\n", errors, iterations);
+
+    FS_FreeTempMem(out2);
+    FS_FreeTempMem(out1);
+    FS_FreeTempMem(src);
 }
+#endif
 
 /*
 =============================================================================
@@ -519,9 +726,11 @@ static void GL_Upload32(byte *data, int width, int height, int baselevel, imaget
     if (flags & IF_CUBEMAP)
         qglTexImage2D(upload_target, baselevel, GL_RGBA, scaled_width,
                       scaled_height, 0, GL_RGBA, GL_UNSIGNED_BYTE, scaled);
-    else
+    else {
         qglTexImage2D(GL_TEXTURE_2D, baselevel, comp, scaled_width,
                       scaled_height, 0, GL_RGBA, GL_UNSIGNED_BYTE, scaled);
+        GL_CacheLevel(comp, scaled_width, scaled_height, scaled);
+    }
 
     c.texUploads++;
 
@@ -542,6 +751,7 @@ static void GL_Upload32(byte *data, int width, int height, int baselevel, imaget
                 miplevel++;
                 qglTexImage2D(GL_TEXTURE_2D, miplevel, comp, scaled_width,
                               scaled_height, 0, GL_RGBA, GL_UNSIGNED_BYTE, scaled);
+                GL_CacheLevel(comp, scaled_width, scaled_height, scaled);
             }
         }
     }
@@ -896,6 +1106,284 @@ void IMG_Unload(image_t *image)
     }
 }
 
+/*
+=================================================================
+
+TEXTURE CACHE
+
+World textures and skins are saved on disk after post-processing, keyed by
+source file contents and all settings that affect GL_Upload32(). Loading
+them back skips decoding, gamma correction, resampling and mipmapping.
+
+=================================================================
+*/
+
+#define TEXCACHE_IDENT      MakeLittleLong('Q','T','C','1')
+#define TEXCACHE_VERSION    1
+#define TEXCACHE_MAXLEVELS  16
+
+typedef struct {
+    uint32_t    ident;
+    uint32_t    flags;
+    uint16_t    width, height;
+    uint16_t    upload_width, upload_height;
+    uint32_t    comp;
+    uint32_t    numlevels;
+    float       aspect;
+} texcache_header_t;
+
+static struct {
+    bool        active;
+    int         numlevels;
+    int         comp;
+    size_t      size;
+    size_t      maxsize;
+    byte        *data;
+} texcache;
+
+static void GL_CacheLevel(int comp, int width, int height, const byte *data)
+{
+    size_t size = (size_t)width * height * 4;
+
+    if (!texcache.active)
+        return;
+
+    if (texcache.numlevels == TEXCACHE_MAXLEVELS || texcache.size + size > MAX_LOADFILE) {
+        texcache.active = false;
+        texcache.numlevels = 0;
+        return;
+    }
+
+    if (texcache.size + size > texcache.maxsize) {
+        texcache.maxsize = max(texcache.size + size, texcache.maxsize * 2);
+        texcache.data = Z_Realloc(texcache.data, texcache.maxsize);
+    }
+
+    memcpy(texcache.data + texcache.size, data, size);
+    texcache.size += size;
+    texcache.comp = comp;
+    texcache.numlevels++;
+}
+
+static void cache_path(char *buffer, const byte *key)
+{
+    static const char hexchars[] = "0123456789abcdef";
+    char *p = buffer + Q_strlcpy(buffer, "texcache/", MAX_QPATH);
+
+    for (int i = 0; i < 16; i++) {
+        *p++ = hexchars[key[i] >> 4];
+        *p++ = hexchars[key[i] & 15];
+    }
+    strcpy(p, ".bin");
+}
+
+/*
+================
+IMG_CacheKey
+
+Returns false if image is not eligible for caching.
+================
+*/
+bool IMG_CacheKey(const image_t *image, const void *data, size_t len, byte *key)
+{
+    struct mdfour md;
+    struct {
+        uint32_t    version;
+        uint32_t    type;
+        uint32_t    flags;
+        int32_t     picmip;
+        int32_t     round_down;
+        int32_t     downsample_skins;
+        int32_t     invert;
+        int32_t     max_texture_size;
+        uint32_t    caps;
+        int32_t     solid_format;
+        int32_t     alpha_format;
+        float       colorscale;
+        uint32_t    lightscale;
+        uint32_t    gammaramp;
+        uint32_t    generate_mipmap;
+    } settings;
+
+    if (!gl_texturecache->integer)
+        return false;
+    if (image->type != IT_WALL && image->type != IT_SKIN)
+        return false;
+    if (image->flags & (IF_CUBEMAP | IF_SPECIAL))
+        return false;
+
+    memset(&settings, 0, sizeof(settings));
+    settings.version = TEXCACHE_VERSION;
+    settings.type = image->type;
+    settings.flags = image->flags;
+    settings.picmip = gl_picmip->integer;
+    settings.round_down = gl_round_down->integer;
+    settings.downsample_skins = gl_downsample_skins->integer;
+    settings.invert = gl_invert->integer;
+    settings.max_texture_size = gl_config.max_texture_size;
+    settings.caps = gl_config.caps & (QGL_CAP_TEXTURE_NON_POWER_OF_TWO | QGL_CAP_TEXTURE_BITS);
+    settings.solid_format = gl_tex_solid_format;
+    settings.alpha_format = gl_tex_alpha_format;
+    settings.colorscale = colorscale;
+    settings.lightscale = lightscale;
+    settings.gammaramp = !!(r_config.flags & QVF_GAMMARAMP);
+    settings.generate_mipmap = !!qglGenerateMipmap;
+
+    mdfour_begin(&md);
+    mdfour_update(&md, (const uint8_t *)&settings, sizeof(settings));
+    mdfour_update(&md, gammaintensitytable, sizeof(gammaintensitytable));
+    mdfour_update(&md, (const uint8_t *)d_8to24table, sizeof(d_8to24table));
+    mdfour_update(&md, data, len);
+    mdfour_result(&md, key);
+
+    return true;
+}
+
+/*
+================
+IMG_ReadCache
+
+Loads and validates cached texture. Returned buffer must be freed by caller.
+================
+*/
+void *IMG_ReadCache(const byte *key)
+{
+    char path[MAX_QPATH];
+    const texcache_header_t *header;
+    void *data;
+    size_t size;
+    int ret, w, h;
+
+    cache_path(path, key);
+
+    ret = FS_LoadFileEx(path, &data, FS_TYPE_REAL, TAG_FILESYSTEM);
+    if (ret < 0) {
+        if (ret != Q_ERR(ENOENT))
+            Com_DPrintf("Couldn't load %s: %s\n", path, Q_ErrorString(ret));
+        return NULL;
+    }
+
+    header = data;
+    if (ret < sizeof(*header) || header->ident != TEXCACHE_IDENT)
+        goto fail;
+    if (header->numlevels < 1 || header->numlevels > TEXCACHE_MAXLEVELS)
+        goto fail;
+
+    w = header->upload_width;
+    h = header->upload_height;
+    if (w < 1 || h < 1 || w > gl_config.max_texture_size || h > gl_config.max_texture_size)
+        goto fail;
+
+    size = sizeof(*header);
+    for (int i = 0; i < header->numlevels; i++) {
+        size += w * h * 4;
+        w = max(w >> 1, 1);
+        h = max(h >> 1, 1);
+    }
+    if (size != ret)
+        goto fail;
+
+    return data;
+
+fail:
+    Com_DPrintf("Ignoring corrupt %s\n", path);
+    FS_FreeFile(data);
+    return NULL;
+}
+
+/*
+================
+IMG_LoadCached
+
+Uploads texture from buffer returned by IMG_ReadCache().
+================
+*/
+void IMG_LoadCached(image_t *image, const void *cache)
+{
+    const texcache_header_t *header = cache;
+    const byte *data = (const byte *)(header + 1);
+    int w = header->upload_width;
+    int h = header->upload_height;
+
+    image->width = header->width;
+    image->height = header->height;
+    image->upload_width = w;
+    image->upload_height = h;
+    image->flags = header->flags;
+    image->aspect = header->aspect;
+
+    qglGenTextures(1, &image->texnum);
+    GL_ForceTexture(TMU_TEXTURE, image->texnum);
+
+    for (int i = 0; i < header->numlevels; i++) {
+        qglTexImage2D(GL_TEXTURE_2D, i, header->comp, w, h, 0,
+                      GL_RGBA, GL_UNSIGNED_BYTE, data);
+        data += w * h * 4;
+        w = max(w >> 1, 1);
+        h = max(h >> 1, 1);
+    }
+
+    c.texUploads++;
+
+    if (header->numlevels == 1 && qglGenerateMipmap)
+        qglGenerateMipmap(GL_TEXTURE_2D);
+
+    GL_SetFilterAndRepeat(image->type, image->flags);
+
+    image->sl = 0;
+    image->sh = 1;
+    image->tl = 0;
+    image->th = 1;
+}
+
+/*
+================
+IMG_LoadAndCache
+
+Same as IMG_Load(), but also saves uploaded texture in cache.
+================
+*/
+void IMG_LoadAndCache(image_t *image, byte *pic, const byte *key)
+{
+    texcache_header_t *header;
+    char path[MAX_QPATH];
+    int ret;
+
+    if (!texcache.data) {
+        texcache.maxsize = 0x10000;
+        texcache.data = Z_Malloc(texcache.maxsize);
+    }
+
+    texcache.active = true;
+    texcache.numlevels = 0;
+    texcache.size = sizeof(*header);
+
+    IMG_Load(image, pic);
+
+    if (!texcache.active || !texcache.numlevels) {
+        texcache.active = false;
+        return;
+    }
+    texcache.active = false;
+
+    header = (texcache_header_t *)texcache.data;
+    header->ident = TEXCACHE_IDENT;
+    header->flags = image->flags;
+    header->width = image->width;
+    header->height = image->height;
+    header->upload_width = image->upload_width;
+    header->upload_height = image->upload_height;
+    header->comp = texcache.comp;
+    header->numlevels = texcache.numlevels;
+    header->aspect = image->aspect;
+
+    cache_path(path, key);
+
+    ret = FS_WriteFile(path, texcache.data, texcache.size);
+    if (ret < 0)
+        Com_DPrintf("Couldn't write %s: %s\n", path, Q_ErrorString(ret));
+}
+
 // for screenshots
 int IMG_ReadPixels(screenshot_t *s)
 {
@@ -1306,6 +1794,7 @@ void GL_InitImages(void)
     gl_partshape->changed = gl_partshape_changed;
     gl_cubemaps = Cvar_Get("gl_cubemaps", "1", CVAR_FILES);
     gl_bloom_scale = Cvar_Get("gl_bloom_scale", "0.25", CVAR_REFRESH);
+    gl_texturecache = Cvar_Get("gl_texturecache", "0", 0);
 
     if (r_config.flags & QVF_GAMMARAMP) {
         gl_gamma->changed = gl_gamma_changed;
@@ -1373,6 +1862,10 @@ void GL_InitImages(void)
     r_charset = R_RegisterFont("conchars");
 #endif
 
+#if USE_TESTS
+    Cmd_AddCommand("imgfiltertest", IMG_FilterTest_f);
+#endif
+
     GL_ShowErrors(__func__);
 }
 
@@ -1404,8 +1897,15 @@ void GL_ShutdownImages(void)
     r_charset = 0;
 #endif
 
+#if USE_TESTS
+    Cmd_RemoveCommand("imgfiltertest");
+#endif
+
     scrap_dirty = false;
 
+    Z_Free(texcache.data);
+    memset(&texcache, 0, sizeof(texcache));
+
     IMG_FreeAll();
     IMG_Shutdown();
 }
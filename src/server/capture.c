@@ -0,0 +1,517 @@
+/*
+Copyright (C) 2026 agent <agent@local>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+//
+// capture.c -- recording and replaying of server input
+//
+// Capture file consists of a header followed by a stream of records. Each
+// SV_Frame call starts with a frame record holding its msec value, followed
+// by packet records for every UDP packet read during that call. Replay
+// feeds the same packets at the same points of server time, but doesn't
+// wait for real time to pass.
+//
+// Server random number generator is seeded from the header when the map is
+// spawned. Game module keeps its own state and may still diverge if it
+// uses time or its own random numbers.
+//
+
+#include "server.h"
+
+#define CAPTURE_MAGIC       MakeLittleLong('Q','2','I','C')
+#define CAPTURE_VERSION     1
+
+enum {
+    CAP_FRAME = 1,
+    CAP_PACKET
+};
+
+typedef enum {
+    CS_NONE,
+    CS_RECORD_PENDING,  // waiting for map spawn
+    CS_RECORDING,
+    CS_REPLAY_PENDING,
+    CS_REPLAYING
+} capstate_t;
+
+typedef struct {
+    uint32_t    magic;
+    uint32_t    version;
+    uint32_t    seed;
+    uint32_t    residual;
+    char        mapcmd[MAX_QPATH];
+} capheader_t;
+
+static struct {
+    capstate_t  state;
+    qhandle_t   file;
+    char        filename[MAX_OSPATH];
+    capheader_t header;
+    bool        spawned;
+
+    // record
+    unsigned    packets;
+
+    // replay
+    bool        pending;        // frame record already read
+    unsigned    pending_msec;
+    uint64_t    start_time;
+    uint64_t    frame_usec;
+    int         framenum;
+    unsigned    realtime;
+    uint32_t    *frame_times;
+    unsigned    num_frames;
+    unsigned    max_frames;
+} cap;
+
+static void close_capture(void)
+{
+    if (cap.file && FS_CloseFile(cap.file))
+        Com_EPrintf("Error closing %s\n", cap.filename);
+
+    Z_Free(cap.frame_times);
+    memset(&cap, 0, sizeof(cap));
+}
+
+/*
+==============================================================================
+
+RECORDING
+
+==============================================================================
+*/
+
+static void write_record(const void *data, size_t len)
+{
+    if (FS_Write(data, len, cap.file) != len) {
+        Com_EPrintf("Couldn't write %s, capture stopped\n", cap.filename);
+        close_capture();
+    }
+}
+
+static void write_header(void)
+{
+    capheader_t header = cap.header;
+
+    header.magic = LittleLong(CAPTURE_MAGIC);
+    header.version = LittleLong(CAPTURE_VERSION);
+    header.seed = LittleLong(header.seed);
+    header.residual = LittleLong(sv.frameresidual);
+
+    write_record(&header, sizeof(header));
+}
+
+static void write_frame(unsigned msec)
+{
+    byte buf[3] = { CAP_FRAME, msec & 255, msec >> 8 };
+
+    write_record(buf, sizeof(buf));
+}
+
+/*
+==================
+SV_CapturePacket
+
+Called for each packet read from UDP socket.
+==================
+*/
+void SV_CapturePacket(void)
+{
+    byte buf[1 + 1 + 16 + 2 + 4 + 2];
+
+    if (cap.state != CS_RECORDING)
+        return;
+
+    // loopback packets from local client can't be replayed
+    if (net_from.type != NA_IP && net_from.type != NA_IP6)
+        return;
+
+    buf[0] = CAP_PACKET;
+    buf[1] = net_from.type == NA_IP6 ? 6 : 4;
+    memcpy(buf + 2, net_from.ip.u8, 16);
+    memcpy(buf + 18, &net_from.port, 2);    // already in network order
+    WL32(buf + 20, net_from.scope_id);
+    WL16(buf + 24, msg_read.cursize);
+
+    write_record(buf, sizeof(buf));
+    if (cap.file)
+        write_record(msg_read.data, msg_read.cursize);
+
+    cap.packets++;
+}
+
+/*
+==============================================================================
+
+REPLAY
+
+==============================================================================
+*/
+
+static bool read_record(void *data, size_t len)
+{
+    return FS_Read(data, len, cap.file) == len;
+}
+
+static int time_cmp(const void *p1, const void *p2)
+{
+    uint32_t a = *(const uint32_t *)p1;
+    uint32_t b = *(const uint32_t *)p2;
+    return a < b ? -1 : a > b;
+}
+
+static void finish_replay(const char *reason)
+{
+    uint64_t total = Sys_Microseconds() - cap.start_time;
+    unsigned n = cap.num_frames;
+
+    Com_Printf("Replay of %s %s after %u frames\n", cap.filename, reason, n);
+
+    if (n) {
+        uint32_t *times = cap.frame_times;
+        uint64_t sum = 0;
+        unsigned i, worst = 0;
+
+        for (i = 0; i < n; i++) {
+            sum += times[i];
+            if (times[i] > times[worst])
+                worst = i;
+        }
+
+        Com_Printf("%.3f sec of server time replayed in %.3f sec\n"
+                   "SV_Frame usec per frame: avg %"PRIu64", worst %u at frame %u\n",
+                   cap.realtime * 0.001, total * 1e-6, sum / n, times[worst], worst);
+
+        qsort(times, n, sizeof(times[0]), time_cmp);
+        Com_Printf("p50 %u, p90 %u, p99 %u, max %u\n",
+                   times[n / 2], times[n * 9 / 10], times[n * 99 / 100], times[n - 1]);
+    }
+
+    close_capture();
+
+    // let real clients in again
+    if (sv_maxclients->integer > 1)
+        NET_Config(NET_SERVER);
+}
+
+static bool read_frame(void)
+{
+    byte buf[2];
+
+    if (!read_record(buf, sizeof(buf)))
+        return false;
+
+    cap.pending_msec = buf[0] | buf[1] << 8;
+    cap.pending = true;
+    return true;
+}
+
+static bool read_packet(void)
+{
+    byte buf[1 + 16 + 2 + 4 + 2];
+    unsigned len;
+
+    if (!read_record(buf, sizeof(buf)))
+        return false;
+
+    memset(&net_from, 0, sizeof(net_from));
+    net_from.type = buf[0] == 6 ? NA_IP6 : NA_IP;
+    memcpy(net_from.ip.u8, buf + 1, 16);
+    memcpy(&net_from.port, buf + 17, 2);
+    net_from.scope_id = RL32(buf + 19);
+
+    len = RL16(buf + 23);
+    if (len > MAX_PACKETLEN)
+        return false;
+
+    if (!read_record(msg_read_buffer, len))
+        return false;
+
+    SZ_InitRead(&msg_read, msg_read_buffer, len);
+    return true;
+}
+
+/*
+==================
+SV_CaptureReplayPackets
+
+Feeds recorded packets for current SV_Frame call into the server.
+Returns false if not replaying, so that real packets are read instead.
+==================
+*/
+bool SV_CaptureReplayPackets(void (*packet_cb)(void))
+{
+    byte type;
+
+    if (cap.state != CS_REPLAYING)
+        return false;
+
+    while (!cap.pending) {
+        if (!read_record(&type, 1))
+            break;
+
+        if (type == CAP_FRAME) {
+            read_frame();
+            break;
+        }
+
+        if (type != CAP_PACKET || !read_packet()) {
+            Com_EPrintf("Malformed packet in %s\n", cap.filename);
+            break;
+        }
+
+        (*packet_cb)();
+
+        // packet may have caused server shutdown
+        if (cap.state != CS_REPLAYING)
+            break;
+    }
+
+    return true;
+}
+
+/*
+==================
+SV_CaptureFrame
+
+Called at the start of each SV_Frame. Records frame time, or replaces it
+with recorded one. Returns true if replaying.
+==================
+*/
+bool SV_CaptureFrame(unsigned *msec)
+{
+    switch (cap.state) {
+    case CS_RECORDING:
+        write_frame(*msec);
+        return false;
+
+    case CS_RECORD_PENDING:
+        if (!cap.spawned || !svs.initialized)
+            return false;
+        write_header();
+        if (cap.file) {
+            Com_Printf("Recording server input to %s\n", cap.filename);
+            cap.state = CS_RECORDING;
+            write_frame(*msec);
+        }
+        return false;
+
+    case CS_REPLAY_PENDING:
+        if (!cap.spawned || !svs.initialized)
+            return false;
+        Com_Printf("Replaying server input from %s\n", cap.filename);
+
+        // don't talk to recorded addresses and don't mix in real clients
+        NET_Config(NET_NONE);
+
+        sv.frameresidual = cap.header.residual;
+        cap.state = CS_REPLAYING;
+        cap.start_time = Sys_Microseconds();
+        cap.framenum = sv.framenum;
+        // fall through
+
+    case CS_REPLAYING:
+        // previous call stopped at the frame record or end of file
+        if (!cap.pending) {
+            byte type;
+            if (!read_record(&type, 1) || type != CAP_FRAME || !read_frame()) {
+                finish_replay("finished");
+                return false;
+            }
+        }
+        *msec = cap.pending_msec;
+        cap.pending = false;
+        cap.realtime += *msec;
+        return true;
+
+    default:
+        return false;
+    }
+}
+
+/*
+==================
+SV_CaptureFrameTime
+
+Accounts time spent in SV_Frame during replay.
+==================
+*/
+void SV_CaptureFrameTime(uint64_t usec)
+{
+    if (cap.state != CS_REPLAYING)
+        return;
+
+    cap.frame_usec += usec;
+
+    // only count calls that ended up running a server frame
+    if (cap.framenum == sv.framenum)
+        return;
+    cap.framenum = sv.framenum;
+
+    if (cap.num_frames == cap.max_frames) {
+        cap.max_frames = max(cap.max_frames * 2, 1024);
+        cap.frame_times = Z_Realloc(cap.frame_times, sizeof(cap.frame_times[0]) * cap.max_frames);
+    }
+
+    cap.frame_times[cap.num_frames++] = min(cap.frame_usec, UINT32_MAX);
+    cap.frame_usec = 0;
+}
+
+/*
+==================
+SV_CaptureSpawn
+
+Seeds random number generator before new map is spawned, so that
+spawncount and challenges match between recording and replay.
+==================
+*/
+void SV_CaptureSpawn(const mapcmd_t *cmd)
+{
+    if (cap.spawned)
+        return;
+
+    if (cap.state == CS_RECORD_PENDING)
+        Q_strlcpy(cap.header.mapcmd, cmd->buffer, sizeof(cap.header.mapcmd));
+    else if (cap.state != CS_REPLAY_PENDING)
+        return;
+
+    Q_srand(cap.header.seed);
+    cap.spawned = true;
+}
+
+/*
+==================
+SV_CaptureStop
+==================
+*/
+void SV_CaptureStop(void)
+{
+    switch (cap.state) {
+    case CS_RECORDING:
+        Com_Printf("Stopped recording %s, %u packets\n", cap.filename, cap.packets);
+        close_capture();
+        break;
+    case CS_REPLAYING:
+        finish_replay("stopped");
+        break;
+    case CS_RECORD_PENDING:
+    case CS_REPLAY_PENDING:
+        Com_Printf("Cancelled capture %s\n", cap.filename);
+        close_capture();
+        break;
+    default:
+        break;
+    }
+}
+
+static bool check_idle(void)
+{
+    if (cap.state != CS_NONE) {
+        Com_Printf("Already %s %s.\n", cap.state < CS_REPLAY_PENDING ?
+                   "recording" : "replaying", cap.filename);
+        return false;
+    }
+
+    if (svs.initialized) {
+        Com_Printf("Capture must start before the map is loaded, "
+                   "use 'killserver' first.\n");
+        return false;
+    }
+
+    return true;
+}
+
+static void SV_RecordInput_f(void)
+{
+    if (Cmd_Argc() != 2) {
+        Com_Printf("Usage: %s <filename>\n", Cmd_Argv(0));
+        return;
+    }
+
+    if (!check_idle())
+        return;
+
+    cap.file = FS_EasyOpenFile(cap.filename, sizeof(cap.filename),
+                               FS_MODE_WRITE, "captures/", Cmd_Argv(1), ".cap");
+    if (!cap.file)
+        return;
+
+    cap.header.seed = Q_rand();
+    cap.state = CS_RECORD_PENDING;
+
+    Com_Printf("Will record server input to %s when the map is loaded.\n", cap.filename);
+}
+
+static void SV_ReplayInput_f(void)
+{
+    capheader_t *h = &cap.header;
+
+    if (Cmd_Argc() != 2) {
+        Com_Printf("Usage: %s <filename>\n", Cmd_Argv(0));
+        return;
+    }
+
+    if (!COM_DEDICATED) {
+        Com_Printf("Replay is only supported on dedicated server.\n");
+        return;
+    }
+
+    if (!check_idle())
+        return;
+
+    cap.file = FS_EasyOpenFile(cap.filename, sizeof(cap.filename),
+                               FS_MODE_READ, "captures/", Cmd_Argv(1), ".cap");
+    if (!cap.file)
+        return;
+
+    if (!read_record(h, sizeof(*h)) ||
+        LittleLong(h->magic) != CAPTURE_MAGIC ||
+        LittleLong(h->version) != CAPTURE_VERSION) {
+        Com_Printf("%s is not a valid capture file.\n", cap.filename);
+        close_capture();
+        return;
+    }
+
+    h->seed = LittleLong(h->seed);
+    h->residual = LittleLong(h->residual);
+    h->mapcmd[MAX_QPATH - 1] = 0;
+    cap.state = CS_REPLAY_PENDING;
+
+    Cbuf_AddText(&cmd_buffer, va("map \"%s\"\n", h->mapcmd));
+}
+
+static void SV_StopInput_f(void)
+{
+    if (cap.state == CS_NONE) {
+        Com_Printf("Not recording or replaying.\n");
+        return;
+    }
+
+    SV_CaptureStop();
+}
+
+static const cmdreg_t c_capture[] = {
+    { "recordinput", SV_RecordInput_f },
+    { "replayinput", SV_ReplayInput_f },
+    { "stopinput", SV_StopInput_f },
+    { NULL }
+};
+
+void SV_RegisterCapture(void)
+{
+    Cmd_Register(c_capture);
+}
@@ -615,7 +615,7 @@ static void dump_downloads(void)
 
     FOR_EACH_CLIENT(client) {
         if (client->download) {
-            name = client->downloadname;
+            name = client->download->name;
             size = client->downloadsize;
             if (!size)
                 size = 1;
@@ -629,6 +629,8 @@ static void dump_downloads(void)
         Com_Printf("%3i %-15.15s %-40.40s %-7d %3d%%\n",
                    client->number, client->name, name, size, percent);
     }
+
+    SV_DownloadCacheInfo();
 }
 
 static void dump_time(void)
@@ -710,6 +712,33 @@ static void dump_settings(void)
     }
 }
 
+static void dump_overload(void)
+{
+    client_t    *cl;
+
+    Com_Printf("Frame time %u usec, overload %s, detected %u times, %u frames skipped\n\n",
+               svs.overload.frame_usec, svs.overload.active ? "active" : "inactive",
+               svs.overload.count, svs.overload.drops);
+
+    Com_Printf(
+        "num name            idle spec div  skipped\n"
+        "--- --------------- ---- ---- --- --------\n");
+
+    FOR_EACH_CLIENT(cl) {
+        unsigned idle = min((svs.realtime - cl->lastactivity) / 1000, 9999);
+        bool spec = cl->state == cs_spawned && cl->edict->client &&
+                    SV_GetClient_PmType(cl) == PM_SPECTATOR;
+#if USE_FPS
+        int div = cl->framediv;
+#else
+        int div = 1;
+#endif
+        Com_Printf("%3i %-15.15s %4u %-4s %3d %8u\n",
+                   cl->number, cl->name, idle, spec ? "yes" : "no",
+                   div, cl->overload_drops);
+    }
+}
+
 /*
 ================
 SV_Status_f
@@ -734,12 +763,13 @@ static void SV_Status_f(void)
             switch (*w) {
             case 'd': dump_downloads(); break;
             case 'l': dump_lag();       break;
+            case 'o': dump_overload();  break;
             case 'p': dump_protocols(); break;
             case 's': dump_settings();  break;
             case 't': dump_time();      break;
             case 'v': dump_versions();  break;
             default:
-                Com_Printf("Usage: %s [d|l|p|s|t|v]\n", Cmd_Argv(0));
+                Com_Printf("Usage: %s [d|l|o|p|s|t|v]\n", Cmd_Argv(0));
                 dump_clients();
                 break;
             }
@@ -0,0 +1,254 @@
+/*
+Copyright (C) 2026 agent <agent@local>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+//
+// download.c -- files shared between UDP downloads
+//
+
+#include "server.h"
+
+// least recently used first
+static LIST_DECL(dl_files);
+static size_t   dl_total;   // bytes held by all files
+
+static cvar_t   *sv_download_cache;
+#if USE_ZLIB
+static cvar_t   *sv_download_deflate;
+#endif
+
+static size_t cache_limit(void)
+{
+    return (size_t)max(sv_download_cache->integer, 0) << 20;
+}
+
+static void free_file(dlfile_t *file)
+{
+    List_Remove(&file->entry);
+    dl_total -= file->size;
+    Z_Free(file->data);
+    Z_Free(file);
+}
+
+// frees least recently used files nobody is downloading until the rest
+// fits into the limit
+static void trim_cache(size_t limit)
+{
+    dlfile_t *file, *next;
+
+    LIST_FOR_EACH_SAFE(dlfile_t, file, next, &dl_files, entry) {
+        if (dl_total <= limit)
+            break;
+        if (!file->refcount)
+            free_file(file);
+    }
+}
+
+static dlfile_t *find_file(const char *name, dltype_t type, int srcsize, int64_t srcmtime)
+{
+    dlfile_t *file, *next;
+
+    LIST_FOR_EACH_SAFE(dlfile_t, file, next, &dl_files, entry) {
+        if (file->type != type || FS_pathcmp(file->name, name))
+            continue;
+
+        if (file->srcsize == srcsize && file->srcmtime == srcmtime) {
+            List_Remove(&file->entry);
+            List_Append(&dl_files, &file->entry);
+            file->refcount++;
+            return file;
+        }
+
+        // file changed on disk
+        if (!file->refcount)
+            free_file(file);
+    }
+
+    return NULL;
+}
+
+static dlfile_t *alloc_file(const char *name, dltype_t type, int srcsize, int64_t srcmtime)
+{
+    size_t len = strlen(name);
+    dlfile_t *file = SV_Mallocz(sizeof(*file) + len);
+
+    memcpy(file->name, name, len + 1);
+    file->type = type;
+    file->srcsize = srcsize;
+    file->srcmtime = srcmtime;
+    file->refcount = 1;
+    return file;
+}
+
+static void add_file(dlfile_t *file)
+{
+    List_Append(&dl_files, &file->entry);
+    dl_total += file->size;
+    trim_cache(cache_limit());
+}
+
+/*
+==================
+SV_LoadDownload
+
+Returns shared contents of already opened file, reading it only if not
+cached yet. Cached files are matched by name, size and modification time
+on disk.
+==================
+*/
+dlfile_t *SV_LoadDownload(const char *name, qhandle_t f, int size, bool pkz)
+{
+    dltype_t type = pkz ? DL_PKZ : DL_RAW;
+    file_info_t info;
+    dlfile_t *file;
+
+    if (FS_GetFileInfo(f, &info))
+        return NULL;
+
+    file = find_file(name, type, size, info.mtime);
+    if (file)
+        return file;
+
+    file = alloc_file(name, type, size, info.mtime);
+    file->data = SV_Malloc(size);
+    if (FS_Read(file->data, size, f) != size) {
+        Z_Free(file->data);
+        Z_Free(file);
+        return NULL;
+    }
+
+    file->size = size;
+    add_file(file);
+    return file;
+}
+
+#if USE_ZLIB
+
+static void deflate_file(dlfile_t *file, const dlfile_t *raw)
+{
+    z_stream z = { .zalloc = SV_zalloc, .zfree = SV_zfree };
+    int level = Cvar_ClampInteger(sv_download_deflate, 1, 9);
+    // not worth it unless at least 1/16 is saved
+    int maxsize = raw->size - raw->size / 16;
+#if USE_DEBUG
+    unsigned start = Sys_Milliseconds();
+#endif
+
+    if (deflateInit2(&z, level, Z_DEFLATED, -MAX_WBITS, 9, Z_DEFAULT_STRATEGY) != Z_OK)
+        return;
+
+    file->data = SV_Malloc(maxsize);
+
+    z.next_in = raw->data;
+    z.avail_in = raw->size;
+    z.next_out = file->data;
+    z.avail_out = maxsize;
+
+    if (deflate(&z, Z_FINISH) == Z_STREAM_END) {
+        file->size = z.total_out;
+        file->data = Z_Realloc(file->data, file->size);
+    } else {
+        Z_Freep(&file->data);
+    }
+
+    deflateEnd(&z);
+
+#if USE_DEBUG
+    Com_DPrintf("Deflated %s: %d -> %d bytes in %u ms\n", raw->name,
+                raw->size, file->size, Sys_Milliseconds() - start);
+#endif
+}
+
+/*
+==================
+SV_DeflateDownload
+
+Returns compressed version of raw file, compressing it only once. Returns
+NULL if compression is disabled or doesn't pay off.
+==================
+*/
+dlfile_t *SV_DeflateDownload(dlfile_t *raw)
+{
+    dlfile_t *file;
+
+    if (!sv_download_deflate->integer)
+        return NULL;
+
+    Q_assert(raw->type == DL_RAW);
+
+    file = find_file(raw->name, DL_DEFLATED, raw->srcsize, raw->srcmtime);
+    if (!file) {
+        file = alloc_file(raw->name, DL_DEFLATED, raw->srcsize, raw->srcmtime);
+        deflate_file(file, raw);
+        // keep empty file to remember not to try again
+        add_file(file);
+    }
+
+    if (!file->size) {
+        SV_ReleaseDownload(file);
+        return NULL;
+    }
+
+    return file;
+}
+
+#endif
+
+void SV_ReleaseDownload(dlfile_t *file)
+{
+    Q_assert(file->refcount > 0);
+    if (!--file->refcount)
+        trim_cache(cache_limit());
+}
+
+void SV_DownloadCacheInfo(void)
+{
+    dlfile_t *file;
+    int count = 0, active = 0;
+
+    LIST_FOR_EACH(dlfile_t, file, &dl_files, entry) {
+        count++;
+        active += !!file->refcount;
+    }
+
+    Com_Printf("Download cache: %d files (%d active), %zu of %zu KiB\n",
+               count, active, dl_total >> 10, cache_limit() >> 10);
+}
+
+// frees everything not being downloaded
+void SV_FlushDownloads(void)
+{
+    dlfile_t *file, *next;
+
+    LIST_FOR_EACH_SAFE(dlfile_t, file, next, &dl_files, entry)
+        if (!file->refcount)
+            free_file(file);
+}
+
+static void sv_download_cache_changed(cvar_t *self)
+{
+    trim_cache(cache_limit());
+}
+
+void SV_RegisterDownloads(void)
+{
+    sv_download_cache = Cvar_Get("sv_download_cache", "64", 0);
+    sv_download_cache->changed = sv_download_cache_changed;
+#if USE_ZLIB
+    sv_download_deflate = Cvar_Get("sv_download_deflate", "1", 0);
+#endif
+}
@@ -480,44 +480,184 @@ static bool SV_EntityAttenuatedAway(const vec3_t org, const edict_t *ent)
 #define IS_MONSTER(ent) \
     ((ent->svflags & (SVF_MONSTER | SVF_DEADMONSTER)) == SVF_MONSTER || (ent->s.renderfx & RF_FRAMELERP))
 
-#define IS_HI_PRIO(ent) \
-    (ent->s.number <= sv_client->maxclients || IS_MONSTER(ent) || ent->solid == SOLID_BSP)
+#define IS_HI_PRIO(client, ent) \
+    (ent->s.number <= client->maxclients || IS_MONSTER(ent) || ent->solid == SOLID_BSP)
 
-#define IS_GIB(ent) \
-    (sv_client->csr->extended ? (ent->s.renderfx & RF_LOW_PRIORITY) : (ent->s.effects & (EF_GIB | EF_GREENGIB)))
+#define IS_GIB(client, ent) \
+    (client->csr->extended ? (ent->s.renderfx & RF_LOW_PRIORITY) : (ent->s.effects & (EF_GIB | EF_GREENGIB)))
 
-#define IS_LO_PRIO(ent) \
-    (IS_GIB(ent) || (!ent->s.modelindex && !ent->s.effects))
+#define IS_LO_PRIO(client, ent) \
+    (IS_GIB(client, ent) || (!ent->s.modelindex && !ent->s.effects))
 
-static vec3_t clientorg;
+/*
+Returns sort key for entity: high priority entities come first, low priority
+last, then closer entities first within each class. Bit pattern of positive
+float compares the same as the float itself, so keys are compared as plain
+integers.
+*/
+static uint64_t SV_EntityPriority(const client_t *client, const vec3_t org, const edict_t *ent)
+{
+    uint64_t prio = 1;
+    float dist = DistanceSquared(ent->s.origin, org);
+    uint32_t bits;
+
+    if (IS_HI_PRIO(client, ent))
+        prio = 0;
+    else if (IS_LO_PRIO(client, ent))
+        prio = 2;
+
+    memcpy(&bits, &dist, sizeof(bits));
+    return prio << 32 | bits;
+}
+
+// returns k-th smallest key, partially reordering the array
+static uint64_t SV_SelectKey(uint64_t *keys, int n, int k)
+{
+    int lo = 0, hi = n - 1;
+
+    while (lo < hi) {
+        uint64_t pivot = keys[lo + (hi - lo) / 2];
+        int i = lo, j = hi;
+
+        while (i <= j) {
+            while (keys[i] < pivot)
+                i++;
+            while (keys[j] > pivot)
+                j--;
+            if (i <= j) {
+                SWAP(uint64_t, keys[i], keys[j]);
+                i++;
+                j--;
+            }
+        }
+
+        if (k <= j)
+            hi = j;
+        else if (k >= i)
+            lo = i;
+        else
+            break;
+    }
+
+    return keys[k];
+}
+
+/*
+Keeps `max' highest priority entities. Candidates are collected in entity
+number order, which is preserved, so that only the threshold key needs to be
+found instead of fully sorting the list twice. Uses static scratch space, so
+must be called from main thread only.
+*/
+static int SV_PrioritizeEntities(const client_t *client, const vec3_t org,
+                                 edict_t **edicts, int num_edicts, int max)
+{
+    static uint64_t keys[MAX_EDICTS], temp[MAX_EDICTS];
+    uint64_t cutoff;
+    int i, n, ties;
+
+    for (i = 0; i < num_edicts; i++)
+        keys[i] = temp[i] = SV_EntityPriority(client, org, edicts[i]);
+
+    cutoff = SV_SelectKey(temp, num_edicts, max - 1);
+
+    // entities with equal keys are taken in entity number order
+    ties = max;
+    for (i = 0; i < num_edicts; i++)
+        if (keys[i] < cutoff)
+            ties--;
+
+    for (i = n = 0; i < num_edicts; i++) {
+        if (keys[i] > cutoff)
+            continue;
+        if (keys[i] == cutoff) {
+            if (!ties)
+                continue;
+            ties--;
+        }
+        edicts[n++] = edicts[i];
+    }
 
-static int entpriocmp(const void *p1, const void *p2)
+    return n;
+}
+
+/*
+=============
+SV_BuildSendableEntities
+
+Client independent part of entity culling is done once per frame. Results
+are kept in parallel arrays, so that per client pass doesn't need to touch
+edicts that can't be sent anyway.
+=============
+*/
+
+#define SENT_NOCULL     BIT(0)  // SVF_NOCULL
+#define SENT_BEAM       BIT(1)  // RF_BEAM
+#define SENT_SOUND      BIT(2)  // has looping sound
+#define SENT_NOMODEL    BIT(3)  // no modelindex
+#define SENT_GIB        BIT(4)  // gib unless protocol extensions say otherwise
+#define SENT_ROCKETGIB  BIT(5)  // EF_GIB | EF_ROCKET, not a gib with extensions
+#define SENT_FLARE      BIT(6)  // RF_FLARE
+
+static struct {
+    const game_export_t *ge;
+    int         num_entities;
+    uint16_t    numbers[MAX_EDICTS];
+    uint8_t     flags[MAX_EDICTS];
+    int16_t     areas[MAX_EDICTS][2];
+} sendable;
+
+void SV_ClearSendableEntities(void)
 {
-    const edict_t *a = *(const edict_t **)p1;
-    const edict_t *b = *(const edict_t **)p2;
-
-    bool hi_a = IS_HI_PRIO(a);
-    bool hi_b = IS_HI_PRIO(b);
-    if (hi_a != hi_b)
-        return hi_b - hi_a;
-
-    bool lo_a = IS_LO_PRIO(a);
-    bool lo_b = IS_LO_PRIO(b);
-    if (lo_a != lo_b)
-        return lo_a - lo_b;
-
-    float dist_a = DistanceSquared(a->s.origin, clientorg);
-    float dist_b = DistanceSquared(b->s.origin, clientorg);
-    if (dist_a > dist_b)
-        return 1;
-    return -1;
+    sendable.ge = NULL;
 }
 
-static int entnumcmp(const void *p1, const void *p2)
+static void SV_BuildSendableEntities(const game_export_t *game)
 {
-    const edict_t *a = *(const edict_t **)p1;
-    const edict_t *b = *(const edict_t **)p2;
-    return a->s.number - b->s.number;
+    bool properinuse = g_features->integer & GMF_PROPERINUSE;
+    int e, n = 0;
+
+    for (e = 1; e < game->num_edicts; e++) {
+        edict_t *ent = EDICT_NUM2(game, e);
+        int flags = 0;
+
+        // ignore entities not in use
+        if (!ent->inuse && properinuse)
+            continue;
+
+        // ignore ents without visible models
+        if (ent->svflags & SVF_NOCLIENT)
+            continue;
+
+        // ignore ents without visible models unless they have an effect
+        if (!HAS_EFFECTS(ent))
+            continue;
+
+        SV_CheckEntityNumber(ent, e);
+
+        if (ent->svflags & SVF_NOCULL)
+            flags |= SENT_NOCULL;
+        if (ent->s.renderfx & RF_BEAM)
+            flags |= SENT_BEAM;
+        if (ent->s.sound)
+            flags |= SENT_SOUND;
+        if (!ent->s.modelindex)
+            flags |= SENT_NOMODEL;
+        if (ent->s.effects & EF_GREENGIB)
+            flags |= SENT_GIB;
+        else if (ent->s.effects & EF_GIB)
+            flags |= (ent->s.effects & EF_ROCKET) ? SENT_ROCKETGIB : SENT_GIB;
+        if (ent->s.renderfx & RF_FLARE)
+            flags |= SENT_FLARE;
+
+        sendable.numbers[n] = e;
+        sendable.flags[n] = flags;
+        sendable.areas[n][0] = ent->areanum;
+        sendable.areas[n][1] = ent->areanum2;
+        n++;
+    }
+
+    sendable.ge = game;
+    sendable.num_entities = n;
 }
 
 /*
@@ -539,6 +679,8 @@ void SV_BuildClientFrame(client_t *client)
     entity_packed_t *state;
     const mleaf_t   *leaf;
     int         clientarea, clientcluster;
+    int         skipflags;
+    bool        novis;
     byte        clientphs[VIS_MAX_BYTES];
     byte        clientpvs[VIS_MAX_BYTES];
     int         max_packet_entities;
@@ -611,70 +753,69 @@ void SV_BuildClientFrame(client_t *client)
     frame->num_entities = 0;
     frame->first_entity = client->next_entity;
 
-    num_edicts = 0;
-    for (e = 1; e < client->ge->num_edicts; e++) {
-        ent = EDICT_NUM2(client->ge, e);
-        svent = &sv.entities[e];
+    // MVD channels have their own edicts
+    if (sendable.ge != client->ge)
+        SV_BuildSendableEntities(client->ge);
 
-        // ignore entities not in use
-        if (!ent->inuse && (g_features->integer & GMF_PROPERINUSE))
-            continue;
+    skipflags = 0;
 
-        // ignore ents without visible models
-        if (ent->svflags & SVF_NOCLIENT)
-            continue;
+    // ignore gibs if client says so
+    if (client->settings[CLS_NOGIBS]) {
+        skipflags |= SENT_GIB;
+        if (!client->csr->extended)
+            skipflags |= SENT_ROCKETGIB;
+    }
 
-        // ignore ents without visible models unless they have an effect
-        if (!HAS_EFFECTS(ent))
-            continue;
+    // ignore flares if client says so
+    if (client->csr->extended && client->settings[CLS_NOFLARES])
+        skipflags |= SENT_FLARE;
 
-        // ignore gibs if client says so
-        if (client->settings[CLS_NOGIBS]) {
-            if (ent->s.effects & EF_GIB && !(client->csr->extended && ent->s.effects & EF_ROCKET))
-                continue;
-            if (ent->s.effects & EF_GREENGIB)
-                continue;
-        }
+    novis = sv_novis->integer;
+
+    num_edicts = 0;
+    for (i = 0; i < sendable.num_entities; i++) {
+        int flags = sendable.flags[i];
 
-        // ignore flares if client says so
-        if (client->csr->extended && ent->s.renderfx & RF_FLARE && client->settings[CLS_NOFLARES])
+        if (flags & skipflags)
             continue;
 
+        e = sendable.numbers[i];
+        ent = EDICT_NUM2(client->ge, e);
+
         // ignore if not touching a PV leaf
-        if (ent != clent && !sv_novis->integer && !(ent->svflags & SVF_NOCULL)) {
+        if (ent != clent && !novis && !(flags & SENT_NOCULL)) {
             // check area
-            if (!CM_AreasConnected(client->cm, clientarea, ent->areanum)) {
+            if (!CM_AreasConnected(client->cm, clientarea, sendable.areas[i][0])) {
                 // doors can legally straddle two areas, so
                 // we may need to check another one
-                if (!CM_AreasConnected(client->cm, clientarea, ent->areanum2)) {
+                if (!CM_AreasConnected(client->cm, clientarea, sendable.areas[i][1])) {
                     continue;        // blocked by a door
                 }
             }
 
             // beams just check one point for PHS
             // remaster uses different sound culling rules
-            bool beam_cull = ent->s.renderfx & RF_BEAM;
-            bool sound_cull = ent->s.sound;
+            bool beam_cull = flags & SENT_BEAM;
+            bool sound_cull = flags & SENT_SOUND;
 
+            svent = &sv.entities[e];
             if (!SV_EntityVisible(client, svent, (beam_cull || sound_cull) ? clientphs : clientpvs))
                 continue;
 
             // don't send sounds if they will be attenuated away
             if (sound_cull) {
                 if (SV_EntityAttenuatedAway(org, ent)) {
-                    if (!ent->s.modelindex)
+                    if (flags & SENT_NOMODEL)
                         continue;
                     if (!beam_cull && !SV_EntityVisible(client, svent, clientpvs))
                         continue;
                 }
-            } else if (!ent->s.modelindex) {
+            } else if (flags & SENT_NOMODEL) {
                 if (Distance(org, ent->s.origin) > 400)
                     continue;
             }
         }
 
-        SV_CheckEntityNumber(ent, e);
-
         // optionally skip it
         if (visible && !visible(clent, ent))
             continue;
@@ -687,14 +828,8 @@ void SV_BuildClientFrame(client_t *client)
 
     // prioritize entities on overflow
     if (num_edicts > max_packet_entities) {
-        VectorCopy(org, clientorg);
-        sv_client = client;
-        sv_player = client->edict;
-        qsort(edicts, num_edicts, sizeof(edicts[0]), entpriocmp);
-        sv_client = NULL;
-        sv_player = NULL;
-        num_edicts = max_packet_entities;
-        qsort(edicts, num_edicts, sizeof(edicts[0]), entnumcmp);
+        num_edicts = SV_PrioritizeEntities(client, org, edicts, num_edicts,
+                                           max_packet_entities);
     }
 
     for (i = 0; i < num_edicts; i++) {
@@ -754,6 +754,11 @@ static int PF_LoadFile(const char *path, void **buffer, unsigned flags, unsigned
     return FS_LoadFileEx(path, buffer, flags, tag + TAG_MAX);
 }
 
+static const world_trace_api_v1_t world_trace_api_v1 = {
+    .TraceWorld = SV_TraceWorld,
+    .TraceEntities = SV_TraceEntities,
+};
+
 static void *PF_GetExtension(const char *name);
 
 static void PF_Bot_RegisterEdict(const edict_t * edict)
@@ -1027,6 +1032,9 @@ static void *PF_GetExtension(const char *name)
     if (!strcmp(name, FILESYSTEM_API_V1))
         return (void *)&filesystem_api_v1;
 
+    if (!strcmp(name, WORLD_TRACE_API_V1))
+        return (void *)&world_trace_api_v1;
+
 #if USE_REF && USE_DEBUG
     if (!strcmp(name, DEBUG_DRAW_API_V1) && !dedicated->integer)
         return (void *)&debug_draw_api_v1;
@@ -39,6 +39,7 @@ static void sync_single_edict_server_to_game(int index);
 static void sync_edicts_server_to_game(void);
 static void sync_single_edict_game_to_server(int index);
 static void sync_edicts_game_to_server(void);
+static void mark_edict_dirty(const game3_edict_t *gent);
 
 static game_import_t game_import;
 
@@ -93,6 +94,43 @@ static const game_q2pro_customize_entity_t game_q2pro_customize_entity = {
 
 static edict_t *server_edicts;
 
+/* ClientThink() and ClientCommand() only sync the edicts the game passed to
+ * an import since the last sync, plus the calling client and anything newly
+ * spawned. Other changes are deferred until the next full sync. */
+static byte *edicts_dirty;
+static int *dirty_list;
+static int num_dirty;
+static bool edicts_pending;
+
+static cvar_t *sv_game3_sync_debug;
+
+static struct {
+    int full;
+    int partial;
+    int edicts;
+    int mismatches;
+} sync_stats;
+
+static void mark_edict_dirty(const game3_edict_t *gent)
+{
+    if (!gent || !edicts_dirty)
+        return;
+
+    int index = NUM_FOR_GAME_EDICT(gent);
+    if (edicts_dirty[index])
+        return;
+
+    edicts_dirty[index] = 1;
+    dirty_list[num_dirty++] = index;
+}
+
+static void clear_dirty_edicts(void)
+{
+    for (int i = 0; i < num_dirty; i++)
+        edicts_dirty[dirty_list[i]] = 0;
+    num_dirty = 0;
+}
+
 static edict_t *translate_edict_from_game(game3_edict_t *ent)
 {
     assert(!ent || (ent >= GAME_EDICT_NUM(0) && ent < GAME_EDICT_NUM(game3_export->num_edicts)));
@@ -113,6 +151,7 @@ static void wrap_multicast(const vec3_t origin, multicast_t to)
 static void wrap_unicast(game3_edict_t *gent, qboolean reliable)
 {
     edict_t *ent = translate_edict_from_game(gent);
+    mark_edict_dirty(gent);
     game_import.unicast(ent, reliable, 0);
 }
 
@@ -158,6 +197,7 @@ static void wrap_dprintf(const char *fmt, ...)
 static void wrap_cprintf(game3_edict_t *gent, int level, const char *fmt, ...)
 {
     edict_t *ent = translate_edict_from_game(gent);
+    mark_edict_dirty(gent);
 
     char        msg[MAX_STRING_CHARS];
     va_list     argptr;
@@ -175,6 +215,7 @@ static void wrap_cprintf(game3_edict_t *gent, int level, const char *fmt, ...)
 static void wrap_centerprintf(game3_edict_t *gent, const char *fmt, ...)
 {
     edict_t *ent = translate_edict_from_game(gent);
+    mark_edict_dirty(gent);
 
     char        msg[MAX_STRING_CHARS];
     va_list     argptr;
@@ -209,6 +250,7 @@ static void wrap_setmodel(game3_edict_t *gent, const char *name)
     game_export.num_edicts = game3_export->num_edicts;
 
     int ent_idx = NUM_FOR_GAME_EDICT(gent);
+    mark_edict_dirty(gent);
     sync_single_edict_game_to_server(ent_idx);
     game_import.setmodel(translate_edict_from_game(gent), name);
     sync_single_edict_server_to_game(ent_idx);
@@ -239,6 +281,7 @@ static void wrap_sound(game3_edict_t *gent, int channel,
                        float attenuation, float timeofs)
 {
     edict_t *ent = translate_edict_from_game(gent);
+    mark_edict_dirty(gent);
     game_import.sound(ent, channel, soundindex, volume, attenuation, timeofs);
 }
 
@@ -247,12 +290,14 @@ static void wrap_positioned_sound(const vec3_t origin, game3_edict_t *gent, int
                                   float attenuation, float timeofs)
 {
     edict_t *ent = translate_edict_from_game(gent);
+    mark_edict_dirty(gent);
     game_import.positioned_sound(origin, ent, channel, soundindex, volume, attenuation, timeofs);
 }
 
 static void wrap_unlinkentity(game3_edict_t *ent)
 {
     int ent_idx = NUM_FOR_GAME_EDICT(ent);
+    mark_edict_dirty(ent);
     sync_single_edict_game_to_server(ent_idx);
     game_import.unlinkentity(translate_edict_from_game(ent));
     sync_single_edict_server_to_game(ent_idx);
@@ -263,6 +308,7 @@ static void wrap_linkentity(game3_edict_t *ent)
     game_export.num_edicts = game3_export->num_edicts;
 
     int ent_idx = NUM_FOR_GAME_EDICT(ent);
+    mark_edict_dirty(ent);
     sync_single_edict_game_to_server(ent_idx);
     game_import.linkentity(translate_edict_from_game(ent));
     sync_single_edict_server_to_game(ent_idx);
@@ -294,12 +340,64 @@ static game3_trace_t wrap_trace(const vec3_t start, const vec3_t mins,
                                 const vec3_t maxs, const vec3_t end,
                                 game3_edict_t *passedict, int contentmask)
 {
+    mark_edict_dirty(passedict);
     trace_t str = game_import.trace(start, mins, maxs, end, translate_edict_from_game(passedict), contentmask);
     game3_trace_t tr;
     server_trace_to_game(&tr, &str);
     return tr;
 }
 
+static void game_trace_to_server(trace_t *str, const game3_trace_t *tr)
+{
+    memset(str, 0, sizeof(*str));
+    str->allsolid = tr->allsolid;
+    str->startsolid = tr->startsolid;
+    str->fraction = tr->fraction;
+    VectorCopy(tr->endpos, str->endpos);
+    str->plane = tr->plane;
+    str->surface = (csurface_t *)((byte *)tr->surface - q_offsetof(csurface_t, surface_v3));
+    str->contents = tr->contents;
+    str->ent = translate_edict_from_game(tr->ent);
+}
+
+static void wrap_TraceWorld(game3_worldtrace_t *traces, int count)
+{
+    worldtrace_t *wt = Z_Malloc(count * sizeof(*wt));
+    int i;
+
+    for (i = 0; i < count; i++) {
+        VectorCopy(traces[i].start, wt[i].start);
+        VectorCopy(traces[i].mins, wt[i].mins);
+        VectorCopy(traces[i].maxs, wt[i].maxs);
+        VectorCopy(traces[i].end, wt[i].end);
+        wt[i].contentmask = traces[i].contentmask;
+    }
+
+    SV_TraceWorld(wt, count);
+
+    for (i = 0; i < count; i++)
+        server_trace_to_game(&traces[i].trace, &wt[i].trace);
+
+    Z_Free(wt);
+}
+
+static void wrap_TraceEntities(game3_worldtrace_t *trace, game3_edict_t *passedict)
+{
+    worldtrace_t wt;
+
+    mark_edict_dirty(passedict);
+    VectorCopy(trace->start, wt.start);
+    VectorCopy(trace->mins, wt.mins);
+    VectorCopy(trace->maxs, wt.maxs);
+    VectorCopy(trace->end, wt.end);
+    wt.contentmask = trace->contentmask;
+    game_trace_to_server(&wt.trace, &trace->trace);
+
+    SV_TraceEntities(&wt, translate_edict_from_game(passedict));
+
+    server_trace_to_game(&trace->trace, &wt.trace);
+}
+
 static int wrap_pointcontents(const vec3_t point)
 {
     return game_import.pointcontents(point);
@@ -307,6 +405,7 @@ static int wrap_pointcontents(const vec3_t point)
 
 static void wrap_local_sound(game3_edict_t *target, const vec3_t origin, game3_edict_t *ent, int channel, int soundindex, float volume, float attenuation, float timeofs)
 {
+    mark_edict_dirty(ent);
     game_import.local_sound(translate_edict_from_game(target), origin, translate_edict_from_game(ent), channel, soundindex, volume, attenuation, timeofs, 0);
 }
 
@@ -458,9 +557,13 @@ static void sync_single_edict_server_to_game(int index)
     game_edict->owner = server_edict->owner ? GAME_EDICT_NUM(server_edict->owner - server_edicts) : NULL;
 }
 
+static void flush_pending_edicts(void);
+
 // Sync edicts from server to game
 static void sync_edicts_server_to_game(void)
 {
+    flush_pending_edicts();
+
     for (int i = 0; i < game_export.num_edicts; i++) {
         sync_single_edict_server_to_game(i);
     }
@@ -587,6 +690,129 @@ static void sync_edicts_game_to_server(void)
     }
 
     game_export.num_edicts = game3_export->num_edicts;
+
+    clear_dirty_edicts();
+    edicts_pending = false;
+    sync_stats.full++;
+    sync_stats.edicts += game3_export->num_edicts;
+}
+
+// Client pings are written by the server directly (SV_SetClient_Ping), so
+// a deferred sync must not overwrite them with what the game had before
+static void flush_single_edict_game_to_server(int index)
+{
+    struct gclient_s *client = server_edicts[index].client;
+    int ping = client ? client->ping : 0;
+
+    sync_single_edict_game_to_server(index);
+
+    if (client && client == server_edicts[index].client)
+        client->ping = ping;
+}
+
+// Catch up with changes deferred by partial syncs before the server side
+// gets copied over game edicts
+static void flush_pending_edicts(void)
+{
+    if (!edicts_pending)
+        return;
+
+    for (int i = 0; i < game3_export->num_edicts; i++) {
+        flush_single_edict_game_to_server(i);
+    }
+
+    game_export.num_edicts = game3_export->num_edicts;
+
+    clear_dirty_edicts();
+    edicts_pending = false;
+    sync_stats.full++;
+    sync_stats.edicts += game3_export->num_edicts;
+}
+
+static void refresh_single_edict_server_to_game(int index)
+{
+    if (edicts_pending)
+        flush_single_edict_game_to_server(index);
+    sync_single_edict_server_to_game(index);
+}
+
+static bool edict_sync_matches(const edict_t *old, const struct gclient_s *old_client, const edict_t *ent)
+{
+    if (old->client != ent->client)
+        return false;
+    if (old->client && memcmp(&old_client->ps, &ent->client->ps, sizeof(old_client->ps)))
+        return false;
+    if (old->client && old_client->clientNum != ent->client->clientNum)
+        return false;
+
+    return old->inuse == ent->inuse
+        && old->linked == ent->linked
+        && !memcmp(&old->s, &ent->s, sizeof(old->s))
+        && old->svflags == ent->svflags
+        && VectorCompare(old->mins, ent->mins)
+        && VectorCompare(old->maxs, ent->maxs)
+        && VectorCompare(old->absmin, ent->absmin)
+        && VectorCompare(old->absmax, ent->absmax)
+        && VectorCompare(old->size, ent->size)
+        && old->solid == ent->solid
+        && old->clipmask == ent->clipmask
+        && old->owner == ent->owner;
+}
+
+// Debug mode: do the full sync anyway and report edicts the partial sync
+// would have missed
+static void check_single_edict_game_to_server(int index)
+{
+    edict_t *ent = &server_edicts[index];
+    struct gclient_s old_client;
+    edict_t old;
+
+    memcpy(&old, ent, sizeof(old));
+    if (old.client)
+        memcpy(&old_client, old.client, sizeof(old_client));
+
+    flush_single_edict_game_to_server(index);
+
+    if (!edict_sync_matches(&old, &old_client, ent)) {
+        Com_WPrintf("Game changed edict %d without syncing it\n", index);
+        sync_stats.mismatches++;
+    }
+}
+
+// Sync edicts from game to server that may have changed since the last sync
+static void sync_dirty_edicts_game_to_server(int first_new)
+{
+    int num_edicts = game3_export->num_edicts;
+    int count = 0;
+
+    // newly spawned edicts may not have gone through any import yet
+    for (int i = first_new; i < num_edicts; i++) {
+        mark_edict_dirty(GAME_EDICT_NUM(i));
+    }
+
+    if (sv_game3_sync_debug->integer) {
+        for (int i = 0; i < num_edicts; i++) {
+            if (!edicts_dirty[i])
+                check_single_edict_game_to_server(i);
+        }
+    }
+
+    for (int i = 0; i < num_dirty; i++) {
+        int index = dirty_list[i];
+        if (index < num_edicts) {
+            sync_single_edict_game_to_server(index);
+            count++;
+        }
+        edicts_dirty[index] = 0;
+    }
+    num_dirty = 0;
+
+    game_export.num_edicts = num_edicts;
+
+    // in debug mode everything has been synced already
+    edicts_pending = !sv_game3_sync_debug->integer;
+    sync_stats.partial++;
+    sync_stats.edicts += count;
 }
 
 static void wrap_PreInit(void) { }
@@ -617,6 +843,13 @@ static void wrap_Init(void)
     game_export.max_edicts = game3_export->max_edicts;
     game_export.num_edicts = game3_export->num_edicts;
 
+    edicts_dirty = Z_Mallocz(game3_export->max_edicts);
+    dirty_list = Z_Malloc(sizeof(dirty_list[0]) * game3_export->max_edicts);
+    num_dirty = 0;
+    edicts_pending = false;
+
+    sv_game3_sync_debug = Cvar_Get("sv_game3_sync_debug", "0", 0);
+
     sync_edicts_game_to_server();
 }
 
@@ -629,6 +862,13 @@ static void wrap_Shutdown(void)
     }
     Z_Free(server_edicts);
     server_edicts = NULL;
+
+    Z_Free(edicts_dirty);
+    edicts_dirty = NULL;
+    Z_Free(dirty_list);
+    dirty_list = NULL;
+    num_dirty = 0;
+    edicts_pending = false;
 }
 
 static void wrap_SpawnEntities(const char *mapname, const char *entstring, const char *spawnpoint)
@@ -835,7 +1075,7 @@ static edict_t *game_ClientChooseSlot (const char *userinfo, const char *social_
 static bool wrap_ClientConnect(edict_t *ent, char *userinfo, const char *social_id, bool isBot)
 {
     int ent_idx = NUM_FOR_EDICT(ent);
-    sync_single_edict_server_to_game(ent_idx);
+    refresh_single_edict_server_to_game(ent_idx);
     bool result = game3_export->ClientConnect(translate_edict_to_game(ent), userinfo);
     sync_single_edict_game_to_server(ent_idx);
     game_export.num_edicts = game3_export->num_edicts;
@@ -845,7 +1085,7 @@ static bool wrap_ClientConnect(edict_t *ent, char *userinfo, const char *social_
 static void wrap_ClientBegin(edict_t *ent)
 {
     int ent_idx = NUM_FOR_EDICT(ent);
-    sync_single_edict_server_to_game(ent_idx);
+    refresh_single_edict_server_to_game(ent_idx);
     game3_export->ClientBegin(translate_edict_to_game(ent));
     sync_single_edict_game_to_server(ent_idx);
     game_export.num_edicts = game3_export->num_edicts;
@@ -854,7 +1094,7 @@ static void wrap_ClientBegin(edict_t *ent)
 static void wrap_ClientUserinfoChanged(edict_t *ent, const char *userinfo)
 {
     int ent_idx = NUM_FOR_EDICT(ent);
-    sync_single_edict_server_to_game(ent_idx);
+    refresh_single_edict_server_to_game(ent_idx);
     game3_export->ClientUserinfoChanged(translate_edict_to_game(ent), (char*)userinfo);
     sync_single_edict_game_to_server(ent_idx);
     game_export.num_edicts = game3_export->num_edicts;
@@ -863,7 +1103,7 @@ static void wrap_ClientUserinfoChanged(edict_t *ent, const char *userinfo)
 static void wrap_ClientDisconnect(edict_t *ent)
 {
     int ent_idx = NUM_FOR_EDICT(ent);
-    sync_single_edict_server_to_game(ent_idx);
+    refresh_single_edict_server_to_game(ent_idx);
     game3_export->ClientDisconnect(translate_edict_to_game(ent));
     sync_single_edict_game_to_server(ent_idx);
     game_export.num_edicts = game3_export->num_edicts;
@@ -871,24 +1111,37 @@ static void wrap_ClientDisconnect(edict_t *ent)
 
 static void wrap_ClientCommand(edict_t *ent)
 {
-    // ClientCommand() may spawn new entitities, so sync them all
-    sync_edicts_server_to_game();
+    int ent_idx = NUM_FOR_EDICT(ent);
+    int first_new = game3_export->num_edicts;
+
+    refresh_single_edict_server_to_game(ent_idx);
+    mark_edict_dirty(GAME_EDICT_NUM(ent_idx));
     game3_export->ClientCommand(translate_edict_to_game(ent));
-    sync_edicts_game_to_server();
+    sync_dirty_edicts_game_to_server(first_new);
 }
 
 static void wrap_ClientThink(edict_t *ent, usercmd_t *cmd)
 {
-    // ClientThink() may spawn new entitities, so sync them all
-    sync_edicts_server_to_game();
+    int ent_idx = NUM_FOR_EDICT(ent);
+    int first_new = game3_export->num_edicts;
+
+    // called for every usercmd, so don't sync all edicts here
+    refresh_single_edict_server_to_game(ent_idx);
+    mark_edict_dirty(GAME_EDICT_NUM(ent_idx));
     game3_usercmd_t game_cmd;
     ConvertToGame3_usercmd(&game_cmd, cmd);
     game3_export->ClientThink(translate_edict_to_game(ent), &game_cmd);
-    sync_edicts_game_to_server();
+    sync_dirty_edicts_game_to_server(first_new);
 }
 
 static void wrap_RunFrame(bool main_loop)
 {
+    if (sv_game3_sync_debug->integer > 1) {
+        Com_Printf("game3 sync: %d full, %d partial, %d edicts, %d mismatches\n",
+                   sync_stats.full, sync_stats.partial, sync_stats.edicts, sync_stats.mismatches);
+    }
+    memset(&sync_stats, 0, sizeof(sync_stats));
+
     sync_edicts_server_to_game();
     game3_export->RunFrame();
     sync_edicts_game_to_server();
@@ -915,7 +1168,9 @@ static void wrap_ServerCommand(void)
 
 static void *wrap_GetExtension_export(const char *name)
 {
-    if (game3_export_ex && strcmp(name, game_q2pro_restart_filesystem_ext) == 0) {
+    if (game3_export_ex
+        && game3_export_ex->RestartFilesystem
+        && strcmp(name, game_q2pro_restart_filesystem_ext) == 0) {
         return (void*)&game_q2pro_restart_filesystem;
     }
     if (game3_export_ex
@@ -967,6 +1222,9 @@ static const game3_import_ex_t game3_import_ex = {
 
     .GetExtension = wrap_GetExtension_import,
     .TagRealloc = PF_TagRealloc,
+
+    .TraceWorld = wrap_TraceWorld,
+    .TraceEntities = wrap_TraceEntities,
 };
 
 game_export_t *GetGame3Proxy(game_import_t *import, void *game3_entry, void *game3_ex_entry)
@@ -126,6 +126,8 @@ void SV_SpawnServer(const mapcmd_t *cmd)
 
     // wipe the entire per-level structure
     memset(&sv, 0, sizeof(sv));
+
+    SV_CaptureSpawn(cmd);
     sv.spawncount = Q_rand() & INT_MAX;
 
     // set legacy spawncounts
@@ -0,0 +1,477 @@
+/*
+Copyright (C) 2026 agent <agent@local>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+//
+// loadgen.c -- synthetic UDP clients for server benchmarking
+//
+// Each bot owns a UDP socket on 127.0.0.1 and talks to the server socket
+// exactly like a remote client would, so its packets go through the full
+// SV_PacketEvent -> SV_ExecuteClientMessage -> SV_SendClientMessages path.
+// Bots don't parse server messages: what a real client would learn from
+// svc_serverdata and svc_frame (spawncount, frame number) is looked up from
+// the server side directly.
+//
+
+#include "server.h"
+
+#define MAX_BOTS        255     // qport is a single byte
+#define BOT_RESEND      1000    // msec between handshake retries
+
+typedef enum {
+    BOT_IDLE,           // waiting for its turn to connect
+    BOT_CHALLENGING,
+    BOT_CONNECTING,
+    BOT_CONNECTED
+} botstate_t;
+
+typedef struct {
+    botstate_t      state;
+    struct pollfd   *socket;
+    netadr_t        address;
+    netchan_t       netchan;
+    int             qport;
+    unsigned        challenge;
+    unsigned        last_send;      // for handshake retries
+    uint32_t        seed;
+    usercmd_t       cmd, oldcmd;
+    int             framenum;       // last server frame a move was sent for
+    unsigned        packets_sent;
+    unsigned        packets_rcvd;
+} bot_t;
+
+static struct {
+    bot_t       *bots;
+    int         count;
+    netadr_t    server;
+    unsigned    start_time;
+} lg;
+
+static bot_t    *lg_current;    // for packet callback
+
+static uint32_t bot_rand(bot_t *bot)
+{
+    // xorshift32, so that runs are reproducible for given seed
+    uint32_t x = bot->seed;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return bot->seed = x;
+}
+
+q_printf(2, 3)
+static void bot_oob(bot_t *bot, const char *fmt, ...)
+{
+    char buffer[MAX_PACKETLEN_DEFAULT];
+    va_list argptr;
+    size_t len;
+
+    memcpy(buffer, "\xff\xff\xff\xff", 4);
+
+    va_start(argptr, fmt);
+    len = Q_vsnprintf(buffer + 4, sizeof(buffer) - 4, fmt, argptr);
+    va_end(argptr);
+
+    if (len >= sizeof(buffer) - 4)
+        return;
+
+    NET_SendUdp(bot->socket, buffer, len + 4, &lg.server);
+    bot->last_send = svs.realtime;
+    bot->packets_sent++;
+}
+
+// sends contents of msg_write as a sequenced packet
+static void bot_transmit(bot_t *bot)
+{
+    netchan_t *chan = &bot->netchan;
+    byte buffer[MAX_PACKETLEN];
+    sizebuf_t send;
+    unsigned w2;
+
+    // header is written by hand because netchan can't transmit over
+    // private sockets; only unreliable data is ever sent by bots
+    w2 = chan->incoming_sequence;
+    if (chan->incoming_reliable_sequence)
+        w2 |= BIT(31);
+
+    SZ_Init(&send, buffer, sizeof(buffer), "loadgen");
+    SZ_WriteLong(&send, chan->outgoing_sequence);
+    SZ_WriteLong(&send, w2);
+    SZ_WriteByte(&send, chan->qport);
+    SZ_Write(&send, msg_write.data, msg_write.cursize);
+    SZ_Clear(&msg_write);
+
+    NET_SendUdp(bot->socket, send.data, send.cursize, &chan->remote_address);
+    chan->outgoing_sequence++;
+    chan->last_sent = com_localTime;
+    bot->packets_sent++;
+}
+
+static void bot_stringcmd(const char *s)
+{
+    MSG_WriteByte(clc_stringcmd);
+    MSG_WriteString(s);
+}
+
+static void bot_think(bot_t *bot)
+{
+    usercmd_t *cmd = &bot->cmd;
+
+    bot->oldcmd = *cmd;
+
+    // pick new direction about once a second
+    if (bot_rand(bot) % SV_FRAMERATE == 0) {
+        cmd->forwardmove = ((int)(bot_rand(bot) % 3) - 1) * 400;
+        cmd->sidemove = ((int)(bot_rand(bot) % 3) - 1) * 400;
+    }
+
+    cmd->angles[YAW] = anglemod(cmd->angles[YAW] + (int)(bot_rand(bot) % 21) - 10);
+    cmd->angles[PITCH] = Q_clipf(cmd->angles[PITCH] + (int)(bot_rand(bot) % 5) - 2, -45, 45);
+
+    cmd->buttons = 0;
+    if (bot_rand(bot) % 4 == 0)
+        cmd->buttons |= BUTTON_ATTACK;
+    if (bot_rand(bot) % 32 == 0)
+        cmd->buttons |= BUTTON_JUMP;
+
+    cmd->msec = SV_FRAMETIME;
+}
+
+static void bot_send_move(bot_t *bot, const client_t *cl)
+{
+    bot_think(bot);
+
+    // also resets bit writer state
+    MSG_BeginWriting();
+
+    // claim previous frame was received, so that server deltas from it
+    MSG_WriteByte(clc_move_batched);
+    MSG_WriteLong(cl->framenum - 1);
+    MSG_WriteByte(1);   // one duplicate frame, like cl_packetdup 1
+    MSG_WriteByte(0);   // lightlevel
+
+    MSG_WriteBits(1, 5);
+    MSG_WriteDeltaUsercmd_Enhanced(NULL, &bot->oldcmd, PROTOCOL_VERSION_RERELEASE);
+    MSG_WriteBits(1, 5);
+    MSG_WriteDeltaUsercmd_Enhanced(&bot->oldcmd, &bot->cmd, PROTOCOL_VERSION_RERELEASE);
+    MSG_FlushBits();
+}
+
+static client_t *bot_client(const bot_t *bot)
+{
+    client_t *cl;
+
+    FOR_EACH_CLIENT(cl)
+        if (NET_IsEqualAdr(&cl->netchan.remote_address, &bot->address))
+            return cl;
+
+    return NULL;
+}
+
+static void bot_reset(bot_t *bot)
+{
+    Netchan_Close(&bot->netchan);
+    bot->state = BOT_IDLE;
+    bot->last_send = 0;
+}
+
+static void bot_packet(void)
+{
+    bot_t *bot = lg_current;
+    char string[MAX_STRING_CHARS];
+    char *c;
+
+    bot->packets_rcvd++;
+
+    if (msg_read.cursize < 4)
+        return;
+
+    if (*(int *)msg_read.data != -1) {
+        // only needed to acknowledge sequences and reliable data
+        if (bot->state == BOT_CONNECTED)
+            Netchan_Process(&bot->netchan);
+        return;
+    }
+
+    MSG_BeginReading();
+    MSG_ReadLong();
+    MSG_ReadStringLine(string, sizeof(string));
+
+    Cmd_TokenizeString(string, false);
+    c = Cmd_Argv(0);
+
+    if (!strcmp(c, "challenge")) {
+        if (bot->state != BOT_CHALLENGING)
+            return;
+        bot->challenge = Q_atoi(Cmd_Argv(1));
+        bot->state = BOT_CONNECTING;
+        bot->last_send = 0;
+        return;
+    }
+
+    if (!strcmp(c, "client_connect")) {
+        if (bot->state != BOT_CONNECTING)
+            return;
+        Netchan_Setup(&bot->netchan, NS_CLIENT, NETCHAN_NEW, &lg.server,
+                      bot->qport, MAX_PACKETLEN_WRITABLE, PROTOCOL_VERSION_RERELEASE);
+        bot->state = BOT_CONNECTED;
+        bot->last_send = 0;
+        return;
+    }
+
+    if (!strcmp(c, "print")) {
+        MSG_ReadString(string, sizeof(string));
+        Com_WPrintf("loadgen%d: %s", (int)(bot - lg.bots), string);
+        return;
+    }
+}
+
+static void bot_run(bot_t *bot)
+{
+    client_t *cl;
+
+    lg_current = bot;
+    NET_GetUdp(bot->socket, bot_packet);
+
+    switch (bot->state) {
+    case BOT_IDLE:
+        break;
+
+    case BOT_CHALLENGING:
+        if (!bot->last_send || svs.realtime - bot->last_send >= BOT_RESEND)
+            bot_oob(bot, "getchallenge\n");
+        break;
+
+    case BOT_CONNECTING:
+        if (!bot->last_send || svs.realtime - bot->last_send >= BOT_RESEND)
+            bot_oob(bot, "connect %d %d %u \"\\name\\loadgen%d\\skin\\male/grunt"
+                    "\\rate\\100000\\hand\\2\" 0 1\n", PROTOCOL_VERSION_RERELEASE,
+                    bot->qport, bot->challenge, (int)(bot - lg.bots));
+        break;
+
+    case BOT_CONNECTED:
+        cl = bot_client(bot);
+        if (!cl || cl->state == cs_zombie) {
+            // kicked or timed out, start over
+            bot_reset(bot);
+            break;
+        }
+
+        if (bot->framenum == sv.framenum)
+            break;
+        bot->framenum = sv.framenum;
+
+        // walk through the connection stages like a real client would, but
+        // let the server decide when to advance
+        if (cl->state < cs_spawned) {
+            if (!bot->last_send || svs.realtime - bot->last_send >= BOT_RESEND) {
+                if (cl->state < cs_primed) {
+                    bot_stringcmd("new");
+                    bot_stringcmd("\177c version q2pro-loadgen");
+                } else {
+                    bot_stringcmd(va("begin %i", cl->spawncount));
+                }
+                bot->last_send = svs.realtime;
+            }
+            MSG_WriteByte(clc_nop);
+        } else {
+            bot_send_move(bot, cl);
+        }
+
+        bot_transmit(bot);
+        break;
+    }
+}
+
+/*
+==================
+SV_RunLoadgen
+
+Called each server tick before reading packets.
+==================
+*/
+void SV_RunLoadgen(void)
+{
+    bot_t *bot;
+    bool handshaking = false;
+    int i;
+
+    if (!lg.count)
+        return;
+
+    for (i = 0, bot = lg.bots; i < lg.count; i++, bot++) {
+        bot_run(bot);
+        if (bot->state == BOT_CHALLENGING || bot->state == BOT_CONNECTING)
+            handshaking = true;
+    }
+
+    // challenges are kept per IP address, so bots must connect one by one
+    if (handshaking)
+        return;
+
+    for (i = 0, bot = lg.bots; i < lg.count; i++, bot++) {
+        if (bot->state == BOT_IDLE) {
+            bot->state = BOT_CHALLENGING;
+            bot_run(bot);
+            break;
+        }
+    }
+}
+
+/*
+==================
+SV_StopLoadgen
+==================
+*/
+void SV_StopLoadgen(void)
+{
+    bot_t *bot;
+    int i;
+
+    for (i = 0, bot = lg.bots; i < lg.count; i++, bot++) {
+        if (bot->state == BOT_CONNECTED) {
+            bot_stringcmd("disconnect");
+            bot_transmit(bot);
+        }
+        Netchan_Close(&bot->netchan);
+        NET_CloseUdp(bot->socket);
+    }
+
+    Z_Freep(&lg.bots);
+    lg.count = 0;
+}
+
+static void SV_Loadgen_f(void)
+{
+    bot_t *bot;
+    int i, count;
+
+    if (Cmd_Argc() < 2) {
+        Com_Printf("Usage: %s <count> [seed]\n"
+                   "       %s stop\n", Cmd_Argv(0), Cmd_Argv(0));
+        return;
+    }
+
+    if (!strcmp(Cmd_Argv(1), "stop")) {
+        if (lg.count)
+            Com_Printf("Stopped %d synthetic clients.\n", lg.count);
+        SV_StopLoadgen();
+        return;
+    }
+
+    if (!svs.initialized) {
+        Com_Printf("No server running.\n");
+        return;
+    }
+
+    if (lg.count) {
+        Com_Printf("Load generator is already running.\n");
+        return;
+    }
+
+    if (!NET_GetAddress(NS_SERVER, &lg.server) || lg.server.type != NA_IP) {
+        Com_Printf("Server IPv4 UDP socket is not open.\n");
+        return;
+    }
+
+    // bound to all interfaces?
+    if (!lg.server.ip.u32[0])
+        lg.server.ip.u32[0] = BigLong(0x7f000001);
+
+    count = Q_atoi(Cmd_Argv(1));
+    if (count < 1 || count > MAX_BOTS) {
+        Com_Printf("Count must be between 1 and %d.\n", MAX_BOTS);
+        return;
+    }
+
+    if (sv_iplimit->integer > 0 && count > sv_iplimit->integer)
+        Com_WPrintf("sv_iplimit is %d, set it to 0 to connect more clients.\n",
+                    sv_iplimit->integer);
+
+    lg.bots = Z_Mallocz(sizeof(lg.bots[0]) * count);
+    for (i = 0, bot = lg.bots; i < count; i++, bot++) {
+        bot->socket = NET_OpenUdp("127.0.0.1", PORT_ANY);
+        if (!bot->socket || !NET_GetUdpAddress(bot->socket, &bot->address)) {
+            Com_EPrintf("Couldn't open socket for synthetic client.\n");
+            if (bot->socket)
+                NET_CloseUdp(bot->socket);
+            break;
+        }
+        bot->qport = i + 1;
+        bot->seed = Q_atoi(Cmd_Argv(2)) * MAX_BOTS + i + 1;
+    }
+
+    if (!i) {
+        Z_Freep(&lg.bots);
+        return;
+    }
+
+    lg.count = i;
+    lg.start_time = svs.realtime;
+
+    Com_Printf("Started %d synthetic clients.\n", lg.count);
+}
+
+static void SV_LoadgenStatus_f(void)
+{
+    const bot_t *bot;
+    const client_t *cl;
+    int i;
+
+    if (!lg.count) {
+        Com_Printf("Load generator is not running.\n");
+        return;
+    }
+
+    Com_Printf("%d synthetic clients, running for %u sec\n"
+               "num state        sent     rcvd\n"
+               "--- ---------- -------- --------\n",
+               lg.count, (svs.realtime - lg.start_time) / 1000);
+
+    for (i = 0, bot = lg.bots; i < lg.count; i++, bot++) {
+        const char *s;
+
+        switch (bot->state) {
+        case BOT_IDLE:
+            s = "idle";
+            break;
+        case BOT_CHALLENGING:
+            s = "challenge";
+            break;
+        case BOT_CONNECTING:
+            s = "connect";
+            break;
+        default:
+            cl = bot_client(bot);
+            s = cl && cl->state == cs_spawned ? "spawned" : "precache";
+            break;
+        }
+
+        Com_Printf("%3d %-10s %8u %8u\n", i, s, bot->packets_sent, bot->packets_rcvd);
+    }
+}
+
+static const cmdreg_t c_loadgen[] = {
+    { "loadgen", SV_Loadgen_f },
+    { "loadgenstatus", SV_LoadgenStatus_f },
+    { NULL }
+};
+
+void SV_RegisterLoadgen(void)
+{
+    Cmd_Register(c_loadgen);
+}
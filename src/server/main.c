@@ -79,6 +79,7 @@ cvar_t  *sv_max_download_size;
 cvar_t  *sv_max_packet_entities;
 cvar_t  *sv_trunc_packet_entities;
 cvar_t  *sv_prioritize_entities;
+cvar_t  *sv_overload_budget;
 
 cvar_t  *sv_strafejump_hack;
 cvar_t  *sv_waterjump_hack;
@@ -1430,6 +1431,8 @@ static void SV_PacketEvent(void)
         return;
     }
 
+    SV_CapturePacket();
+
     // check for connectionless packet (0xffffffff) first
     // connectionless packets are processed even if the server is down
     if (*(int *)msg_read.data == -1) {
@@ -1805,18 +1808,13 @@ static void SV_MasterShutdown(void)
     }
 }
 
-/*
-==================
-SV_Frame
+// time spent processing client input since the last server frame
+static uint64_t input_usec;
 
-Some things like MVD client connections and command buffer
-processing are run even when server is not yet initalized.
-
-Returns amount of extra frametime available for sleeping on IO.
-==================
-*/
-unsigned SV_Frame(unsigned msec)
+static unsigned run_frame(unsigned msec)
 {
+    uint64_t prof, input;
+
 #if USE_CLIENT
     time_before_game = time_after_game = 0;
 #endif
@@ -1834,10 +1832,19 @@ unsigned SV_Frame(unsigned msec)
     MVD_Frame();
 #endif
 
+    // let synthetic clients send their packets
+    SV_RunLoadgen();
+
     // read packets from UDP clients
-    NET_GetPackets(NS_SERVER, SV_PacketEvent);
+    input = Sys_Microseconds();
+    prof = SV_ProfileBegin();
+    if (!SV_CaptureReplayPackets(SV_PacketEvent))
+        NET_GetPackets(NS_SERVER, SV_PacketEvent);
+    SV_ProfileAdd(PROF_PACKETS, prof);
 
     if (svs.initialized) {
+        prof = SV_ProfileBegin();
+
         // run connection to the anticheat server
         AC_Run();
 
@@ -1846,8 +1853,12 @@ unsigned SV_Frame(unsigned msec)
 
         // deliver fragments and reliable messages for connecting clients
         SV_SendAsyncPackets();
+
+        SV_ProfileAdd(PROF_ASYNC, prof);
     }
 
+    input_usec += Sys_Microseconds() - input;
+
     // move autonomous things around if enough time has passed
     sv.frameresidual += msec;
     if (sv.frameresidual < SV_FRAMETIME) {
@@ -1855,6 +1866,12 @@ unsigned SV_Frame(unsigned msec)
     }
 
     if (svs.initialized && !check_paused()) {
+        uint64_t frame = SV_ProfileBegin();
+        uint64_t start = Sys_Microseconds();
+
+        SV_ProfileFlush(PROF_PACKETS);
+        SV_ProfileFlush(PROF_ASYNC);
+
         // check timeouts
         SV_CheckTimeouts();
 
@@ -1865,10 +1882,14 @@ unsigned SV_Frame(unsigned msec)
         SV_GiveMsec();
 
         // let everything in the world think and move
+        prof = SV_ProfileBegin();
         SV_RunGameFrame();
+        SV_ProfileEnd(PROF_GAME, prof, -1);
 
         // send messages back to the UDP clients
+        prof = SV_ProfileBegin();
         SV_SendClientMessages();
+        SV_ProfileEnd(PROF_SEND, prof, -1);
 
         // send a heartbeat to the master if needed
         SV_MasterHeartbeat();
@@ -1876,10 +1897,21 @@ unsigned SV_Frame(unsigned msec)
         // clear teleport flags, etc for next frame
         SV_PrepWorldFrame();
 
+        // see if some clients should get less updates. client moves and
+        // commands are executed while reading packets, so count them too.
+        unsigned usec = Sys_Microseconds() - start + input_usec;
+        SV_UpdateOverload(usec);
+        SV_MetricsFrame(usec);
+        SV_RunMetrics();
+
+        SV_ProfileEnd(PROF_FRAME, frame, -1);
+
         // advance for next frame
         sv.framenum++;
     }
 
+    input_usec = 0;
+
     if (COM_DEDICATED) {
         // run cmd buffer in dedicated mode
         Cbuf_Frame(&cmd_buffer);
@@ -1900,6 +1932,31 @@ unsigned SV_Frame(unsigned msec)
     return 0;
 }
 
+/*
+==================
+SV_Frame
+
+Some things like MVD client connections and command buffer
+processing are run even when server is not yet initalized.
+
+Returns amount of extra frametime available for sleeping on IO.
+==================
+*/
+unsigned SV_Frame(unsigned msec)
+{
+    uint64_t start;
+
+    // replay recorded input as fast as possible
+    if (SV_CaptureFrame(&msec)) {
+        start = Sys_Microseconds();
+        run_frame(msec);
+        SV_CaptureFrameTime(Sys_Microseconds() - start);
+        return 0;
+    }
+
+    return run_frame(msec);
+}
+
 //============================================================================
 
 /*
@@ -2077,6 +2134,12 @@ void SV_Init(void)
 
     SV_RegisterSavegames();
 
+    SV_RegisterProfile();
+    SV_RegisterDownloads();
+    SV_RegisterMetrics();
+    SV_RegisterLoadgen();
+    SV_RegisterCapture();
+
     Cvar_Get("protocol", STRINGIFY(PROTOCOL_VERSION_DEFAULT), CVAR_SERVERINFO | CVAR_ROM);
 
     Cvar_Get("skill", "1", CVAR_LATCH);
@@ -2141,6 +2204,7 @@ void SV_Init(void)
     sv_max_packet_entities = Cvar_Get("sv_max_packet_entities", "0", 0);
     sv_trunc_packet_entities = Cvar_Get("sv_trunc_packet_entities", "1", 0);
     sv_prioritize_entities = Cvar_Get("sv_prioritize_entities", "0", 0);
+    sv_overload_budget = Cvar_Get("sv_overload_budget", "0", 0);
 
     sv_strafejump_hack = Cvar_Get("sv_strafejump_hack", "1", CVAR_LATCH);
     sv_waterjump_hack = Cvar_Get("sv_waterjump_hack", "1", CVAR_LATCH);
@@ -2293,6 +2357,10 @@ void SV_Shutdown(const char *finalmsg, error_type_t type)
 
     AC_Disconnect();
 
+    SV_StopLoadgen();
+
+    SV_CaptureStop();
+
     SV_MvdShutdown(type);
 
     SV_FinalMessage(finalmsg, type);
@@ -2306,6 +2374,7 @@ void SV_Shutdown(const char *finalmsg, error_type_t type)
 
     // free server static data
     Z_Free(svs.client_pool);
+    SV_FlushDownloads();
 #if USE_ZLIB
     deflateEnd(&svs.z);
     Z_Free(svs.z_buffer);
@@ -0,0 +1,323 @@
+/*
+Copyright (C) 2026 agent <agent@local>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+//
+// metrics.c -- server metrics in Prometheus text format
+//
+
+#include "server.h"
+
+// histogram bucket upper bounds
+static const unsigned frame_bounds[] = { 1000, 2500, 5000, 10000, 25000, 50000, 100000 };
+static const unsigned snapshot_bounds[] = { 64, 128, 256, 512, 1024, 1400, 2048, 4096 };
+
+typedef struct {
+    uint64_t    count;
+    uint64_t    sum;
+    uint64_t    buckets[9];
+} histogram_t;
+
+static struct {
+    histogram_t frame_usec;
+    histogram_t snapshot_bytes;
+    uint64_t    snapshot_entities;
+} met;
+
+// output buffer
+static char     *met_data;
+static size_t   met_len, met_size;
+static unsigned met_write_time;
+
+cvar_t  *sv_metrics;
+static cvar_t   *sv_metrics_file;
+static cvar_t   *sv_metrics_interval;
+
+static void hist_add(histogram_t *h, const unsigned *bounds, int numbounds, unsigned value)
+{
+    int i;
+
+    for (i = 0; i < numbounds; i++)
+        if (value <= bounds[i])
+            break;
+
+    Q_assert(i < q_countof(h->buckets));
+    h->buckets[i]++;
+    h->count++;
+    h->sum += value;
+}
+
+void SV_MetricsFrame(unsigned usec)
+{
+    hist_add(&met.frame_usec, frame_bounds, q_countof(frame_bounds), usec);
+}
+
+void SV_MetricsSnapshot(client_t *client, unsigned size)
+{
+    const client_frame_t *frame = &client->frames[client->framenum & UPDATE_MASK];
+
+    hist_add(&met.snapshot_bytes, snapshot_bounds, q_countof(snapshot_bounds), size);
+    met.snapshot_entities += frame->num_entities;
+}
+
+/*
+==============================================================================
+
+TEXT OUTPUT
+
+==============================================================================
+*/
+
+void SV_MetricsPrintf(const char *fmt, ...)
+{
+    va_list argptr;
+    size_t len;
+
+    while (1) {
+        va_start(argptr, fmt);
+        len = Q_vsnprintf(met_data + met_len, met_size - met_len, fmt, argptr);
+        va_end(argptr);
+
+        if (len < met_size - met_len)
+            break;
+
+        met_size = max(met_size * 2, met_len + len + 1);
+        met_data = Z_Realloc(met_data, met_size);
+    }
+
+    met_len += len;
+}
+
+void SV_MetricsHeader(const char *name, const char *type, const char *help)
+{
+    SV_MetricsPrintf("# HELP q2pro_%s %s\n# TYPE q2pro_%s %s\n", name, help, name, type);
+}
+
+// returns label value escaped in static buffer
+const char *SV_MetricsLabel(const char *s)
+{
+    static char buffer[MAX_CLIENT_NAME * 2];
+    char *p = buffer;
+
+    while (*s && p < buffer + sizeof(buffer) - 2) {
+        int c = *s++;
+        if (c == '\\' || c == '"') {
+            *p++ = '\\';
+        } else if (!Q_isprint(c)) {
+            c = '_';
+        }
+        *p++ = c;
+    }
+    *p = 0;
+
+    return buffer;
+}
+
+static void write_histogram(const char *name, const char *help, const histogram_t *h,
+                            const unsigned *bounds, int numbounds, double scale)
+{
+    uint64_t total = 0;
+    int i;
+
+    SV_MetricsHeader(name, "histogram", help);
+    for (i = 0; i < numbounds; i++) {
+        total += h->buckets[i];
+        SV_MetricsPrintf("q2pro_%s_bucket{le=\"%g\"} %"PRIu64"\n", name, bounds[i] * scale, total);
+    }
+    SV_MetricsPrintf("q2pro_%s_bucket{le=\"+Inf\"} %"PRIu64"\n", name, h->count);
+    SV_MetricsPrintf("q2pro_%s_sum %g\n", name, h->sum * scale);
+    SV_MetricsPrintf("q2pro_%s_count %"PRIu64"\n", name, h->count);
+}
+
+static void write_server(void)
+{
+    int states[cs_spawned + 1] = { 0 };
+    static const char *const statenames[] = {
+        "free", "zombie", "assigned", "connected", "primed", "spawned"
+    };
+    client_t *client;
+    int i;
+
+    write_histogram("frame_seconds", "Server frame time.", &met.frame_usec,
+                    frame_bounds, q_countof(frame_bounds), 1e-6);
+
+    SV_MetricsHeader("frame_usec_smoothed", "gauge", "Smoothed server frame time in microseconds.");
+    SV_MetricsPrintf("q2pro_frame_usec_smoothed %u\n", svs.overload.frame_usec);
+
+    SV_MetricsHeader("overload_active", "gauge", "Whether server is reducing updates due to overload.");
+    SV_MetricsPrintf("q2pro_overload_active %d\n", svs.overload.active);
+
+    SV_MetricsHeader("overload_frames_skipped_total", "counter", "Client frames skipped due to overload.");
+    SV_MetricsPrintf("q2pro_overload_frames_skipped_total %u\n", svs.overload.drops);
+
+    write_histogram("snapshot_bytes", "Size of client frame datagrams.", &met.snapshot_bytes,
+                    snapshot_bounds, q_countof(snapshot_bounds), 1);
+
+    SV_MetricsHeader("snapshot_entities_total", "counter", "Entities sent in client frames.");
+    SV_MetricsPrintf("q2pro_snapshot_entities_total %"PRIu64"\n", met.snapshot_entities);
+
+    SV_MetricsHeader("edicts", "gauge", "Number of edicts in use by game.");
+    SV_MetricsPrintf("q2pro_edicts %d\n", ge ? ge->num_edicts : 0);
+
+    SV_MetricsHeader("maxclients", "gauge", "Maximum number of clients.");
+    SV_MetricsPrintf("q2pro_maxclients %d\n", sv_maxclients->integer);
+
+    FOR_EACH_CLIENT(client)
+        if (client->state <= cs_spawned)
+            states[client->state]++;
+
+    SV_MetricsHeader("clients", "gauge", "Number of clients by state.");
+    for (i = cs_zombie; i <= cs_spawned; i++)
+        SV_MetricsPrintf("q2pro_clients{state=\"%s\"} %d\n", statenames[i], states[i]);
+}
+
+#define CLIENT_METRIC(metric, type, help, fmt, value) \
+    do { \
+        SV_MetricsHeader(metric, type, help); \
+        FOR_EACH_CLIENT(client) { \
+            if (client->state < cs_connected) \
+                continue; \
+            SV_MetricsPrintf("q2pro_" metric "{client=\"%d\",name=\"%s\"} " fmt "\n", \
+                             client->number, SV_MetricsLabel(client->name), value); \
+        } \
+    } while (0)
+
+static void write_clients(void)
+{
+    client_t *client;
+
+    CLIENT_METRIC("client_ping_ms", "gauge", "Client ping.",
+                  "%d", client->ping);
+    CLIENT_METRIC("client_ping_avg_ms", "gauge", "Client average ping.",
+                  "%d", AVG_PING(client));
+    CLIENT_METRIC("client_loss_s2c_ratio", "gauge", "Server to client packet loss.",
+                  "%.4f", PL_S2C(client) / 100);
+    CLIENT_METRIC("client_loss_c2s_ratio", "gauge", "Client to server packet loss.",
+                  "%.4f", PL_C2S(client) / 100);
+    CLIENT_METRIC("client_rate_bytes", "gauge", "Client rate limit.",
+                  "%u", client->rate);
+    CLIENT_METRIC("client_rate_drops_total", "counter", "Client frames suppressed due to rate limit.",
+                  "%u", client->rate_drops);
+    CLIENT_METRIC("client_overload_drops_total", "counter", "Client frames skipped due to overload.",
+                  "%u", client->overload_drops);
+    CLIENT_METRIC("client_frames_sent_total", "counter", "Client frames sent.",
+                  "%u", client->frames_sent);
+}
+
+#undef CLIENT_METRIC
+
+static void write_network(void)
+{
+    netstats_t stats;
+
+    NET_GetStats(&stats);
+
+    SV_MetricsHeader("net_bytes_total", "counter", "UDP bytes.");
+    SV_MetricsPrintf("q2pro_net_bytes_total{dir=\"rx\"} %"PRIu64"\n", stats.bytes_rcvd);
+    SV_MetricsPrintf("q2pro_net_bytes_total{dir=\"tx\"} %"PRIu64"\n", stats.bytes_sent);
+
+    SV_MetricsHeader("net_packets_total", "counter", "UDP packets.");
+    SV_MetricsPrintf("q2pro_net_packets_total{dir=\"rx\"} %"PRIu64"\n", stats.packets_rcvd);
+    SV_MetricsPrintf("q2pro_net_packets_total{dir=\"tx\"} %"PRIu64"\n", stats.packets_sent);
+
+    SV_MetricsHeader("net_errors_total", "counter", "UDP errors.");
+    SV_MetricsPrintf("q2pro_net_errors_total{dir=\"rx\"} %"PRIu64"\n", stats.recv_errors);
+    SV_MetricsPrintf("q2pro_net_errors_total{dir=\"tx\"} %"PRIu64"\n", stats.send_errors);
+}
+
+static void write_zone(void)
+{
+    size_t bytes, count;
+    const char *name;
+    int i;
+
+    SV_MetricsHeader("zone_bytes", "gauge", "Zone memory allocated per tag.");
+    for (i = 0; i < TAG_MAX; i++)
+        if ((name = Z_TagStats(i, &bytes, &count)))
+            SV_MetricsPrintf("q2pro_zone_bytes{tag=\"%s\"} %zu\n", name, bytes);
+
+    SV_MetricsHeader("zone_blocks", "gauge", "Zone memory blocks allocated per tag.");
+    for (i = 0; i < TAG_MAX; i++)
+        if ((name = Z_TagStats(i, &bytes, &count)))
+            SV_MetricsPrintf("q2pro_zone_blocks{tag=\"%s\"} %zu\n", name, count);
+}
+
+/*
+=================
+SV_GetMetrics
+
+Returns all metrics as text. Buffer is valid until the next call.
+=================
+*/
+const char *SV_GetMetrics(size_t *len)
+{
+    met_len = 0;
+
+    write_server();
+    write_clients();
+    write_network();
+    write_zone();
+    SV_MvdMetrics();
+
+    *len = met_len;
+    return met_data ? met_data : "";
+}
+
+static void write_file(void)
+{
+    char path[MAX_OSPATH], temp[MAX_OSPATH];
+    const char *data;
+    size_t len;
+    int ret;
+
+    if (Q_concat(path, sizeof(path), "metrics/", sv_metrics_file->string, ".prom") >= sizeof(path) ||
+        Q_concat(temp, sizeof(temp), path, ".tmp") >= sizeof(temp)) {
+        Com_EPrintf("Metrics file name too long\n");
+        Cvar_Set("sv_metrics_file", "");
+        return;
+    }
+
+    data = SV_GetMetrics(&len);
+
+    // replace atomically, so that scrapers never see partial file
+    ret = FS_WriteFile(temp, data, len);
+    if (!ret)
+        ret = FS_RenameFile(temp, path);
+    if (ret) {
+        Com_EPrintf("Couldn't write %s: %s\n", path, Q_ErrorString(ret));
+        Cvar_Set("sv_metrics_file", "");
+    }
+}
+
+void SV_RunMetrics(void)
+{
+    if (!sv_metrics_file->string[0])
+        return;
+
+    if (svs.realtime - met_write_time < Cvar_ClampInteger(sv_metrics_interval, 1, 3600) * 1000)
+        return;
+
+    met_write_time = svs.realtime;
+    write_file();
+}
+
+void SV_RegisterMetrics(void)
+{
+    sv_metrics = Cvar_Get("sv_metrics", "0", 0);
+    sv_metrics_file = Cvar_Get("sv_metrics_file", "", 0);
+    sv_metrics_interval = Cvar_Get("sv_metrics_interval", "15", 0);
+}
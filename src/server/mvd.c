@@ -29,6 +29,8 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #define FOR_EACH_ACTIVE_GTV(client) \
     LIST_FOR_EACH(gtv_client_t, client, &gtv_active_list, active)
 
+#define MAX_HTTP_REQUEST    4096    // maximum metrics request length
+
 typedef struct {
     list_t      entry;
     list_t      active;
@@ -40,6 +42,9 @@ typedef struct {
     unsigned    msglen;
     unsigned    lastmessage;
 
+    unsigned    httplen;    // length of HTTP request read so far
+    uint32_t    httptail;   // last 4 bytes of HTTP request
+
     unsigned    flags;
     unsigned    maxbuf;
     unsigned    bufcount;
@@ -1635,6 +1640,69 @@ static void parse_stringcmd(gtv_client_t *client)
     dummy_command();
 }
 
+// answers plain HTTP request on GTV port with server metrics
+static void serve_metrics(gtv_client_t *client)
+{
+    char header[256];
+    const char *data = "";
+    size_t len = 0, hlen;
+
+    if (!auth_client(client, "")) {
+        hlen = Q_scnprintf(header, sizeof(header),
+                           "HTTP/1.0 403 Forbidden\r\n"
+                           "Content-Length: 0\r\n"
+                           "Connection: close\r\n\r\n");
+    } else {
+        data = SV_GetMetrics(&len);
+        hlen = Q_scnprintf(header, sizeof(header),
+                           "HTTP/1.0 200 OK\r\n"
+                           "Content-Type: text/plain; version=0.0.4\r\n"
+                           "Content-Length: %zu\r\n"
+                           "Connection: close\r\n\r\n", len);
+    }
+
+    // response is sent in whole, then connection is closed
+    client->data = SV_Malloc(hlen + len);
+    client->stream.send.data = client->data;
+    client->stream.send.size = hlen + len;
+    FIFO_Write(&client->stream.send, header, hlen);
+    FIFO_Write(&client->stream.send, data, len);
+
+    Com_DPrintf("TCP client [%s] requested metrics\n",
+                NET_AdrToString(&client->stream.address));
+    drop_client(client, NULL);
+}
+
+// reads HTTP request up to empty line before answering it, so that closing
+// connection with unread data doesn't reset it
+static void read_http_request(gtv_client_t *client)
+{
+    fifo_t *fifo = &client->stream.recv;
+    byte *data;
+    size_t i, len;
+
+    while (1) {
+        data = FIFO_Peek(fifo, &len);
+        if (!len) {
+            return;
+        }
+        for (i = 0; i < len; i++) {
+            client->httptail = (client->httptail << 8) | data[i];
+            if (client->httptail == 0x0d0a0d0a) {
+                FIFO_Decommit(fifo, i + 1);
+                serve_metrics(client);
+                return;
+            }
+        }
+        FIFO_Decommit(fifo, len);
+        client->httplen += len;
+        if (client->httplen > MAX_HTTP_REQUEST) {
+            drop_client(client, "oversize HTTP request");
+            return;
+        }
+    }
+}
+
 static bool parse_message(gtv_client_t *client)
 {
     uint32_t magic;
@@ -1647,9 +1715,18 @@ static bool parse_message(gtv_client_t *client)
 
     // check magic
     if (client->state < cs_connected) {
+        if (client->httplen) {
+            read_http_request(client);
+            return false;
+        }
         if (!FIFO_TryRead(&client->stream.recv, &magic, 4)) {
             return false;
         }
+        if (magic == MakeRawLong('G','E','T',' ') && sv_metrics->integer) {
+            client->httplen = 4;
+            read_http_request(client);
+            return false;
+        }
         if (magic != MVD_MAGIC) {
             drop_client(client, "not a MVD/GTV stream");
             return false;
@@ -1857,6 +1934,23 @@ void SV_MvdRunClients(void)
     }
 }
 
+void SV_MvdMetrics(void)
+{
+    gtv_client_t *client;
+
+    SV_MetricsHeader("mvd_clients", "gauge", "Number of MVD/GTV clients receiving stream.");
+    SV_MetricsPrintf("q2pro_mvd_clients %d\n", List_Count(&gtv_active_list));
+
+    SV_MetricsHeader("mvd_client_backlog_bytes", "gauge", "Data queued for MVD/GTV client.");
+    FOR_EACH_GTV(client) {
+        if (client->state < cs_primed)
+            continue;
+        SV_MetricsPrintf("q2pro_mvd_client_backlog_bytes{client=\"%d\",name=\"%s\"} %zu\n",
+                         (int)(client - mvd.clients), SV_MetricsLabel(client->name),
+                         FIFO_Usage(&client->stream.send));
+    }
+}
+
 static void dump_clients(void)
 {
     gtv_client_t    *client;
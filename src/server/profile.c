@@ -0,0 +1,215 @@
+/*
+Copyright (C) 2026 agent <agent@local>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+//
+// profile.c -- server frame phase timings
+//
+
+#include "server.h"
+
+// must be power of two
+#define PROF_EVENTS     0x10000
+#define PROF_MASK       (PROF_EVENTS - 1)
+
+typedef struct {
+    uint64_t    start;      // microseconds
+    uint32_t    usec;
+    uint16_t    phase;
+    int16_t     arg;        // client number or -1
+} profevent_t;
+
+// events are only recorded from the main thread, so the ring needs no
+// locking: the writer just keeps overwriting the oldest slot
+static profevent_t  *prof_events;
+static unsigned     prof_head;
+
+// phases summed up until the next server frame
+static struct {
+    uint64_t    start;
+    uint64_t    usec;
+} prof_sums[PROF_MAX];
+
+cvar_t  *sv_profile;
+
+static const char *const prof_names[PROF_MAX] = {
+    [PROF_FRAME]            = "frame",
+    [PROF_PACKETS]          = "packets",
+    [PROF_ASYNC]            = "async",
+    [PROF_GAME]             = "game",
+    [PROF_SEND]             = "send",
+    [PROF_CLIENT_FRAME]     = "client_frame",
+    [PROF_CLIENT_THINK]     = "ClientThink",
+    [PROF_CLIENT_COMMAND]   = "ClientCommand",
+};
+
+static void add_event(prof_phase_t phase, uint64_t start, uint64_t usec, int arg)
+{
+    profevent_t *ev;
+
+    if (!prof_events)
+        prof_events = Z_Malloc(sizeof(prof_events[0]) * PROF_EVENTS);
+
+    ev = &prof_events[prof_head++ & PROF_MASK];
+    ev->start = start;
+    ev->usec = min(usec, UINT32_MAX);
+    ev->phase = phase;
+    ev->arg = arg;
+}
+
+void SV_ProfileRecord(prof_phase_t phase, uint64_t start, int arg)
+{
+    add_event(phase, start, Sys_Microseconds() - start, arg);
+}
+
+void SV_ProfileAccumulate(prof_phase_t phase, uint64_t start)
+{
+    if (!prof_sums[phase].start)
+        prof_sums[phase].start = start;
+    prof_sums[phase].usec += Sys_Microseconds() - start;
+}
+
+void SV_ProfileFlush(prof_phase_t phase)
+{
+    if (prof_sums[phase].start)
+        add_event(phase, prof_sums[phase].start, prof_sums[phase].usec, -1);
+    prof_sums[phase].start = 0;
+    prof_sums[phase].usec = 0;
+}
+
+static unsigned prof_count(void)
+{
+    return prof_events ? min(prof_head, PROF_EVENTS) : 0;
+}
+
+static int prof_cmp(const void *p1, const void *p2)
+{
+    uint32_t a = *(const uint32_t *)p1;
+    uint32_t b = *(const uint32_t *)p2;
+    return a < b ? -1 : a > b;
+}
+
+static void SV_ProfileStats_f(void)
+{
+    unsigned i, count = prof_count();
+    uint32_t *times;
+
+    if (!count) {
+        Com_Printf("No profile events recorded. Set sv_profile to 1 to enable.\n");
+        return;
+    }
+
+    times = Z_Malloc(sizeof(times[0]) * count);
+
+    Com_Printf("%u events, times in usec\n"
+               "phase           count      p50      p99      max\n"
+               "--------------- ------ -------- -------- --------\n", count);
+
+    for (int phase = 0; phase < PROF_MAX; phase++) {
+        unsigned n = 0;
+
+        for (i = 0; i < count; i++)
+            if (prof_events[i].phase == phase)
+                times[n++] = prof_events[i].usec;
+
+        if (!n)
+            continue;
+
+        qsort(times, n, sizeof(times[0]), prof_cmp);
+        Com_Printf("%-15s %6u %8u %8u %8u\n", prof_names[phase], n,
+                   times[n / 2], times[n * 99 / 100], times[n - 1]);
+    }
+
+    Z_Free(times);
+}
+
+static void SV_ProfileDump_f(void)
+{
+    char buffer[MAX_OSPATH];
+    unsigned i, count = prof_count();
+    uint64_t base;
+    qhandle_t f;
+
+    if (Cmd_Argc() < 2) {
+        Com_Printf("Usage: %s <filename>\n", Cmd_Argv(0));
+        return;
+    }
+
+    if (!count) {
+        Com_Printf("No profile events recorded.\n");
+        return;
+    }
+
+    f = FS_EasyOpenFile(buffer, sizeof(buffer), FS_MODE_WRITE | FS_FLAG_TEXT,
+                        "profiles/", Cmd_Argv(1), ".json");
+    if (!f)
+        return;
+
+    // oldest event first, timestamps relative to it
+    unsigned first = prof_head - count;
+    base = prof_events[first & PROF_MASK].start;
+
+    FS_FPrintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    for (i = 0; i < count; i++) {
+        const profevent_t *ev = &prof_events[(first + i) & PROF_MASK];
+        // summed up phases don't nest with others, show them separately
+        int tid = (ev->phase == PROF_PACKETS || ev->phase == PROF_ASYNC) + 1;
+
+        FS_FPrintf(f, "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,"
+                   "\"ts\":%"PRIu64",\"dur\":%u", prof_names[ev->phase], tid,
+                   ev->start - base, ev->usec);
+        if (ev->arg >= 0)
+            FS_FPrintf(f, ",\"args\":{\"client\":%d}", ev->arg);
+        FS_FPrintf(f, "}%s\n", i < count - 1 ? "," : "");
+    }
+    FS_FPrintf(f, "]}\n");
+
+    if (FS_CloseFile(f))
+        Com_EPrintf("Error writing %s\n", buffer);
+    else
+        Com_Printf("Wrote %u events to %s\n", count, buffer);
+}
+
+static void SV_ProfileClear_f(void)
+{
+    prof_head = 0;
+    memset(prof_sums, 0, sizeof(prof_sums));
+}
+
+static void sv_profile_changed(cvar_t *self)
+{
+    if (!self->integer) {
+        SV_ProfileClear_f();
+        Z_Free(prof_events);
+        prof_events = NULL;
+    }
+}
+
+static const cmdreg_t c_profile[] = {
+    { "profilestats", SV_ProfileStats_f },
+    { "profiledump", SV_ProfileDump_f },
+    { "profileclear", SV_ProfileClear_f },
+    { NULL }
+};
+
+void SV_RegisterProfile(void)
+{
+    sv_profile = Cvar_Get("sv_profile", "0", 0);
+    sv_profile->changed = sv_profile_changed;
+
+    Cmd_Register(c_profile);
+}
@@ -17,6 +17,11 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 */
 
 #include "server.h"
+#include "common/async.h"
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
 
 #define SAVE_MAGIC1     MakeLittleLong('S','S','V','2')
 #define SAVE_MAGIC2     MakeLittleLong('S','A','V','2')
@@ -41,13 +46,362 @@ typedef enum {
 } loadtype_t;
 
 static cvar_t   *sv_noreload;
+static cvar_t   *sv_savegame_async;
 
 static bool have_enhanced_savegames(void);
 
-static int write_server_file(savetype_t autosave)
+/*
+==============================================================================
+
+SAVE JOBS
+
+Game state is captured into memory synchronously, but writing files and
+copying save slots is left to async work thread. Files are never written
+in place, but replaced by renaming a temporary file, so that save slots can
+share files with hardlinks.
+
+==============================================================================
+*/
+
+#define MAX_SAVE_OPS    8
+
+typedef enum {
+    SAVEOP_WRITE,   // write data to file
+    SAVEOP_WIPE,    // remove save files from directory
+    SAVEOP_COPY,    // copy save files from another directory
+} saveop_type_t;
+
+typedef struct {
+    saveop_type_t   type;
+    char            path[MAX_QPATH];    // file or directory below save/
+    char            src[MAX_QPATH];     // source directory for SAVEOP_COPY
+    byte            *data;
+    size_t          len;
+} saveop_t;
+
+typedef struct {
+    list_t      entry;
+    bool        queued;
+    char        gamedir[MAX_OSPATH];
+    saveop_t    ops[MAX_SAVE_OPS];
+    int         numops;
+    int         failed;     // index of failed op
+    int         error;
+    const char  *message;   // printed on success
+} savejob_t;
+
+static LIST_DECL(save_jobs);
+
+static savejob_t *begin_job(void)
+{
+    savejob_t *job = Z_Mallocz(sizeof(*job));
+
+    Q_strlcpy(job->gamedir, fs_gamedir, sizeof(job->gamedir));
+    job->failed = -1;
+    return job;
+}
+
+static saveop_t *add_op(savejob_t *job, saveop_type_t type, const char *path)
+{
+    saveop_t *op;
+
+    Q_assert(job->numops < MAX_SAVE_OPS);
+    op = &job->ops[job->numops++];
+    op->type = type;
+    Q_strlcpy(op->path, path, sizeof(op->path));
+    return op;
+}
+
+static void add_copy(savejob_t *job, const char *src, const char *dst)
+{
+    saveop_t *op = add_op(job, SAVEOP_COPY, dst);
+
+    Q_strlcpy(op->src, src, sizeof(op->src));
+}
+
+static void free_job(savejob_t *job)
+{
+    for (int i = 0; i < job->numops; i++)
+        Z_Free(job->ops[i].data);
+    Z_Free(job);
+}
+
+// appends contents of msg_write to file data
+static void append_msg(saveop_t *op)
+{
+    op->data = Z_Realloc(op->data, op->len + msg_write.cursize);
+    memcpy(op->data + op->len, msg_write.data, msg_write.cursize);
+    op->len += msg_write.cursize;
+    SZ_Clear(&msg_write);
+}
+
+static void **list_save_dir(const savejob_t *job, const char *dir, int *count)
+{
+    char path[MAX_OSPATH];
+    listfiles_t list = {
+        .filter = ".ssv;.sav;.sv2",
+        .flags = FS_SEARCH_RECURSIVE,
+    };
+
+    list.baselen = Q_concat(path, sizeof(path), job->gamedir, "/save/", dir) + 1;
+    if (list.baselen > sizeof(path))
+        return NULL;
+
+    Sys_ListFiles_r(&list, path, 0);
+    *count = list.count;
+    return list.files;
+}
+
+static void free_list(void **list, int count)
+{
+    for (int i = 0; i < count; i++)
+        Z_Free(list[i]);
+    Z_Free(list);
+}
+
+static int write_file(const savejob_t *job, const saveop_t *op)
+{
+    char    path[MAX_OSPATH], temp[MAX_OSPATH];
+    FILE    *fp;
+    int     ret;
+
+    if (Q_concat(path, sizeof(path), job->gamedir, "/save/", op->path) >= sizeof(path))
+        return Q_ERR(ENAMETOOLONG);
+    if (Q_concat(temp, sizeof(temp), path, ".tmp") >= sizeof(temp))
+        return Q_ERR(ENAMETOOLONG);
+
+    if ((ret = FS_CreatePath(temp)))
+        return ret;
+
+    fp = fopen(temp, "wb");
+    if (!fp)
+        return Q_ERRNO;
+
+    if (fwrite(op->data, 1, op->len, fp) != op->len)
+        ret = Q_ERRNO;
+    if (fclose(fp) && !ret)
+        ret = Q_ERRNO;
+    if (ret) {
+        remove(temp);
+        return ret;
+    }
+
+#ifdef _WIN32
+    remove(path);
+#endif
+    if (rename(temp, path)) {
+        ret = Q_ERRNO;
+        remove(temp);
+    }
+
+    return ret;
+}
+
+static int wipe_dir(const savejob_t *job, const char *dir)
+{
+    char    path[MAX_OSPATH];
+    void    **list;
+    int     i, count, ret = 0;
+
+    if ((list = list_save_dir(job, dir, &count)) == NULL)
+        return 0;
+
+    for (i = 0; i < count && !ret; i++) {
+        if (Q_concat(path, sizeof(path), job->gamedir, "/save/", dir, "/", list[i]) >= sizeof(path))
+            ret = Q_ERR(ENAMETOOLONG);
+        else if (remove(path))
+            ret = Q_ERRNO;
+    }
+
+    free_list(list, count);
+    return ret;
+}
+
+static int copy_file(const char *src, const char *dst)
+{
+    byte    buf[0x10000];
+    FILE    *ifp, *ofp;
+    size_t  len, res;
+    int     ret = 0;
+
+#ifndef _WIN32
+    // files are never modified in place, so sharing them is safe
+    if (!link(src, dst))
+        return 0;
+#endif
+
+    ifp = fopen(src, "rb");
+    if (!ifp)
+        return Q_ERRNO;
+
+    ofp = fopen(dst, "wb");
+    if (!ofp) {
+        ret = Q_ERRNO;
+        fclose(ifp);
+        return ret;
+    }
+
+    do {
+        len = fread(buf, 1, sizeof(buf), ifp);
+        res = fwrite(buf, 1, len, ofp);
+    } while (len == sizeof(buf) && res == len);
+
+    if (ferror(ifp) || ferror(ofp))
+        ret = Q_ERR_FAILURE;
+    if (fclose(ofp) && !ret)
+        ret = Q_ERRNO;
+    fclose(ifp);
+
+    return ret;
+}
+
+static int copy_dir(const savejob_t *job, const char *src, const char *dst)
+{
+    char    srcpath[MAX_OSPATH], dstpath[MAX_OSPATH];
+    void    **list;
+    int     i, count, ret = 0;
+
+    if ((list = list_save_dir(job, src, &count)) == NULL)
+        return Q_ERR(ENOENT);
+
+    for (i = 0; i < count && !ret; i++) {
+        if (Q_concat(srcpath, sizeof(srcpath), job->gamedir, "/save/", src, "/", list[i]) >= sizeof(srcpath) ||
+            Q_concat(dstpath, sizeof(dstpath), job->gamedir, "/save/", dst, "/", list[i]) >= sizeof(dstpath)) {
+            ret = Q_ERR(ENAMETOOLONG);
+            break;
+        }
+        if ((ret = FS_CreatePath(dstpath)))
+            break;
+        remove(dstpath);
+        ret = copy_file(srcpath, dstpath);
+    }
+
+    free_list(list, count);
+    return ret;
+}
+
+// runs on async work thread, must not touch anything else
+static void save_work_cb(void *arg)
+{
+    savejob_t *job = arg;
+    int i, ret = 0;
+
+    for (i = 0; i < job->numops; i++) {
+        const saveop_t *op = &job->ops[i];
+
+        switch (op->type) {
+        case SAVEOP_WRITE:
+            ret = write_file(job, op);
+            break;
+        case SAVEOP_WIPE:
+            ret = wipe_dir(job, op->path);
+            break;
+        case SAVEOP_COPY:
+            ret = copy_dir(job, op->src, op->path);
+            break;
+        }
+
+        if (ret) {
+            job->failed = i;
+            job->error = ret;
+            break;
+        }
+    }
+}
+
+// returns true if job succeeded
+static bool finish_job(savejob_t *job)
+{
+    const saveop_t *op;
+    bool ok = job->failed < 0;
+
+    // files are written directly, make them visible to lookups
+    FS_UpdateIndex();
+
+    if (!ok) {
+        op = &job->ops[job->failed];
+        switch (op->type) {
+        case SAVEOP_WRITE:
+            Com_EPrintf("Couldn't write %s: %s\n", op->path, Q_ErrorString(job->error));
+            break;
+        case SAVEOP_WIPE:
+            Com_EPrintf("Couldn't wipe '%s' directory: %s\n", op->path, Q_ErrorString(job->error));
+            break;
+        case SAVEOP_COPY:
+            Com_EPrintf("Couldn't copy '%s' to '%s': %s\n", op->src, op->path, Q_ErrorString(job->error));
+            break;
+        }
+    } else if (job->message) {
+        Com_Printf("%s", job->message);
+    }
+
+    if (job->queued)
+        List_Remove(&job->entry);
+    free_job(job);
+    return ok;
+}
+
+static void save_done_cb(void *arg)
+{
+    finish_job(arg);
+}
+
+static bool run_job(savejob_t *job)
+{
+    save_work_cb(job);
+    return finish_job(job);
+}
+
+static void wait_for_saves(void)
+{
+    if (!LIST_EMPTY(&save_jobs))
+        Com_WaitAsyncWork();
+}
+
+static void submit_job(savejob_t *job)
+{
+    // jobs queued before async saving was disabled must finish first
+    if (!sv_savegame_async->integer) {
+        wait_for_saves();
+        run_job(job);
+        return;
+    }
+
+    asyncwork_t work = {
+        .work_cb = save_work_cb,
+        .done_cb = save_done_cb,
+        .cb_arg = job,
+    };
+
+    List_Append(&save_jobs, &job->entry);
+    job->queued = true;
+    Com_QueueAsyncWork(&work);
+}
+
+// returns true if any queued job changes this file
+static bool save_pending(const char *dir, const char *name)
+{
+    savejob_t *job;
+    char path[MAX_QPATH];
+    int i;
+
+    Q_concat(path, sizeof(path), dir, "/", name);
+
+    LIST_FOR_EACH(savejob_t, job, &save_jobs, entry) {
+        for (i = 0; i < job->numops; i++) {
+            const saveop_t *op = &job->ops[i];
+            if (op->type == SAVEOP_WRITE ? !strcmp(op->path, path) : !strcmp(op->path, dir))
+                return true;
+        }
+    }
+
+    return false;
+}
+
+static int write_server_file(savejob_t *job, savetype_t autosave)
 {
     cvar_t      *var;
-    int         ret;
+    saveop_t    *op;
 
     // write magic
     MSG_WriteLong(SAVE_MAGIC1);
@@ -80,13 +434,8 @@ static int write_server_file(savetype_t autosave)
     }
 
     // write server state
-    ret = FS_WriteFile("save/" SAVE_CURRENT "/server.ssv",
-                       msg_write.data, msg_write.cursize);
-
-    SZ_Clear(&msg_write);
-
-    if (ret < 0)
-        return -1;
+    op = add_op(job, SAVEOP_WRITE, SAVE_CURRENT "/server.ssv");
+    append_msg(op);
 
     // write game state
     size_t json_size = 0;
@@ -94,30 +443,25 @@ static int write_server_file(savetype_t autosave)
     if (!game_json)
         return -1;
 
-    ret = FS_WriteFile("save/" SAVE_CURRENT "/game.ssv",
-                       game_json, json_size);
-    Z_Free(game_json);
-    if (ret < 0)
-        return -1;
-
+    op = add_op(job, SAVEOP_WRITE, SAVE_CURRENT "/game.ssv");
+    op->data = (byte *)game_json;
+    op->len = json_size;
     return 0;
 }
 
-static int write_level_file(void)
+static int write_level_file(savejob_t *job)
 {
-    char        name[MAX_OSPATH];
-    int         i, ret;
+    char        name[MAX_QPATH];
+    int         i;
     char        *s;
     size_t      len;
     byte        portalbits[MAX_MAP_PORTAL_BYTES];
-    qhandle_t   f;
+    saveop_t    *op;
 
-    if (Q_snprintf(name, MAX_QPATH, "save/" SAVE_CURRENT "/%s.sv2", sv.name) >= MAX_QPATH)
+    if (Q_snprintf(name, MAX_QPATH, SAVE_CURRENT "/%s.sv2", sv.name) >= MAX_QPATH)
         return -1;
 
-    FS_OpenFile(name, &f, FS_MODE_WRITE);
-    if (!f)
-        return -1;
+    op = add_op(job, SAVEOP_WRITE, name);
 
     // write magic
     MSG_WriteLong(SAVE_MAGIC2);
@@ -134,10 +478,8 @@ static int write_level_file(void)
         MSG_WriteData(s, len);
         MSG_WriteByte(0);
 
-        if (msg_write.cursize > msg_write.maxsize / 2) {
-            FS_Write(msg_write.data, msg_write.cursize, f);
-            SZ_Clear(&msg_write);
-        }
+        if (msg_write.cursize > msg_write.maxsize / 2)
+            append_msg(op);
     }
     MSG_WriteShort(i);
 
@@ -145,121 +487,23 @@ static int write_level_file(void)
     MSG_WriteByte(len);
     MSG_WriteData(portalbits, len);
 
-    FS_Write(msg_write.data, msg_write.cursize, f);
-    SZ_Clear(&msg_write);
+    append_msg(op);
 
-    ret = FS_CloseFile(f);
-    if (ret < 0)
+    // write game level
+    if (Q_snprintf(name, MAX_QPATH, SAVE_CURRENT "/%s.sav", sv.name) >= MAX_QPATH)
         return -1;
 
-    // write game level
     size_t json_size = 0;
     char *level_json = ge->WriteLevelJson(false, &json_size); // FIXME: transition flag
     if (!level_json)
         return -1;
 
-    if (Q_snprintf(name, MAX_QPATH, "save/" SAVE_CURRENT "/%s.sav", sv.name) >= MAX_QPATH)
-        ret = -1;
-    else
-        ret = FS_WriteFile(name, level_json, json_size);
-    Z_Free(level_json);
-
-    if (ret < 0)
-        return -1;
+    op = add_op(job, SAVEOP_WRITE, name);
+    op->data = (byte *)level_json;
+    op->len = json_size;
     return 0;
 }
 
-static int copy_file(const char *src, const char *dst, const char *name)
-{
-    char    path[MAX_OSPATH];
-    byte    buf[0x10000];
-    FILE    *ifp, *ofp;
-    size_t  len, res;
-    int     ret = -1;
-
-    if (Q_snprintf(path, MAX_OSPATH, "%s/save/%s/%s", fs_gamedir, src, name) >= MAX_OSPATH)
-        goto fail0;
-
-    ifp = fopen(path, "rb");
-    if (!ifp)
-        goto fail0;
-
-    if (Q_snprintf(path, MAX_OSPATH, "%s/save/%s/%s", fs_gamedir, dst, name) >= MAX_OSPATH)
-        goto fail1;
-
-    if (FS_CreatePath(path))
-        goto fail1;
-
-    ofp = fopen(path, "wb");
-    if (!ofp)
-        goto fail1;
-
-    do {
-        len = fread(buf, 1, sizeof(buf), ifp);
-        res = fwrite(buf, 1, len, ofp);
-    } while (len == sizeof(buf) && res == len);
-
-    if (ferror(ifp))
-        goto fail2;
-
-    if (ferror(ofp))
-        goto fail2;
-
-    ret = 0;
-fail2:
-    ret |= fclose(ofp);
-fail1:
-    ret |= fclose(ifp);
-fail0:
-    return ret;
-}
-
-static int remove_file(const char *dir, const char *name)
-{
-    char path[MAX_OSPATH];
-
-    if (Q_snprintf(path, MAX_OSPATH, "%s/save/%s/%s", fs_gamedir, dir, name) >= MAX_OSPATH)
-        return -1;
-
-    return remove(path);
-}
-
-static void **list_save_dir(const char *dir, int *count)
-{
-    return FS_ListFiles(va("save/%s", dir), ".ssv;.sav;.sv2",
-        SAVE_LOOKUP_FLAGS | FS_SEARCH_RECURSIVE, count);
-}
-
-static int wipe_save_dir(const char *dir)
-{
-    void **list;
-    int i, count, ret = 0;
-
-    if ((list = list_save_dir(dir, &count)) == NULL)
-        return 0;
-
-    for (i = 0; i < count; i++)
-        ret |= remove_file(dir, list[i]);
-
-    FS_FreeList(list);
-    return ret;
-}
-
-static int copy_save_dir(const char *src, const char *dst)
-{
-    void **list;
-    int i, count, ret = 0;
-
-    if ((list = list_save_dir(src, &count)) == NULL)
-        return -1;
-
-    for (i = 0; i < count; i++)
-        ret |= copy_file(src, dst, list[i]);
-
-    FS_FreeList(list);
-    return ret;
-}
-
 static int read_binary_file(const char *name)
 {
     qhandle_t f;
@@ -297,6 +541,9 @@ char *SV_GetSaveInfo(const char *dir)
     if (Q_snprintf(name, MAX_QPATH, "save/%s/server.ssv", dir) >= MAX_QPATH)
         return NULL;
 
+    if (save_pending(dir, "server.ssv"))
+        wait_for_saves();
+
     if (read_binary_file(name))
         return NULL;
 
@@ -503,11 +750,14 @@ bool SV_AutoSaveBegin(const mapcmd_t *cmd)
 {
     byte        bitmap[MAX_CLIENTS / CHAR_BIT];
     edict_t     *ent;
+    savejob_t   *job;
     int         i;
 
     // check for clearing the current savegame
     if (cmd->endofunit) {
-        wipe_save_dir(SAVE_CURRENT);
+        job = begin_job();
+        add_op(job, SAVEOP_WIPE, SAVE_CURRENT);
+        submit_job(job);
         return false;
     }
 
@@ -534,8 +784,13 @@ bool SV_AutoSaveBegin(const mapcmd_t *cmd)
     }
 
     // save the map just exited
-    if (write_level_file())
+    job = begin_job();
+    if (write_level_file(job)) {
         Com_EPrintf("Couldn't write level file.\n");
+        free_job(job);
+    } else {
+        submit_job(job);
+    }
 
     // we must restore these for clients to transfer over correctly
     for (i = 0; i < sv_maxclients->integer; i++) {
@@ -548,23 +803,22 @@ bool SV_AutoSaveBegin(const mapcmd_t *cmd)
 
 void SV_AutoSaveEnd(void)
 {
+    savejob_t *job = begin_job();
+
     // save server state
-    if (write_server_file(SAVE_LEVEL_START)) {
+    if (write_server_file(job, SAVE_LEVEL_START)) {
         Com_EPrintf("Couldn't write server file.\n");
+        free_job(job);
         return;
     }
 
     // clear whatever savegames are there
-    if (wipe_save_dir(SAVE_AUTO)) {
-        Com_EPrintf("Couldn't wipe '%s' directory.\n", SAVE_AUTO);
-        return;
-    }
+    add_op(job, SAVEOP_WIPE, SAVE_AUTO);
 
     // copy off the level to the autosave slot
-    if (copy_save_dir(SAVE_CURRENT, SAVE_AUTO)) {
-        Com_EPrintf("Couldn't write '%s' directory.\n", SAVE_AUTO);
-        return;
-    }
+    add_copy(job, SAVE_CURRENT, SAVE_AUTO);
+
+    submit_job(job);
 }
 
 void SV_CheckForSavegame(const mapcmd_t *cmd)
@@ -576,6 +830,10 @@ void SV_CheckForSavegame(const mapcmd_t *cmd)
     if (sv_noreload->integer)
         return;
 
+    if (save_pending(SAVE_CURRENT, va("%s.sv2", sv.name)) ||
+        save_pending(SAVE_CURRENT, va("%s.sav", sv.name)))
+        wait_for_saves();
+
     if (read_level_file()) {
         // only warn when loading a regular savegame. autosave without level
         // file is ok and simply starts the map from the beginning.
@@ -627,6 +885,7 @@ static void SV_Savegame_c(genctx_t *ctx, int argnum)
 
 static void SV_Loadgame_f(void)
 {
+    savejob_t *job;
     char *dir;
 
     if (Cmd_Argc() != 2) {
@@ -640,6 +899,9 @@ static void SV_Loadgame_f(void)
         return;
     }
 
+    // everything is read back immediately
+    wait_for_saves();
+
     // make sure the server files exist
     if (!FS_FileExistsEx(va("save/%s/server.ssv", dir), SAVE_LOOKUP_FLAGS) ||
         !FS_FileExistsEx(va("save/%s/game.ssv", dir), SAVE_LOOKUP_FLAGS)) {
@@ -647,17 +909,12 @@ static void SV_Loadgame_f(void)
         return;
     }
 
-    // clear whatever savegames are there
-    if (wipe_save_dir(SAVE_CURRENT)) {
-        Com_Printf("Couldn't wipe '%s' directory.\n", SAVE_CURRENT);
-        return;
-    }
-
-    // copy it off
-    if (copy_save_dir(dir, SAVE_CURRENT)) {
-        Com_Printf("Couldn't read '%s' directory.\n", dir);
+    // clear whatever savegames are there and copy it off
+    job = begin_job();
+    add_op(job, SAVEOP_WIPE, SAVE_CURRENT);
+    add_copy(job, dir, SAVE_CURRENT);
+    if (!run_job(job))
         return;
-    }
 
     // read server state
     if (read_server_file()) {
@@ -668,6 +925,7 @@ static void SV_Loadgame_f(void)
 
 static void SV_Savegame_f(void)
 {
+    savejob_t *job;
     char *dir;
     savetype_t type;
 
@@ -707,33 +965,32 @@ static void SV_Savegame_f(void)
         type = SAVE_MANUAL;
     }
 
+    job = begin_job();
+
     // archive current level, including all client edicts.
     // when the level is reloaded, they will be shells awaiting
     // a connecting client
-    if (write_level_file()) {
+    if (write_level_file(job)) {
         Com_Printf("Couldn't write level file.\n");
+        free_job(job);
         return;
     }
 
     // save server state
-    if (write_server_file(type)) {
+    if (write_server_file(job, type)) {
         Com_Printf("Couldn't write server file.\n");
+        free_job(job);
         return;
     }
 
     // clear whatever savegames are there
-    if (wipe_save_dir(dir)) {
-        Com_Printf("Couldn't wipe '%s' directory.\n", dir);
-        return;
-    }
+    add_op(job, SAVEOP_WIPE, dir);
 
     // copy it off
-    if (copy_save_dir(SAVE_CURRENT, dir)) {
-        Com_Printf("Couldn't write '%s' directory.\n", dir);
-        return;
-    }
+    add_copy(job, SAVE_CURRENT, dir);
 
-    Com_Printf("Game saved.\n");
+    job->message = "Game saved.\n";
+    submit_job(job);
 }
 
 static const cmdreg_t c_savegames[] = {
@@ -746,6 +1003,7 @@ static const cmdreg_t c_savegames[] = {
 void SV_RegisterSavegames(void)
 {
     sv_noreload = Cvar_Get("sv_noreload", "0", 0);
+    sv_savegame_async = Cvar_Get("sv_savegame_async", "1", 0);
 
     Cmd_Register(c_savegames);
 }
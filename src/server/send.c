@@ -79,6 +79,7 @@ static bool SV_RateDrop(client_t *client)
                    client->framenum, client->name, total);
         client->frameflags |= FF_SUPPRESSED;
         client->suppress_count++;
+        client->rate_drops++;
         client->message_size[client->framenum % RATE_MESSAGES] = 0;
         return true;
     }
@@ -86,6 +87,86 @@ static bool SV_RateDrop(client_t *client)
     return false;
 }
 
+#define OVERLOAD_IDLE_TIME  10000   // msec without any input
+
+/*
+=======================
+SV_UpdateOverload
+
+Tracks server frame time and enters overload mode when it gets close
+to frame duration. Hysteresis prevents flapping around the threshold.
+=======================
+*/
+void SV_UpdateOverload(unsigned usec)
+{
+    unsigned budget;
+
+    svs.overload.frame_usec = (svs.overload.frame_usec * 7 + usec) / 8;
+
+    if (sv_overload_budget->integer <= 0) {
+        svs.overload.active = false;
+        return;
+    }
+
+    budget = SV_FRAMETIME * 10 * min(sv_overload_budget->integer, 100);
+
+    if (!svs.overload.active && svs.overload.frame_usec > budget) {
+        Com_Printf("Server frame time %u usec exceeds budget of %u usec, "
+                   "reducing updates for spectators and idle clients.\n",
+                   svs.overload.frame_usec, budget);
+        svs.overload.active = true;
+        svs.overload.count++;
+    } else if (svs.overload.active && svs.overload.frame_usec < budget * 3 / 4) {
+        Com_Printf("Server frame time %u usec is back within budget.\n",
+                   svs.overload.frame_usec);
+        svs.overload.active = false;
+    }
+}
+
+// active players always get full update rate
+static bool SV_ClientDegradable(const client_t *client)
+{
+    if (client->edict->client && SV_GetClient_PmType(client) == PM_SPECTATOR)
+        return true;
+
+    if (svs.realtime - client->lastactivity > OVERLOAD_IDLE_TIME)
+        return true;
+
+#if USE_FPS
+    // already doesn't need every frame
+    if (client->framediv > 1)
+        return true;
+#endif
+
+    return false;
+}
+
+/*
+=======================
+SV_OverloadDrop
+
+Returns true if every other frame for this client should be
+skipped to reduce server load
+=======================
+*/
+static bool SV_OverloadDrop(client_t *client)
+{
+    if (!svs.overload.active)
+        return false;
+
+    if (!(client->framenum & 1))
+        return false;
+
+    if (!SV_ClientDegradable(client))
+        return false;
+
+    client->frameflags |= FF_SUPPRESSED;
+    client->message_size[client->framenum % RATE_MESSAGES] = 0;
+    client->overload_drops++;
+    svs.overload.drops++;
+    return true;
+}
+
 static void SV_CalcSendTime(client_t *client, unsigned size)
 {
     // never drop over the loopback
@@ -759,6 +840,7 @@ static void write_datagram_old(client_t *client)
 
     // record the size for rate estimation
     SV_CalcSendTime(client, cursize);
+    SV_MetricsSnapshot(client, cursize);
 
     // clear the write buffer
     SZ_Clear(&msg_write);
@@ -825,6 +907,7 @@ static void write_datagram_new(client_t *client)
 
     // record the size for rate estimation
     SV_CalcSendTime(client, cursize);
+    SV_MetricsSnapshot(client, cursize);
 
     // clear the write buffer
     SZ_Clear(&msg_write);
@@ -877,6 +960,9 @@ void SV_SendClientMessages(void)
     client_t    *client;
     int         cursize;
 
+    // entities may have changed since last time
+    SV_ClearSendableEntities();
+
     // send a message to each connected client
     FOR_EACH_CLIENT(client) {
         if (!CLIENT_ACTIVE(client))
@@ -902,6 +988,10 @@ void SV_SendClientMessages(void)
         if (SV_RateDrop(client))
             goto advance;
 
+        // don't overrun server frame time
+        if (SV_OverloadDrop(client))
+            goto advance;
+
         // don't write any frame data until all fragments are sent
         if (client->netchan.fragment_pending) {
             client->frameflags |= FF_SUPPRESSED;
@@ -911,8 +1001,10 @@ void SV_SendClientMessages(void)
         }
 
         // build the new frame and write it
+        uint64_t prof = SV_ProfileBegin();
         SV_BuildClientFrame(client);
         client->WriteDatagram(client);
+        SV_ProfileEnd(PROF_CLIENT_FRAME, prof, client->number);
 
 advance:
         // advance for next frame
@@ -950,7 +1042,7 @@ static void write_pending_download(client_t *client)
     SZ_WriteByte(buf, client->downloadcmd);
     SZ_WriteShort(buf, chunk);
     SZ_WriteByte(buf, client->downloadcount * 100 / client->downloadsize);
-    SZ_Write(buf, client->download + client->downloadcount - chunk, chunk);
+    SZ_Write(buf, client->download->data + client->downloadcount - chunk, chunk);
 
     if (client->downloadcount == client->downloadsize) {
         SV_CloseDownload(client);
@@ -232,6 +232,24 @@ typedef struct {
 
 #define RATE_MESSAGES   10
 
+typedef enum {
+    DL_RAW,         // file contents
+    DL_PKZ,         // raw deflate stream read from .pkz
+    DL_DEFLATED     // raw deflate stream compressed by server
+} dltype_t;
+
+// file contents shared between all clients downloading it
+typedef struct {
+    list_t      entry;
+    int         refcount;
+    dltype_t    type;
+    int         srcsize;    // size and modification time on disk,
+    int64_t     srcmtime;   // to notice changed files
+    int         size;       // 0 if compression didn't pay off
+    byte        *data;
+    char        name[1];
+} dlfile_t;
+
 #define FOR_EACH_CLIENT(client) \
     LIST_FOR_EACH(client_t, client, &sv_clientlist, entry)
 
@@ -310,13 +328,14 @@ typedef struct client_s {
     // rate dropping
     unsigned        message_size[RATE_MESSAGES];    // used to rate drop normal packets
     int             suppress_count;                 // number of messages rate suppressed
+    unsigned        rate_drops;                     // total frames rate suppressed
+    unsigned        overload_drops;                 // frames skipped while server overloaded
     unsigned        send_time, send_delta;          // used to rate drop async packets
 
     // current download
-    byte            *download;      // file being downloaded
+    dlfile_t        *download;      // file being downloaded
     int             downloadsize;   // total bytes (can't use EOF because of paks)
     int             downloadcount;  // bytes sent
-    char            *downloadname;  // name of the file
     int             downloadcmd;    // svc_(z)download
     bool            downloadpending;
 
@@ -488,6 +507,13 @@ typedef struct {
     ratelimit_t     ratelimit_rcon;
 
     challenge_t     challenges[MAX_CHALLENGES]; // to prevent invalid IPs from connecting
+
+    struct {
+        bool        active;
+        unsigned    frame_usec;     // smoothed server frame time
+        unsigned    count;          // number of times overload was detected
+        unsigned    drops;          // frames skipped while overloaded
+    } overload;
 } server_static_t;
 
 //=============================================================================
@@ -530,6 +556,7 @@ extern cvar_t       *sv_max_download_size;
 extern cvar_t       *sv_max_packet_entities;
 extern cvar_t       *sv_trunc_packet_entities;
 extern cvar_t       *sv_prioritize_entities;
+extern cvar_t       *sv_overload_budget;
 
 extern cvar_t       *sv_strafejump_hack;
 #if USE_PACKETDUP
@@ -617,6 +644,7 @@ void SV_FlushRedirect(int redirected, const char *outputbuf, size_t len);
 
 void SV_SendClientMessages(void);
 void SV_SendAsyncPackets(void);
+void SV_UpdateOverload(unsigned usec);
 
 void SV_Multicast(const vec3_t origin, multicast_t to, bool reliable);
 void SV_ClientPrintf(client_t *cl, int level, const char *fmt, ...) q_printf(3, 4);
@@ -652,6 +680,7 @@ void SV_MvdStartSound(int entnum, int channel, int flags,
 
 void SV_MvdRecord_f(void);
 void SV_MvdStop_f(void);
+void SV_MvdMetrics(void);
 #else
 #define SV_MvdRegister()            (void)0
 #define SV_MvdPreInit()             (void)0
@@ -663,6 +692,7 @@ void SV_MvdStop_f(void);
 #define SV_MvdStatus_f()            (void)0
 #define SV_MvdMapChanged()          (void)0
 #define SV_MvdClientDropped(client) (void)0
+#define SV_MvdMetrics()             (void)0
 
 #define SV_MvdUnicast(ent, clientNum, reliable)     (void)0
 #define SV_MvdMulticast(leafnum, to, reliable)      (void)0
@@ -755,6 +785,7 @@ static inline void SV_CheckEntityNumber(edict_t *ent, int e, const char *func)
 
 #define SV_CheckEntityNumber(ent, e) SV_CheckEntityNumber(ent, e, __func__)
 
+void SV_ClearSendableEntities(void);
 void SV_BuildClientFrame(client_t *client);
 bool SV_WriteFrameToClient_Default(client_t *client, unsigned maxsize);
 bool SV_WriteFrameToClient_Enhanced(client_t *client, unsigned maxsize);
@@ -788,6 +819,97 @@ void SV_RegisterSavegames(void);
 #define SV_RegisterSavegames()          (void)0
 #endif
 
+//
+// sv_profile.c
+//
+typedef enum {
+    PROF_FRAME,
+    PROF_PACKETS,
+    PROF_ASYNC,
+    PROF_GAME,
+    PROF_SEND,
+    PROF_CLIENT_FRAME,
+    PROF_CLIENT_THINK,
+    PROF_CLIENT_COMMAND,
+
+    PROF_MAX
+} prof_phase_t;
+
+extern cvar_t   *sv_profile;
+
+void SV_ProfileRecord(prof_phase_t phase, uint64_t start, int arg);
+void SV_ProfileAccumulate(prof_phase_t phase, uint64_t start);
+void SV_ProfileFlush(prof_phase_t phase);
+void SV_RegisterProfile(void);
+
+static inline uint64_t SV_ProfileBegin(void)
+{
+    return sv_profile->integer ? Sys_Microseconds() : 0;
+}
+
+static inline void SV_ProfileEnd(prof_phase_t phase, uint64_t start, int arg)
+{
+    if (start)
+        SV_ProfileRecord(phase, start, arg);
+}
+
+// for phases that run many times between server frames
+static inline void SV_ProfileAdd(prof_phase_t phase, uint64_t start)
+{
+    if (start)
+        SV_ProfileAccumulate(phase, start);
+}
+
+//
+// sv_download.c
+//
+dlfile_t *SV_LoadDownload(const char *name, qhandle_t f, int size, bool pkz);
+#if USE_ZLIB
+dlfile_t *SV_DeflateDownload(dlfile_t *raw);
+#endif
+void SV_ReleaseDownload(dlfile_t *file);
+void SV_DownloadCacheInfo(void);
+void SV_FlushDownloads(void);
+void SV_RegisterDownloads(void);
+
+//
+// sv_metrics.c
+//
+extern cvar_t   *sv_metrics;
+
+void SV_MetricsFrame(unsigned usec);
+void SV_MetricsSnapshot(client_t *client, unsigned size);
+void SV_MetricsPrintf(const char *fmt, ...) q_printf(1, 2);
+void SV_MetricsHeader(const char *name, const char *type, const char *help);
+const char *SV_MetricsLabel(const char *s);
+const char *SV_GetMetrics(size_t *len);
+void SV_RunMetrics(void);
+void SV_RegisterMetrics(void);
+
+//
+// sv_capture.c
+//
+bool SV_CaptureFrame(unsigned *msec);
+void SV_CaptureFrameTime(uint64_t usec);
+bool SV_CaptureReplayPackets(void (*packet_cb)(void));
+void SV_CapturePacket(void);
+void SV_CaptureSpawn(const mapcmd_t *cmd);
+void SV_CaptureStop(void);
+void SV_RegisterCapture(void);
+
+//
+// sv_loadgen.c
+//
+#if USE_TESTS
+void SV_RunLoadgen(void);
+void SV_StopLoadgen(void);
+void SV_RegisterLoadgen(void);
+#else
+#define SV_RunLoadgen()         (void)0
+#define SV_StopLoadgen()        (void)0
+#define SV_RegisterLoadgen()    (void)0
+#endif
+
 //
 // ugly gclient_(old|new)_t accessors
 //
@@ -808,6 +930,11 @@ static inline int SV_GetClient_Stat(const client_t *client, int stat)
     return ((const gclient_t *)client->edict->client)->ps.stats[stat];
 }
 
+static inline int SV_GetClient_PmType(const client_t *client)
+{
+    return ((const gclient_t *)client->edict->client)->ps.pmove.pm_type;
+}
+
 static inline void SV_SetClient_Ping(const client_t *client, int ping)
 {
     ((gclient_t *)client->edict->client)->ping = ping;
@@ -864,6 +991,10 @@ trace_t q_gameabi SV_Trace(const vec3_t start, const vec3_t mins,
 
 // passedict is explicitly excluded from clipping checks (normally NULL)
 
+void SV_TraceWorld(worldtrace_t *traces, int count);
+void SV_TraceEntities(worldtrace_t *wt, edict_t *passedict);
+// same as SV_Trace(), split in two parts for parallel clipping to world
+
 trace_t q_gameabi SV_Clip(const vec3_t start, const vec3_t mins,
                           const vec3_t maxs, const vec3_t end,
                           edict_t *clip, contents_t contentmask);
@@ -483,8 +483,10 @@ void SV_Begin_f(void)
 
 void SV_CloseDownload(client_t *client)
 {
-    Z_Freep(&client->download);
-    Z_Freep(&client->downloadname);
+    if (client->download) {
+        SV_ReleaseDownload(client->download);
+        client->download = NULL;
+    }
     client->downloadsize = 0;
     client->downloadcount = 0;
     client->downloadcmd = 0;
@@ -512,10 +514,10 @@ SV_BeginDownload_f
 static void SV_BeginDownload_f(void)
 {
     char    name[MAX_QPATH];
-    byte    *download;
+    dlfile_t *download;
     int     downloadcmd;
     int64_t downloadsize;
-    int     maxdownloadsize, result, offset = 0;
+    int     maxdownloadsize, offset = 0;
     cvar_t  *allow;
     size_t  len;
     qhandle_t f;
@@ -638,27 +640,37 @@ static void SV_BeginDownload_f(void)
         return;
     }
 
-    download = SV_Malloc(downloadsize);
-    result = FS_Read(download, downloadsize, f);
-    if (result != downloadsize) {
+    // clients downloading the same file share it
+    download = SV_LoadDownload(name, f, downloadsize, downloadcmd == svc_rr_zdownload);
+    if (!download) {
         Com_DPrintf("Couldn't download %s to %s\n", name, sv_client->name);
-        goto fail3;
+        goto fail2;
     }
 
     FS_CloseFile(f);
 
+#if USE_ZLIB
+    // compress loose files on the fly, only once
+    if (sv_client->has_zlib && offset == 0 && downloadcmd == svc_download) {
+        dlfile_t *deflated = SV_DeflateDownload(download);
+        if (deflated) {
+            Com_DPrintf("Serving compressed download to %s\n", sv_client->name);
+            SV_ReleaseDownload(download);
+            download = deflated;
+            downloadcmd = svc_rr_zdownload;
+        }
+    }
+#endif
+
     sv_client->download = download;
-    sv_client->downloadsize = downloadsize;
+    sv_client->downloadsize = download->size;
     sv_client->downloadcount = offset;
-    sv_client->downloadname = SV_CopyString(name);
     sv_client->downloadcmd = downloadcmd;
     sv_client->downloadpending = true;
 
     Com_DPrintf("Downloading %s to %s\n", name, sv_client->name);
     return;
 
-fail3:
-    Z_Free(download);
 fail2:
     FS_CloseFile(f);
 fail1:
@@ -683,7 +695,7 @@ static void SV_StopDownload_f(void)
     SV_ClientAddMessage(sv_client, MSG_RELIABLE | MSG_CLEAR);
 
     Com_DPrintf("Download of %s to %s stopped by user request\n",
-                sv_client->downloadname, sv_client->name);
+                sv_client->download->name, sv_client->name);
     SV_CloseDownload(sv_client);
     SV_AlignKeyFrames(sv_client);
 }
@@ -1021,7 +1033,9 @@ static void SV_ExecuteUserCommand(const char *s)
         sv_client->lastactivity = svs.realtime;
     }
 
+    uint64_t prof = SV_ProfileBegin();
     ge->ClientCommand(sv_player);
+    SV_ProfileEnd(PROF_CLIENT_COMMAND, prof, sv_client->number);
 }
 
 /*
@@ -1061,7 +1075,9 @@ static inline void SV_ClientThink(usercmd_t *cmd)
         sv_client->lastactivity = svs.realtime;
     }
 
+    uint64_t prof = SV_ProfileBegin();
     ge->ClientThink(sv_player, cmd);
+    SV_ProfileEnd(PROF_CLIENT_THINK, prof, sv_client->number);
 }
 
 static void SV_SetLastFrame(int lastframe)
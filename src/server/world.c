@@ -18,6 +18,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 // world.c -- world query functions
 
 #include "server.h"
+#include "common/async.h"
 
 /*
 ===============================================================================
@@ -621,6 +622,58 @@ trace_t q_gameabi SV_Trace(const vec3_t start, const vec3_t mins,
     return trace;
 }
 
+#define TRACES_PER_JOB  16
+
+typedef struct {
+    worldtrace_t    *traces;
+    int             count;
+} tracejob_t;
+
+static void trace_world_job(void *arg, int index)
+{
+    const tracejob_t *job = arg;
+    const mnode_t *nodes = SV_WorldNodes();
+    int i, end = min((index + 1) * TRACES_PER_JOB, job->count);
+
+    for (i = index * TRACES_PER_JOB; i < end; i++) {
+        worldtrace_t *wt = &job->traces[i];
+        CM_ParallelBoxTrace(&wt->trace, wt->start, wt->end, wt->mins, wt->maxs,
+                            nodes, wt->contentmask);
+        wt->trace.ent = ge->edicts;
+    }
+}
+
+/*
+==================
+SV_TraceWorld
+
+First half of SV_Trace() for a batch of moves. Clipping to world doesn't
+depend on entities, so it is done in parallel.
+==================
+*/
+void SV_TraceWorld(worldtrace_t *traces, int count)
+{
+    tracejob_t job = { traces, count };
+
+    Com_ParallelWork(trace_world_job, &job, (count + TRACES_PER_JOB - 1) / TRACES_PER_JOB);
+}
+
+/*
+==================
+SV_TraceEntities
+
+Second half of SV_Trace(). Must be called serially.
+==================
+*/
+void SV_TraceEntities(worldtrace_t *wt, edict_t *passedict)
+{
+    if (wt->trace.fraction == 0)
+        return;     // blocked by the world
+
+    SV_ClipMoveToEntities(&wt->trace, wt->start, wt->end, wt->mins, wt->maxs,
+                          passedict, wt->contentmask);
+}
+
 /*
 ==================
 SV_Clip
@@ -891,6 +891,22 @@ unsigned Sys_Milliseconds(void)
     return tm.QuadPart * 1000ULL / timer_freq.QuadPart;
 }
 
+uint64_t Sys_Microseconds(void)
+{
+    LARGE_INTEGER tm;
+    QueryPerformanceCounter(&tm);
+    uint64_t sec = tm.QuadPart / timer_freq.QuadPart;
+    uint64_t rem = tm.QuadPart % timer_freq.QuadPart;
+    return sec * 1000000ULL + rem * 1000000ULL / timer_freq.QuadPart;
+}
+
+int Sys_GetNumCPUs(void)
+{
+    SYSTEM_INFO si;
+    GetSystemInfo(&si);
+    return max(si.dwNumberOfProcessors, 1);
+}
+
 void Sys_AddDefaultConfig(void)
 {
 }